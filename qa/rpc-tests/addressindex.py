@@ -0,0 +1,108 @@
+#!/usr/bin/env python2
+# Copyright (c) 2015-2017 The BlocknetDX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the address and spent indexes: the getaddress* and getspentinfo
+# calls, reorgs, and rebuilding the indexes with -reindex.
+# The reindex is timed with and without the indexes.
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+import time
+
+COIN = 100000000
+
+class AddressIndexTest (BitcoinTestFramework):
+    def setup_network(self, split = False):
+        # the cached chain was built without the indexes
+        self.nodes = start_nodes(2, self.options.tmpdir, extra_args=[['-addressindex', '-spentindex', '-reindex'], []])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def reindex(self, i, extra_args, count):
+        stop_node(self.nodes[i], i)
+        start = time.time()
+        self.nodes[i] = start_node(i, self.options.tmpdir, extra_args + ['-reindex'])
+        while self.nodes[i].getblockcount() < count:
+            time.sleep(0.1)
+        return time.time() - start
+
+    def run_test(self):
+        addr = self.nodes[1].getnewaddress()
+        txid = self.nodes[0].sendtoaddress(addr, 10)
+        self.nodes[0].setgenerate(True, 1)
+        self.sync_all()
+        height = self.nodes[0].getblockcount()
+
+        tx = self.nodes[0].getrawtransaction(txid, 1)
+        n = [out['n'] for out in tx['vout'] if addr in out['scriptPubKey'].get('addresses', [])][0]
+
+        balance = self.nodes[0].getaddressbalance(addr)
+        assert_equal(balance['balance'], 10 * COIN)
+        assert_equal(balance['received'], 10 * COIN)
+        assert_equal(self.nodes[0].getaddresstxids(addr), [txid])
+        utxos = self.nodes[0].getaddressutxos(addr)
+        assert_equal(len(utxos), 1)
+        assert_equal(utxos[0]['txid'], txid)
+        assert_equal(utxos[0]['outputIndex'], n)
+        assert_equal(utxos[0]['satoshis'], 10 * COIN)
+        assert_equal(utxos[0]['height'], height)
+
+        # spend that very output, the change going to a fresh address
+        inputs = [{'txid': txid, 'vout': n}]
+        outputs = {self.nodes[0].getnewaddress(): 4, self.nodes[1].getnewaddress(): 5.999}
+        signed = self.nodes[1].signrawtransaction(self.nodes[1].createrawtransaction(inputs, outputs))
+        assert_equal(signed['complete'], True)
+        spendid = self.nodes[1].sendrawtransaction(signed['hex'])
+        self.nodes[1].setgenerate(True, 1)
+        self.sync_all()
+
+        balance = self.nodes[0].getaddressbalance(addr)
+        assert_equal(balance['balance'], 0)
+        assert_equal(balance['received'], 10 * COIN)
+        assert_equal(self.nodes[0].getaddressutxos(addr), [])
+        assert_equal(self.nodes[0].getaddresstxids(addr), [txid, spendid])
+        deltas = self.nodes[0].getaddressdeltas(addr)
+        assert_equal([d['satoshis'] for d in deltas], [10 * COIN, -10 * COIN])
+        assert_equal([d['height'] for d in deltas], [height, height + 1])
+        assert_equal(self.nodes[0].getaddressdeltas(addr, height + 1, height + 1)[0]['txid'], spendid)
+        spent = self.nodes[0].getspentinfo(txid, n)
+        assert_equal(spent['txid'], spendid)
+        assert_equal(spent['height'], height + 1)
+
+        # disconnecting the block restores the output
+        tip = self.nodes[0].getbestblockhash()
+        self.nodes[0].invalidateblock(tip)
+        assert_equal(self.nodes[0].getaddressbalance(addr)['balance'], 10 * COIN)
+        assert_equal(len(self.nodes[0].getaddressutxos(addr)), 1)
+        assert_equal(self.nodes[0].getaddresstxids(addr), [txid])
+        try:
+            self.nodes[0].getspentinfo(txid, n)
+            raise AssertionError("spent info survived the disconnect")
+        except JSONRPCException as e:
+            assert_equal(e.error['code'], -5)
+        self.nodes[0].reconsiderblock(tip)
+        assert_equal(self.nodes[0].getbestblockhash(), tip)
+        assert_equal(self.nodes[0].getaddressbalance(addr)['balance'], 0)
+
+        # rebuilding from the block files gives the same indexes
+        count = self.nodes[0].getblockcount()
+        tindexed = self.reindex(0, ['-addressindex', '-spentindex'], count)
+        tplain = self.reindex(1, [], count)
+        print("reindex of %d blocks: %.2fs with the indexes, %.2fs without" % (count, tindexed, tplain))
+        assert_equal(self.nodes[0].getaddressdeltas(addr), deltas)
+        assert_equal(self.nodes[0].getspentinfo(txid, n), spent)
+
+        # the calls need the index
+        try:
+            self.nodes[1].getaddressbalance(addr)
+            raise AssertionError("address index used without -addressindex")
+        except JSONRPCException as e:
+            assert_equal(e.error['code'], -5)
+
+if __name__ == '__main__':
+    AddressIndexTest ().main ()
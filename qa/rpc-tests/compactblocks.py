@@ -0,0 +1,76 @@
+#!/usr/bin/env python2
+# Copyright (c) 2015-2017 The BlocknetDX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Block propagation with and without compact blocks: four nodes in a line,
+# blocks mined by the first one after their transactions were relayed to
+# all. Reports how long each block took to reach the last node and how many
+# bytes the nodes received while it propagated, and checks that compact
+# blocks need fewer.
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+import time
+
+ROUNDS = 5
+TXS_PER_BLOCK = 20
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def setup_network(self, compact = True):
+        args = ["-compactblocks=%d" % int(compact), "-debug=net"]
+        self.nodes = start_nodes(4, self.options.tmpdir, [args] * 4)
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 1, 2)
+        connect_nodes_bi(self.nodes, 2, 3)
+        self.is_network_split = False
+        self.sync_all()
+
+    def restart_network(self, compact):
+        stop_nodes(self.nodes)
+        wait_bitcoinds()
+        self.setup_network(compact)
+
+    def bytes_received(self):
+        return sum(node.getnettotals()['totalbytesrecv'] for node in self.nodes[1:])
+
+    def propagate_blocks(self):
+        address = self.nodes[3].getnewaddress()
+        # A recent tip ends the initial download, before which new blocks
+        # are requested whole
+        self.nodes[0].setgenerate(True, 1)
+        self.sync_all()
+        latency = 0.0
+        received = 0
+        for i in range(ROUNDS):
+            for j in range(TXS_PER_BLOCK):
+                self.nodes[0].sendtoaddress(address, 1)
+            sync_mempools(self.nodes)
+
+            received_before = self.bytes_received()
+            start = time.time()
+            blockhash = self.nodes[0].setgenerate(True, 1)[0]
+            while self.nodes[3].getbestblockhash() != blockhash:
+                time.sleep(0.01)
+            latency += time.time() - start
+            sync_blocks(self.nodes)
+            received += self.bytes_received() - received_before
+
+            assert_equal(len(self.nodes[3].getblock(blockhash)['tx']), TXS_PER_BLOCK + 1)
+            assert_equal(self.nodes[3].getrawmempool(), [])
+        return (latency / ROUNDS, received / ROUNDS)
+
+    def run_test(self):
+        (compact_latency, compact_received) = self.propagate_blocks()
+        self.restart_network(False)
+        (full_latency, full_received) = self.propagate_blocks()
+
+        print("compact blocks: %.3fs to propagate over 3 hops, %d bytes received per block" % (compact_latency, compact_received))
+        print("full blocks:    %.3fs to propagate over 3 hops, %d bytes received per block" % (full_latency, full_received))
+        assert_greater_than(full_received, compact_received)
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python2
+# Copyright (c) 2015-2017 The BlocknetDX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Headers-first sync from several peers of unequal bandwidth: nodes 0-2 mine
+# a chain that node 3 then downloads, each of them reached through a proxy
+# limiting what it sends to node 3. Reports how long the sync took and how
+# much each peer sent, and checks that the blocks didn't all come from one
+# peer.
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+import socket
+import threading
+import time
+
+class ThrottledProxy(object):
+    """Forwards connections to a node, sending its data on at a limited rate"""
+
+    def __init__(self, port, target_port, rate):
+        self.target_port = target_port
+        self.rate = rate
+        self.bytes_sent = 0
+        self.lock = threading.Lock()
+        self.server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.server.bind(("127.0.0.1", port))
+        self.server.listen(5)
+        self.start_thread(self.accept)
+
+    def start_thread(self, target, *args):
+        thread = threading.Thread(target=target, args=args)
+        thread.daemon = True
+        thread.start()
+
+    def accept(self):
+        while True:
+            try:
+                client, _ = self.server.accept()
+            except socket.error:
+                return
+            upstream = socket.create_connection(("127.0.0.1", self.target_port))
+            self.start_thread(self.pipe, client, upstream, False)
+            self.start_thread(self.pipe, upstream, client, True)
+
+    def pipe(self, src, dst, throttled):
+        while True:
+            try:
+                data = src.recv(4096)
+            except socket.error:
+                break
+            if not data:
+                break
+            if throttled:
+                with self.lock:
+                    self.bytes_sent += len(data)
+                time.sleep(float(len(data)) / self.rate)
+            try:
+                dst.sendall(data)
+            except socket.error:
+                break
+        src.close()
+        dst.close()
+
+    def close(self):
+        self.server.close()
+
+class HeadersSyncTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--blocks", dest="blocks", default=300, type="int",
+                          help="Blocks node 3 has to download (default: %default)")
+        parser.add_option("--rates", dest="rates", default="20000,200000,200000",
+                          help="Bytes per second nodes 0-2 can send to node 3 (default: %default)")
+
+    def setup_network(self):
+        self.nodes = start_nodes(3, self.options.tmpdir, [["-debug=net"]] * 3)
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 1, 2)
+        self.is_network_split = False
+        sync_blocks(self.nodes)
+
+    def run_test(self):
+        # Node 3 has the 200 cached blocks only
+        self.nodes[0].setgenerate(True, self.options.blocks)
+        sync_blocks(self.nodes)
+        tip = self.nodes[0].getbestblockhash()
+
+        rates = [int(rate) for rate in self.options.rates.split(",")]
+        proxies = [ThrottledProxy(p2p_port(10 + i), p2p_port(i), rates[i]) for i in range(3)]
+        self.nodes.append(start_node(3, self.options.tmpdir, ["-debug=net"]))
+
+        start = time.time()
+        for i in range(3):
+            self.nodes[3].addnode("127.0.0.1:%d" % p2p_port(10 + i), "onetry")
+        while self.nodes[3].getbestblockhash() != tip:
+            time.sleep(0.1)
+        elapsed = time.time() - start
+
+        print("synced %d blocks in %.2fs" % (self.options.blocks, elapsed))
+        for i in range(3):
+            print("  peer %d limited to %d bytes/s sent %d bytes" % (i, rates[i], proxies[i].bytes_sent))
+        assert_equal(self.nodes[3].getblockcount(), self.nodes[0].getblockcount())
+        assert(max(proxy.bytes_sent for proxy in proxies) < sum(proxy.bytes_sent for proxy in proxies) * 0.9)
+
+        for proxy in proxies:
+            proxy.close()
+
+if __name__ == '__main__':
+    HeadersSyncTest().main()
@@ -9,6 +9,7 @@
 
 from test_framework import BitcoinTestFramework
 from util import *
+import binascii
 import json
 
 try:
@@ -82,6 +83,45 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         for tx in txs:
             assert_equal(tx in json_obj['tx'], True)
+
+        # block bodies are streamed from disk, hex and binary must agree
+        bin_block = http_get_call(url.hostname, url.port, '/rest/block/'+newblockhash[0]+self.FORMAT_SEPARATOR+'bin')
+        hex_block = http_get_call(url.hostname, url.port, '/rest/block/'+newblockhash[0]+self.FORMAT_SEPARATOR+'hex')
+        assert_equal(hex_block, binascii.hexlify(bin_block)+"\n")
+        assert_equal(hex_block.strip(), self.nodes[0].getblock(newblockhash[0], False))
+
+        # check headers
+        json_string = http_get_call(url.hostname, url.port, '/rest/headers/1/'+newblockhash[0]+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(len(json_obj), 1)
+        assert_equal(json_obj[0]['hash'], newblockhash[0])
+        bin_headers = http_get_call(url.hostname, url.port, '/rest/headers/5/'+bb_hash+self.FORMAT_SEPARATOR+'bin')
+        assert_equal(len(bin_headers), 2*80) # only the best block at the start and the new one follow
+        response = http_get_call(url.hostname, url.port, '/rest/headers/0/'+bb_hash+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 400)
+
+        # check chaininfo
+        json_string = http_get_call(url.hostname, url.port, '/rest/chaininfo'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['bestblockhash'], newblockhash[0])
+
+        # check getutxos against gettxout, output 9 does not exist
+        json_string = http_get_call(url.hostname, url.port, '/rest/getutxos/'+txs[0]+'-0/'+txs[0]+'-1/'+txs[0]+'-9'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['chaintipHash'], newblockhash[0])
+        bitmap = ''.join(['0' if self.nodes[0].gettxout(txs[0], n, False) is None else '1' for n in [0, 1]]) + '0'
+        assert_equal(json_obj['bitmap'], bitmap)
+        assert_equal(len(json_obj['utxos']), bitmap.count('1'))
+
+        # unconfirmed outputs are only found with checkmempool
+        txid = self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), 1)
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/getutxos/'+txid+'-0'+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(json_obj['bitmap'], "0")
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/getutxos/checkmempool/'+txid+'-0'+self.FORMAT_SEPARATOR+'json'))
+        assert_equal(json_obj['bitmap'], "1")
+
+        response = http_get_call(url.hostname, url.port, '/rest/getutxos/checkmempool'+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 400)
                 
         
 
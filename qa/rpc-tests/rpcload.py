@@ -0,0 +1,127 @@
+#!/usr/bin/env python2
+# Copyright (c) 2015-2017 The BlocknetDX developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Load test for the RPC server: many clients on persistent connections,
+# batch and pipelined requests, checked against getrpcstats.
+# Raise --clients/--requests to use it as a benchmark.
+#
+
+from test_framework import BitcoinTestFramework
+from util import *
+import base64
+import json
+import socket
+import threading
+import time
+
+try:
+    import http.client as httplib
+except ImportError:
+    import httplib
+try:
+    import urllib.parse as urlparse
+except ImportError:
+    import urlparse
+
+class RPCLoadTest (BitcoinTestFramework):
+    def add_options(self, parser):
+        parser.add_option("--clients", dest="clients", default=8, type="int",
+                          help="Number of concurrent RPC clients (default: %default)")
+        parser.add_option("--requests", dest="requests", default=250, type="int",
+                          help="Requests sent by each client (default: %default)")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self, split = False):
+        self.nodes = start_nodes(1, self.options.tmpdir, extra_args=[['-rpcthreads=4', '-rpcworkqueue=%d' % (self.options.clients * 2)]])
+        self.is_network_split = False
+
+    def client(self, url, headers, latencies, failures):
+        conn = httplib.HTTPConnection(url.hostname, url.port)
+        conn.connect()
+        for i in range(self.options.requests):
+            if i % 4 == 3:
+                body = json.dumps([{"method": "getblockcount", "id": 1},
+                                   {"method": "getblockhash", "params": [0], "id": 2},
+                                   {"method": "getbestblockhash", "id": 3}])
+            else:
+                body = json.dumps({"method": "getblockcount", "id": i})
+            start = time.time()
+            conn.request('POST', '/', body, headers)
+            reply = json.loads(conn.getresponse().read())
+            latencies.append(time.time() - start)
+            replies = reply if isinstance(reply, list) else [reply]
+            if any(r['error'] is not None for r in replies) or conn.sock is None:
+                failures.append(reply)
+        conn.close()
+
+    def run_test(self):
+        url = urlparse.urlparse(self.nodes[0].url)
+        authpair = url.username + ':' + url.password
+        headers = {"Authorization": "Basic " + base64.b64encode(authpair)}
+
+        # forget the calls made while starting the node
+        self.nodes[0].getrpcstats(True)
+
+        #################################################
+        # concurrent clients on persistent connections  #
+        #################################################
+        latencies = []
+        failures = []
+        threads = [threading.Thread(target=self.client, args=(url, headers, latencies, failures))
+                   for i in range(self.options.clients)]
+        start = time.time()
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        elapsed = time.time() - start
+
+        assert_equal(len(failures), 0)
+        assert_equal(len(latencies), self.options.clients * self.options.requests)
+        latencies.sort()
+        print("%d requests in %.2fs: %.0f req/s, p50 %.2fms, p99 %.2fms" % (
+            len(latencies), elapsed, len(latencies) / elapsed,
+            latencies[len(latencies) // 2] * 1000, latencies[len(latencies) * 99 // 100] * 1000))
+
+        #################################################
+        # pipelined requests on one connection          #
+        #################################################
+        request = 'POST / HTTP/1.1\r\nAuthorization: %s\r\nContent-Length: %d\r\n\r\n%s'
+        body = '{"method": "getblockcount"}'
+        sock = socket.create_connection((url.hostname, url.port))
+        sock.sendall((request % (headers["Authorization"], len(body), body)) * 2)
+        sock.settimeout(30)
+        data = ''
+        while data.count('"error":null') < 2:
+            chunk = sock.recv(4096)
+            assert(chunk)
+            data += chunk
+        assert_equal(data.count('HTTP/1.1 200 OK'), 2)
+        sock.close()
+
+        #################################################
+        # the server counted every call                 #
+        #################################################
+        stats = self.nodes[0].getrpcstats()
+        # every request calls getblockcount once, two more came pipelined
+        calls = self.options.clients * self.options.requests + 2
+        batches = self.options.clients * (self.options.requests // 4)
+        assert_equal(stats['methods']['getblockcount']['calls'], calls)
+        assert_equal(stats['methods']['getblockhash']['calls'], batches)
+        assert_equal(stats['methods']['getblockcount']['errors'], 0)
+        assert_equal(sum(stats['methods']['getblockcount']['histogram'].values()), calls)
+        assert_equal(stats['workqueue']['threads'], 4)
+        assert_equal(stats['workqueue']['rejected'], 0)
+
+        # reset clears the method statistics
+        self.nodes[0].getrpcstats(True)
+        assert('getblockcount' not in self.nodes[0].getrpcstats()['methods'])
+
+if __name__ == '__main__':
+    RPCLoadTest ().main ()
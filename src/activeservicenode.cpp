@@ -193,6 +193,7 @@ bool CActiveServicenode::SendServicenodePing(std::string& errorMessage)
         {
             mnodeman.mapSeenServicenodeBroadcast[hash].lastPing = mnp;
         }
+        mnodeman.LogUpdate(*pmn);
 
         mnp.Relay();
 
@@ -316,7 +317,7 @@ bool CActiveServicenode::Register(CTxIn vin, CService service, CKey keyCollatera
         CServicenode mn(mnb);
         mnodeman.Add(mn);
     } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+        mnodeman.UpdateFromNewBroadcast(*pmn, mnb);
     }
 
     //send to all peers
@@ -0,0 +1,166 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockprecheck.h"
+#include "blockstore.h"
+#include "chainparams.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "pow.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+//! Blocks before the first coinbase can be spent
+static const int BENCH_MATURE_BLOCKS = COINBASE_MATURITY + 1;
+//! Blocks after those, each spending the outputs of an earlier coinbase
+static const int BENCH_SPENDING_BLOCKS = 200;
+//! Coinbase outputs, and so signed inputs of each spending block
+static const int BENCH_INPUTS_PER_BLOCK = 20;
+
+// Start over from a chain holding only the genesis block
+static void ResetChain()
+{
+    static CCoinsViewDB* pcoinsdbviewBench = NULL;
+    {
+        LOCK(cs_main);
+        UnloadBlockIndex();
+        delete pcoinsTip;
+        delete pcoinsdbviewBench;
+        delete pblocktree;
+        pblocktree = new CBlockTreeDB(1 << 20, true);
+        pcoinsdbviewBench = new CCoinsViewDB(1 << 23, true);
+        pcoinsTip = new CCoinsViewCache(pcoinsdbviewBench);
+    }
+    assert(InitBlockIndex());
+}
+
+// Bootstrap file of a chain whose blocks, once the first coinbase matured,
+// each spend all outputs of the coinbase BENCH_MATURE_BLOCKS blocks back.
+// Every bootstrap pays a key of its own, so the signatures it carries are
+// not in the signature cache until it was replayed.
+static boost::filesystem::path GetBenchBootstrap(int nBootstrap)
+{
+    boost::filesystem::path path = GetDataDir() / strprintf("bootstrap%d.dat", nBootstrap);
+    if (boost::filesystem::exists(path))
+        return path;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    ResetChain();
+    CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    assert(!fileout.IsNull());
+    std::vector<CTransaction> vCoinbase;
+    for (int nHeight = 1; nHeight <= BENCH_MATURE_BLOCKS + BENCH_SPENDING_BLOCKS; nHeight++) {
+        CBlockIndex* pindexPrev = chainActive.Tip();
+        CBlock block;
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.nTime = pindexPrev->nTime + 60;
+
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+        coinbase.vout.resize(BENCH_INPUTS_PER_BLOCK);
+        for (int i = 0; i < BENCH_INPUTS_PER_BLOCK; i++) {
+            coinbase.vout[i].nValue = COIN;
+            coinbase.vout[i].scriptPubKey = scriptPubKey;
+        }
+        block.vtx.push_back(coinbase);
+        vCoinbase.push_back(block.vtx[0]);
+
+        if (nHeight > BENCH_MATURE_BLOCKS) {
+            const CTransaction& txFrom = vCoinbase[nHeight - BENCH_MATURE_BLOCKS - 1];
+            CMutableTransaction tx;
+            tx.vin.resize(BENCH_INPUTS_PER_BLOCK);
+            for (int i = 0; i < BENCH_INPUTS_PER_BLOCK; i++)
+                tx.vin[i].prevout = COutPoint(txFrom.GetHash(), i);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = BENCH_INPUTS_PER_BLOCK * COIN;
+            tx.vout[0].scriptPubKey = scriptPubKey;
+            for (int i = 0; i < BENCH_INPUTS_PER_BLOCK; i++)
+                assert(SignSignature(keystore, txFrom, tx, i));
+            block.vtx.push_back(tx);
+        }
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        block.nBits = GetNextWorkRequired(pindexPrev, &block);
+
+        CValidationState state;
+        assert(ProcessNewBlock(state, NULL, &block));
+        unsigned int nSize = fileout.GetSerializeSize(block);
+        fileout << FLATDATA(Params().MessageStart()) << nSize << block;
+    }
+    return path;
+}
+
+// Import a bootstrap into an empty chain, like -loadblock does
+static void ImportBootstrap(benchmark::State& state, int nBootstrap, bool fPipelined, bool fFast = false)
+{
+    // the benchmark chains aren't mined
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    boost::filesystem::path path = GetBenchBootstrap(nBootstrap);
+
+    boost::thread_group threads;
+    if (fPipelined) {
+        int nThreads = std::max((int)boost::thread::hardware_concurrency() - 1, 1);
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CBlockPrecheckQueue::Thread, &blockPrecheckQueue));
+        threads.create_thread(boost::bind(&CBlockWriteQueue::Thread, &blockWriteQueue));
+    }
+
+    while (state.KeepRunning()) {
+        ResetChain();
+        if (fFast) {
+            assert(LoadExternalBlockFileFast(path));
+        } else {
+            FILE* file = fopen(path.string().c_str(), "rb");
+            assert(file);
+            assert(LoadExternalBlockFile(file));
+        }
+        assert(chainActive.Height() == BENCH_MATURE_BLOCKS + BENCH_SPENDING_BLOCKS);
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+    assert(blockWriteQueue.Flush());
+    ResetChain();
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
+// Blocks read ahead and checked on all cores while the chain is connected,
+// and written in the background. Only the first replay finds the signature
+// cache cold, later ones show the best case of checking ahead.
+static void ImportBootstrapPipelined(benchmark::State& state)
+{
+    ImportBootstrap(state, 0, true);
+}
+
+// Every check done on the importing thread, as before the pipeline
+static void ImportBootstrapSerial(benchmark::State& state)
+{
+    ImportBootstrap(state, 1, false);
+}
+
+// The same with -fastimport: the bootstrap mapped and decoded on all cores
+// ahead of connecting it, and the chain state flushed once at the end
+static void ImportBootstrapFast(benchmark::State& state)
+{
+    ImportBootstrap(state, 2, true, true);
+}
+
+BENCHMARK(ImportBootstrapFast);
+BENCHMARK(ImportBootstrapPipelined);
+BENCHMARK(ImportBootstrapSerial);
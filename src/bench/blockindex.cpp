@@ -0,0 +1,73 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "txdb.h"
+
+//! Roughly the number of headers in the mainnet block index
+static const int BENCH_BLOCK_INDEX_SIZE = 500000;
+
+// Block tree database holding a header chain of BENCH_BLOCK_INDEX_SIZE entries,
+// built once and shared by the benchmarks below
+static CBlockTreeDB& GetBenchBlockTree()
+{
+    static CBlockTreeDB* pdb = NULL;
+    if (pdb)
+        return *pdb;
+
+    pdb = new CBlockTreeDB(1 << 20, true);
+    std::vector<uint256> vHash(BENCH_BLOCK_INDEX_SIZE);
+    std::vector<CBlockIndex> vIndex(BENCH_BLOCK_INDEX_SIZE);
+    for (int i = 0; i < BENCH_BLOCK_INDEX_SIZE; i++) {
+        CBlockIndex& index = vIndex[i];
+        index.pprev = i ? &vIndex[i - 1] : NULL;
+        // past the PoW phase, so verification only has to rehash the headers
+        index.nHeight = Params().LAST_POW_BLOCK() + 1 + i;
+        index.nVersion = 1;
+        index.nTime = Params().GenesisBlock().nTime + i * 60;
+        index.nBits = Params().GenesisBlock().nBits;
+        index.nNonce = i;
+        index.nStatus = BLOCK_VALID_TREE;
+        vHash[i] = index.GetBlockHeader().GetHash();
+        index.phashBlock = &vHash[i];
+        assert(pdb->WriteBlockIndex(CDiskBlockIndex(&index)));
+    }
+    return *pdb;
+}
+
+// Load the block index into an empty mapBlockIndex, keeping the benchmark chain aside
+static void LoadBlockIndex(benchmark::State& state, bool fCheckHashes)
+{
+    CBlockTreeDB& db = GetBenchBlockTree();
+
+    LOCK(cs_main);
+    BlockMap mapSaved;
+    mapSaved.swap(mapBlockIndex);
+    while (state.KeepRunning()) {
+        assert(db.LoadBlockIndexGuts(fCheckHashes));
+        assert(mapBlockIndex.size() == (size_t)BENCH_BLOCK_INDEX_SIZE);
+        for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); it++)
+            delete it->second;
+        mapBlockIndex.clear();
+    }
+    mapSaved.swap(mapBlockIndex);
+}
+
+// Startup: hashes are taken from the database keys
+static void LoadBlockIndexFromKeys(benchmark::State& state)
+{
+    LoadBlockIndex(state, false);
+}
+
+// Startup with -checkblockhashes: every header is rehashed on all cores
+static void LoadBlockIndexCheckHashes(benchmark::State& state)
+{
+    LoadBlockIndex(state, true);
+}
+
+BENCHMARK(LoadBlockIndexFromKeys);
+BENCHMARK(LoadBlockIndexCheckHashes);
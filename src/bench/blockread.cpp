@@ -0,0 +1,99 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockstore.h"
+#include "main.h"
+
+//! Number of consecutive blocks served per iteration
+static const int BENCH_BLOCK_COUNT = 10000;
+//! Block file the benchmark blocks are appended to, far from the chain's own files
+static const int BENCH_BLOCK_FILE = 9999;
+
+// Proof of stake block with a few ordinary transactions, so reading it back
+// skips the proof of work check
+static CBlock MakeBenchBlock(int n)
+{
+    CBlock block;
+    block.nVersion = 1;
+    block.nTime = n;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << n << OP_0;
+    coinbase.vout.resize(1);
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(block.vtx[0].GetHash(), 0);
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout[1].nValue = 1000 * COIN;
+    coinstake.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(coinstake);
+
+    for (int i = 0; i < 8; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vin[0].prevout = COutPoint(block.vtx.back().GetHash(), 1);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, i) << std::vector<unsigned char>(33, i);
+        tx.vin[1] = tx.vin[0];
+        tx.vin[1].prevout.n = 0;
+        tx.vout.resize(2);
+        tx.vout[0].nValue = i * COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout[1] = tx.vout[0];
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+// Positions of BENCH_BLOCK_COUNT blocks written back to back, written once
+static const std::vector<CDiskBlockPos>& GetBenchBlocks()
+{
+    static std::vector<CDiskBlockPos> vPos;
+    if (!vPos.empty())
+        return vPos;
+
+    CDiskBlockPos pos(BENCH_BLOCK_FILE, 0);
+    for (int i = 0; i < BENCH_BLOCK_COUNT; i++) {
+        CBlock block = MakeBenchBlock(i);
+        assert(WriteBlockToDisk(block, pos));
+        vPos.push_back(pos);
+        pos.nPos += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    }
+    return vPos;
+}
+
+static void ReadBenchBlocks(benchmark::State& state, size_t nMaxFiles)
+{
+    const std::vector<CDiskBlockPos>& vPos = GetBenchBlocks();
+    blockFileCache.SetMaxFiles(nMaxFiles);
+    blockFileCache.Invalidate(BENCH_BLOCK_FILE);
+
+    CBlock block;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vPos.size(); i++)
+            assert(ReadBlockFromDisk(block, vPos[i]));
+    }
+    blockFileCache.SetMaxFiles(DEFAULT_BLOCK_FILE_MAPS);
+}
+
+// Serving 10k consecutive blocks from the memory-mapped block file
+static void ReadBlocksMapped(benchmark::State& state)
+{
+    ReadBenchBlocks(state, DEFAULT_BLOCK_FILE_MAPS);
+}
+
+// The same through fopen and CAutoFile for every block
+static void ReadBlocksFile(benchmark::State& state)
+{
+    ReadBenchBlocks(state, 0);
+}
+
+BENCHMARK(ReadBlocksMapped);
+BENCHMARK(ReadBlocksFile);
@@ -0,0 +1,109 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "clientversion.h"
+#include "random.h"
+#include "script/standard.h"
+#include "servicenode-budget.h"
+#include "servicenodeman.h"
+#include "util.h"
+
+//! Proposals of the budget
+static const int BENCH_BUDGET_PROPOSALS = 500;
+//! Servicenodes voting on every proposal
+static const int BENCH_BUDGET_VOTERS = 5000;
+
+// Fill the budget with proposals voted on by all servicenodes, the
+// proposals and voters are returned
+static void AddBenchBudget(std::vector<uint256>& vProposals, std::vector<CTxIn>& vVoters)
+{
+    static std::vector<uint256> vProposalsAdded;
+    static std::vector<CTxIn> vVotersAdded;
+    if (vProposalsAdded.empty()) {
+        mnodeman.Clear();
+        for (int i = 0; i < BENCH_BUDGET_VOTERS; i++) {
+            CServicenode mn;
+            mn.vin = CTxIn(GetRandHash(), 0);
+            assert(mnodeman.Add(mn));
+            vVotersAdded.push_back(mn.vin);
+        }
+
+        budget.Clear();
+        for (int i = 0; i < BENCH_BUDGET_PROPOSALS; i++) {
+            uint160 payee;
+            GetRandBytes(payee.begin(), payee.size());
+            CBudgetProposal budgetProposal(strprintf("proposal-%d", i), "https://blocknet.co", 0, 1000000,
+                GetScriptForDestination(CKeyID(payee)), 10 * COIN, GetRandHash());
+            budgetProposal.nTime = GetTime() - 60 * 60 * 24 * 2;
+            budget.mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+            vProposalsAdded.push_back(budgetProposal.GetHash());
+        }
+        // indexed as when loaded from budget.dat, their collateral can't be checked
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << budget;
+        ss >> budget;
+
+        // votes ten days old, leaving room for updates
+        for (int i = 0; i < BENCH_BUDGET_PROPOSALS; i++) {
+            for (int j = 0; j < BENCH_BUDGET_VOTERS; j++) {
+                CBudgetVote vote(vVotersAdded[j], vProposalsAdded[i], (i + j) % 3 ? VOTE_YES : VOTE_NO);
+                vote.nTime = GetAdjustedTime() - 60 * 60 * 24 * 10;
+                std::string strError;
+                assert(budget.UpdateProposal(vote, NULL, strError));
+            }
+        }
+    }
+    vProposals = vProposalsAdded;
+    vVoters = vVotersAdded;
+}
+
+// Picking the proposals the next budget pays, as for every finalized budget
+// submitted or checked and the budget RPCs
+static void BudgetGetBudget(benchmark::State& state)
+{
+    std::vector<uint256> vProposals;
+    std::vector<CTxIn> vVoters;
+    AddBenchBudget(vProposals, vVoters);
+
+    while (state.KeepRunning())
+        assert(!budget.GetBudget().empty());
+}
+
+// Servicenodes changing their votes one after the other, with the tallies of
+// the proposal read after each vote
+static void BudgetVoteUpdates(benchmark::State& state)
+{
+    std::vector<uint256> vProposals;
+    std::vector<CTxIn> vVoters;
+    AddBenchBudget(vProposals, vVoters);
+
+    // each pass over all the votes is an update interval later
+    int64_t nVoteTime = GetAdjustedTime() - 60 * 60 * 24 * 10;
+    int nPass = 0;
+    size_t i = 0, j = 0;
+    while (state.KeepRunning()) {
+        if (i == 0 && j == 0) {
+            nVoteTime += BUDGET_VOTE_UPDATE_MIN;
+            nPass++;
+        }
+
+        CBudgetVote vote(vVoters[j], vProposals[i], nPass % 2 ? VOTE_YES : VOTE_NO);
+        vote.nTime = nVoteTime;
+        std::string strError;
+        assert(budget.UpdateProposal(vote, NULL, strError));
+        CBudgetProposal* pbudgetProposal = budget.FindProposal(vProposals[i]);
+        assert(pbudgetProposal->GetYeas() + pbudgetProposal->GetNays() == BENCH_BUDGET_VOTERS);
+
+        if (++i == vProposals.size()) {
+            i = 0;
+            if (++j == vVoters.size())
+                j = 0;
+        }
+    }
+}
+
+BENCHMARK(BudgetGetBudget);
+BENCHMARK(BudgetVoteUpdates);
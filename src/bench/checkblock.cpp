@@ -0,0 +1,113 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "timedata.h"
+
+#include <boost/thread.hpp>
+
+//! Ordinary transactions in the benchmark block, besides coinbase and coinstake
+static const int BENCH_BLOCK_TXS = 200;
+
+// Signed proof of stake block shaped like the ones on mainnet: an empty
+// coinbase, a coinstake paying the staker and a servicenode, and transactions
+// spending two outputs each
+static const CBlock& GetBenchPoSBlock()
+{
+    static CBlock block;
+    if (!block.IsNull())
+        return block;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptStaker = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CKey keyPayee;
+    keyPayee.MakeNewKey(true);
+
+    block.nVersion = CBlockHeader::CURRENT_VERSION;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetAdjustedTime();
+    block.nBits = 0x1e0fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].SetEmpty();
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(GetRandHash(), 1);
+    coinstake.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+    coinstake.vout.resize(3);
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout[1].nValue = 1000 * COIN;
+    coinstake.vout[1].scriptPubKey = scriptStaker;
+    coinstake.vout[2].nValue = 2 * COIN;
+    coinstake.vout[2].scriptPubKey = GetScriptForDestination(keyPayee.GetPubKey().GetID());
+    block.vtx.push_back(coinstake);
+
+    for (int i = 0; i < BENCH_BLOCK_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        for (unsigned int n = 0; n < tx.vin.size(); n++) {
+            tx.vin[n].prevout = COutPoint(GetRandHash(), n);
+            tx.vin[n].scriptSig = CScript() << std::vector<unsigned char>(72, i) << ToByteVector(key.GetPubKey());
+        }
+        tx.vout.resize(2);
+        for (unsigned int n = 0; n < tx.vout.size(); n++) {
+            tx.vout[n].nValue = (i + 1) * COIN;
+            tx.vout[n].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    assert(block.SignBlock(keystore));
+    return block;
+}
+
+static void CheckPoSBlock(benchmark::State& state, int nThreads)
+{
+    const CBlock& block = GetBenchPoSBlock();
+
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads - 1; i++)
+        threads.create_thread(&ThreadBlockCheck);
+    nScriptCheckThreads = nThreads;
+
+    while (state.KeepRunning()) {
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, true, true, true));
+    }
+
+    nScriptCheckThreads = 0;
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+// Validation latency of a block as it arrives, with the transaction checks
+// and the block signature on the block check threads
+static void CheckPoSBlockParallel(benchmark::State& state)
+{
+    CheckPoSBlock(state, std::max((int)boost::thread::hardware_concurrency(), 2));
+}
+
+// Every check on the calling thread, as without -par
+static void CheckPoSBlockSerial(benchmark::State& state)
+{
+    CheckPoSBlock(state, 0);
+}
+
+BENCHMARK(CheckPoSBlockParallel);
+BENCHMARK(CheckPoSBlockSerial);
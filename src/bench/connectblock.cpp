@@ -0,0 +1,119 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "pow.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txmempool.h"
+
+//! Transactions in the benchmark block, each spending one coinbase output
+static const int BENCH_BLOCK_TXS = 100;
+
+// Block on top of the active chain whose transactions spend the outputs of a
+// matured coinbase, as a peer would relay it after its transactions
+static const CBlock& GetBenchBlock()
+{
+    static CBlock block;
+    if (!block.IsNull())
+        return block;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CTransaction txFrom;
+    for (int i = 0; i <= Params().COINBASE_MATURITY() + 1; i++) {
+        CBlockIndex* pindexPrev = chainActive.Tip();
+        block.SetNull();
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.nTime = pindexPrev->nTime + 60;
+
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+        coinbase.vout.resize(i == 0 ? BENCH_BLOCK_TXS : 1);
+        for (unsigned int n = 0; n < coinbase.vout.size(); n++) {
+            coinbase.vout[n].nValue = i == 0 ? COIN / 10 : COIN;
+            coinbase.vout[n].scriptPubKey = scriptPubKey;
+        }
+        block.vtx.push_back(coinbase);
+        if (i == 0)
+            txFrom = block.vtx[0];
+
+        // the last one is the benchmark block, it isn't connected
+        if (i == Params().COINBASE_MATURITY() + 1) {
+            for (int n = 0; n < BENCH_BLOCK_TXS; n++) {
+                CMutableTransaction tx;
+                tx.vin.resize(1);
+                tx.vin[0].prevout = COutPoint(txFrom.GetHash(), n);
+                tx.vout.resize(1);
+                tx.vout[0].nValue = COIN / 10 - COIN / 1000;
+                tx.vout[0].scriptPubKey = scriptPubKey;
+                assert(SignSignature(keystore, txFrom, tx, 0));
+                block.vtx.push_back(tx);
+            }
+        }
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        block.nBits = GetNextWorkRequired(pindexPrev, &block);
+
+        if (i < Params().COINBASE_MATURITY() + 1) {
+            CValidationState state;
+            assert(ProcessNewBlock(state, NULL, &block));
+        }
+    }
+    return block;
+}
+
+static void ConnectBench(benchmark::State& state, bool fRelayed)
+{
+    // the benchmark chain isn't mined
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    const CBlock& block = GetBenchBlock();
+
+    LOCK(cs_main);
+    if (!fRelayed)
+        SetTxScriptCacheSize(0);
+    // Either way the transactions went through the memory pool, so their
+    // signatures are in the signature cache
+    mempool.clear();
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        CValidationState validationState;
+        assert(AcceptToMemoryPool(mempool, validationState, block.vtx[i], false, NULL));
+    }
+
+    while (state.KeepRunning()) {
+        CValidationState validationState;
+        assert(TestBlockValidity(validationState, block, chainActive.Tip(), false, true));
+    }
+
+    mempool.clear();
+    SetTxScriptCacheSize(DEFAULT_TX_SCRIPT_CACHE);
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
+// Connecting a block whose transactions were all accepted to the memory pool
+// before, their scripts aren't run again
+static void ConnectBlockRelayed(benchmark::State& state)
+{
+    ConnectBench(state, true);
+}
+
+// The same without the transaction script cache: every script is run, only
+// the signature checks are found in the signature cache
+static void ConnectBlockScriptsRun(benchmark::State& state)
+{
+    ConnectBench(state, false);
+}
+
+BENCHMARK(ConnectBlockRelayed);
+BENCHMARK(ConnectBlockScriptsRun);
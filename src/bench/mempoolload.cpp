@@ -0,0 +1,135 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "pow.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
+
+//! Transactions in the saved memory pool
+static const int BENCH_MEMPOOL_TXS = 100000;
+//! Outputs of each coinbase the transactions spend, worth one block reward
+static const int BENCH_COINBASE_OUTPUTS = 1000;
+
+// Mine a block on top of the active chain with the given transactions after
+// a coinbase paying to scriptPubKey in nOutputs outputs
+static CBlock MineBenchBlock(const CScript& scriptPubKey, int nOutputs)
+{
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    CBlock block;
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = pindexPrev->nTime + 60;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+    coinbase.vout.resize(nOutputs);
+    for (int n = 0; n < nOutputs; n++) {
+        coinbase.vout[n].nValue = COIN / nOutputs;
+        coinbase.vout[n].scriptPubKey = scriptPubKey;
+    }
+    block.vtx.push_back(coinbase);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    block.nBits = GetNextWorkRequired(pindexPrev, &block);
+
+    CValidationState state;
+    assert(ProcessNewBlock(state, NULL, &block));
+    return block;
+}
+
+// Fill the memory pool with transactions spending matured coinbase outputs,
+// and save it in the benchmark data directory
+static void SaveBenchMempool()
+{
+    static bool fSaved = false;
+    if (fSaved)
+        return;
+    fSaved = true;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    std::vector<CTransaction> vCoinbases;
+    for (int i = 0; i < BENCH_MEMPOOL_TXS / BENCH_COINBASE_OUTPUTS; i++)
+        vCoinbases.push_back(MineBenchBlock(scriptPubKey, BENCH_COINBASE_OUTPUTS).vtx[0]);
+    for (int i = 0; i <= Params().COINBASE_MATURITY(); i++)
+        MineBenchBlock(scriptPubKey, 1);
+
+    LOCK(cs_main);
+    mempool.clear();
+    BOOST_FOREACH (const CTransaction& txFrom, vCoinbases) {
+        for (int n = 0; n < BENCH_COINBASE_OUTPUTS; n++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(txFrom.GetHash(), n);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = txFrom.vout[n].nValue - COIN / 10000;
+            tx.vout[0].scriptPubKey = scriptPubKey;
+            assert(SignSignature(keystore, txFrom, tx, 0));
+            CValidationState state;
+            assert(AcceptToMemoryPool(mempool, state, tx, false, NULL));
+        }
+    }
+    assert(DumpMempool());
+}
+
+static void LoadBench(benchmark::State& state)
+{
+    // the benchmark chain isn't mined, and signatures checked once aren't
+    // remembered, as after a restart
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    mapArgs["-maxsigcachesize"] = "0";
+    SaveBenchMempool();
+
+    while (state.KeepRunning()) {
+        {
+            LOCK(cs_main);
+            mempool.clear();
+            SetTxScriptCacheSize(0);
+            SetTxScriptCacheSize(DEFAULT_TX_SCRIPT_CACHE);
+        }
+        assert(LoadMempool());
+        assert(mempool.size() == (unsigned int)BENCH_MEMPOOL_TXS);
+    }
+
+    mempool.clear();
+    mapArgs.erase("-maxsigcachesize");
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
+// Loading a saved memory pool with the scripts of each batch run on the
+// script check threads
+static void MempoolLoadParallel(benchmark::State& state)
+{
+    static boost::thread_group threadGroup;
+    if (threadGroup.size() == 0) {
+        for (unsigned int i = 1; i < std::max(2u, boost::thread::hardware_concurrency()); i++)
+            threadGroup.create_thread(&ThreadScriptCheck);
+    }
+    nScriptCheckThreads = threadGroup.size() + 1;
+    LoadBench(state);
+    nScriptCheckThreads = 0;
+}
+
+// The same without script check threads, AcceptToMemoryPool runs every script
+static void MempoolLoadSerial(benchmark::State& state)
+{
+    LoadBench(state);
+}
+
+BENCHMARK(MempoolLoadParallel);
+BENCHMARK(MempoolLoadSerial);
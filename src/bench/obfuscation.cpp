@@ -0,0 +1,133 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "main.h"
+#include "obfuscation.h"
+#include "random.h"
+#include "wallet.h"
+
+//! Transactions of the wallet, each paying it BENCH_MIXING_TX_OUTPUTS outputs
+static const int BENCH_MIXING_TXS = 5000;
+static const int BENCH_MIXING_TX_OUTPUTS = 10;
+//! Transactions denominating the outputs of the one this many before them
+static const int BENCH_MIXING_CHAIN_STEP = 500;
+
+// A wallet of BENCH_MIXING_TXS * BENCH_MIXING_TX_OUTPUTS outputs confirmed in
+// the genesis block: denominations of every size, of transactions spending
+// earlier ones so they have rounds, with some change and collateral outputs
+static CWallet& GetBenchMixingWallet()
+{
+    static CWallet wallet;
+    if (!wallet.mapWallet.empty())
+        return wallet;
+
+    if (obfuScationDenominations.empty()) {
+        obfuScationDenominations.push_back((10000 * COIN) + 10000000);
+        obfuScationDenominations.push_back((1000 * COIN) + 1000000);
+        obfuScationDenominations.push_back((100 * COIN) + 100000);
+        obfuScationDenominations.push_back((10 * COIN) + 10000);
+        obfuScationDenominations.push_back((1 * COIN) + 1000);
+        obfuScationDenominations.push_back((.1 * COIN) + 100);
+    }
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    std::vector<CScript> vScripts;
+    for (int i = 0; i < 10; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        assert(wallet.AddKeyPubKey(key, key.GetPubKey()));
+        vScripts.push_back(GetScriptForDestination(key.GetPubKey().GetID()));
+    }
+
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < BENCH_MIXING_TXS; i++) {
+        CMutableTransaction tx;
+        if (i < BENCH_MIXING_CHAIN_STEP)
+            tx.vin.push_back(CTxIn(GetRandHash(), 0));
+        else
+            tx.vin.push_back(CTxIn(vHashes[i - BENCH_MIXING_CHAIN_STEP], 0));
+        for (int n = 0; n < BENCH_MIXING_TX_OUTPUTS; n++) {
+            CAmount nValue = obfuScationDenominations[(i + n) % obfuScationDenominations.size()];
+            if (n == BENCH_MIXING_TX_OUTPUTS - 1 && i % 10 == 0)
+                nValue = 7 * COIN; // change
+            if (n == BENCH_MIXING_TX_OUTPUTS - 1 && i % 50 == 1)
+                nValue = 2 * OBFUSCATION_COLLATERAL;
+            tx.vout.push_back(CTxOut(nValue, vScripts[(i + n) % vScripts.size()]));
+        }
+
+        CWalletTx wtx(&wallet, tx);
+        wtx.hashBlock = chainActive.Tip()->GetBlockHash();
+        wtx.nIndex = 0;
+        wtx.fMerkleVerified = true;
+        assert(wallet.AddToWallet(wtx, true));
+        vHashes.push_back(wtx.GetHash());
+    }
+    return wallet;
+}
+
+// The wallet side of a mixing attempt (DoAutomaticDenominating) matching a
+// queued session of each denomination, then selecting the inputs of the
+// session as PrepareObfuscationDenominate does
+static void MixingAttempt(CWallet& wallet)
+{
+    std::vector<CTxIn> vCoins;
+    std::vector<COutput> vCoins2;
+    CAmount nValueIn;
+
+    wallet.HasCollateralInputs();
+    wallet.GetAnonymizedBalance();
+    wallet.GetAnonymizableBalance();
+    // a wallet this size has more than the pool maximum left to mix
+    CAmount nBalanceNeedsAnonymized = OBFUSCATION_POOL_MAX;
+    wallet.SelectCoinsDark(CENT, nBalanceNeedsAnonymized, vCoins, nValueIn, 0, nObfuscationRounds);
+    wallet.GetDenominatedBalance(true);
+    wallet.GetDenominatedBalance();
+    wallet.HasCollateralInputs();
+
+    int nDenomsMixable = wallet.GetObfuscationDenominations(0, nObfuscationRounds);
+    int nSessionDenom = 0;
+    for (unsigned int d = 0; d < obfuScationDenominations.size(); d++) {
+        int nDenom = 1 << d;
+        if ((nDenom & nDenomsMixable) != nDenom) continue;
+        if (wallet.SelectCoinsByDenominations(nDenom, CENT, nBalanceNeedsAnonymized, vCoins, vCoins2, nValueIn, 0, nObfuscationRounds))
+            nSessionDenom = nDenom;
+    }
+    assert(nSessionDenom != 0);
+
+    for (int i = 0; i < nObfuscationRounds; i++)
+        if (wallet.SelectCoinsByDenominations(nSessionDenom, 0.1 * COIN, OBFUSCATION_POOL_MAX, vCoins, vCoins2, nValueIn, i, i + 1))
+            break;
+}
+
+// Mixing attempts with the wallet unchanged in between, reusing its plan
+static void ObfuscationMixingAttempt(benchmark::State& state)
+{
+    CWallet& wallet = GetBenchMixingWallet();
+
+    while (state.KeepRunning())
+        MixingAttempt(wallet);
+}
+
+// The same with a coin locked and unlocked before each attempt, as by a
+// session, so every attempt plans from the wallet again
+static void ObfuscationMixingAttemptWalletChanged(benchmark::State& state)
+{
+    CWallet& wallet = GetBenchMixingWallet();
+    COutPoint outpoint(wallet.mapWallet.begin()->first, 1);
+
+    while (state.KeepRunning()) {
+        {
+            LOCK(wallet.cs_wallet);
+            wallet.LockCoin(outpoint);
+            wallet.UnlockCoin(outpoint);
+        }
+        MixingAttempt(wallet);
+    }
+}
+
+BENCHMARK(ObfuscationMixingAttempt);
+BENCHMARK(ObfuscationMixingAttemptWalletChanged);
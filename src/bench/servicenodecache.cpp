@@ -0,0 +1,154 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "obfuscation.h"
+#include "random.h"
+#include "servicenodeman.h"
+#include "util.h"
+
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+//! Servicenodes in the list dumped and restarted with
+static const int BENCH_CACHE_SERVICENODES = 2000;
+//! Of which one in pinged between the dump and the restart
+static const int BENCH_CACHE_PINGED_ONE_IN = 20;
+
+// The signed broadcasts of the servicenodes, as received from peers
+static const std::vector<CDataStream>& GetBenchBroadcasts()
+{
+    static std::vector<CDataStream> vBroadcasts;
+    if (!vBroadcasts.empty())
+        return vBroadcasts;
+
+    for (int i = 0; i < BENCH_CACHE_SERVICENODES; i++) {
+        CKey keyCollateral, keyServicenode;
+        keyCollateral.MakeNewKey(true);
+        keyServicenode.MakeNewKey(true);
+
+        CServicenodeBroadcast mnb;
+        mnb.vin = CTxIn(GetRandHash(), 0);
+        mnb.addr = CService(strprintf("1.%d.%d.%d", (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff), 41412);
+        mnb.pubKeyCollateralAddress = keyCollateral.GetPubKey();
+        mnb.pubKeyServicenode = keyServicenode.GetPubKey();
+        mnb.protocolVersion = PROTOCOL_VERSION;
+        assert(mnb.Sign(keyCollateral));
+        mnb.lastPing.vin = mnb.vin;
+        mnb.lastPing.sigTime = GetAdjustedTime();
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << mnb;
+        vBroadcasts.push_back(ss);
+    }
+    return vBroadcasts;
+}
+
+// Fill the servicenode list with the servicenodes of the broadcasts
+static void FillBenchList()
+{
+    const std::vector<CDataStream>& vBroadcasts = GetBenchBroadcasts();
+    if (mnodeman.size() == (int)vBroadcasts.size())
+        return;
+
+    mnodeman.Clear();
+    BOOST_FOREACH (const CDataStream& msg, vBroadcasts) {
+        CDataStream vRecv(msg);
+        CServicenodeBroadcast mnb;
+        vRecv >> mnb;
+        mnb.unitTest = true;
+        assert(mnodeman.Add(mnb));
+    }
+}
+
+// The time the list is held by a dump: serializing it into memory
+static void ServicenodeCacheDumpPause(benchmark::State& state)
+{
+    FillBenchList();
+
+    size_t nBytes = 0;
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        mnodeman.Snapshot(ss);
+        nBytes = ss.size();
+    }
+    std::cout << "# ServicenodeCacheDumpPause bytes: " << nBytes << "\n";
+}
+
+// The whole dump, the file being written without holding the list
+static void ServicenodeCacheDumpWrite(benchmark::State& state)
+{
+    FillBenchList();
+
+    boost::filesystem::path path = GetTempPath() / strprintf("bench_mncache_%lu.dat", (unsigned long)GetRand(1000000));
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        mnodeman.Snapshot(ss);
+        assert(WriteServicenodeCacheFile(path, ss));
+    }
+    boost::filesystem::remove(path);
+}
+
+// A restart without mncache.dat: every broadcast received again from peers
+// is checked and added, before the time spent waiting for them
+static void ServicenodeCacheColdRestart(benchmark::State& state)
+{
+    const std::vector<CDataStream>& vBroadcasts = GetBenchBroadcasts();
+
+    while (state.KeepRunning()) {
+        CServicenodeMan mnodemanRestarted;
+        BOOST_FOREACH (const CDataStream& msg, vBroadcasts) {
+            CDataStream vRecv(msg);
+            CServicenodeBroadcast mnb;
+            vRecv >> mnb;
+
+            std::string errorMessage;
+            assert(obfuScationSigner.VerifyMessage(mnb.pubKeyCollateralAddress, mnb.sig, mnb.GetStrMessage(), errorMessage));
+            mnb.unitTest = true;
+            assert(mnodemanRestarted.Add(mnb));
+        }
+    }
+}
+
+// A restart with mncache.dat and the change log written after it: the file
+// is read and the pings logged since are replayed
+static void ServicenodeCacheWarmRestart(benchmark::State& state)
+{
+    FillBenchList();
+
+    CDataStream ssDump(SER_DISK, CLIENT_VERSION);
+    mnodeman.Snapshot(ssDump);
+
+    const std::vector<CDataStream>& vBroadcasts = GetBenchBroadcasts();
+    std::vector<CDataStream> vChanges;
+    for (size_t i = 0; i < vBroadcasts.size(); i += BENCH_CACHE_PINGED_ONE_IN) {
+        CDataStream vRecv(vBroadcasts[i]);
+        CServicenodeBroadcast mnb;
+        vRecv >> mnb;
+        mnb.lastPing.sigTime += SERVICENODE_PING_SECONDS;
+
+        CDataStream ssChange(SER_DISK, CLIENT_VERSION);
+        ssChange << mnb;
+        vChanges.push_back(ssChange);
+    }
+
+    while (state.KeepRunning()) {
+        CServicenodeMan mnodemanRestarted;
+        CDataStream ss(ssDump);
+        ss >> mnodemanRestarted;
+        BOOST_FOREACH (const CDataStream& ssChange, vChanges) {
+            CDataStream ssApply(ssChange);
+            mnodemanRestarted.ApplyChange("mnb", ssApply);
+        }
+        assert(mnodemanRestarted.size() == (int)vBroadcasts.size());
+    }
+}
+
+BENCHMARK(ServicenodeCacheColdRestart);
+BENCHMARK(ServicenodeCacheDumpPause);
+BENCHMARK(ServicenodeCacheDumpWrite);
+BENCHMARK(ServicenodeCacheWarmRestart);
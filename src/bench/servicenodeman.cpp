@@ -0,0 +1,82 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "random.h"
+#include "script/standard.h"
+#include "servicenodeman.h"
+#include "util.h"
+
+//! Servicenodes in the list the messages are processed against
+static const int BENCH_SERVICENODES = 10000;
+
+// A servicenode with random keys, collateral and address
+static CServicenode MakeBenchServicenode(int i)
+{
+    CServicenode mn;
+    mn.vin = CTxIn(GetRandHash(), i % 2);
+    mn.addr = CService(strprintf("1.%d.%d.%d", (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff), 41412);
+
+    std::vector<unsigned char> vchPubKey(33);
+    vchPubKey[0] = 0x02;
+    GetRandBytes(&vchPubKey[1], 32);
+    mn.pubKeyCollateralAddress = CPubKey(vchPubKey);
+    GetRandBytes(&vchPubKey[1], 32);
+    mn.pubKeyServicenode = CPubKey(vchPubKey);
+    return mn;
+}
+
+// Fill the servicenode list, the servicenodes it holds are returned
+static const std::vector<CServicenode>& AddBenchServicenodes()
+{
+    static std::vector<CServicenode> vServicenodes;
+    if (vServicenodes.empty()) {
+        mnodeman.Clear();
+        for (int i = 0; i < BENCH_SERVICENODES; i++) {
+            vServicenodes.push_back(MakeBenchServicenode(i));
+            assert(mnodeman.Add(vServicenodes.back()));
+        }
+    }
+    return vServicenodes;
+}
+
+// The lookups of the servicenode messages, with the list full: the sender of
+// a ping (mnp), of a payment vote (mnw) and its payee, of a budget vote
+// (mvote), and a servicenode by its key as for obfuscation queues (dsq)
+static void ServicenodeMessageLookups(benchmark::State& state)
+{
+    const std::vector<CServicenode>& vServicenodes = AddBenchServicenodes();
+
+    std::vector<CScript> vPayees;
+    BOOST_FOREACH (const CServicenode& mn, vServicenodes)
+        vPayees.push_back(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()));
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const CServicenode& mn = vServicenodes[i];
+        assert(mnodeman.Find(mn.vin));
+        assert(mnodeman.Find(mn.vin) && mnodeman.Find(vPayees[i]));
+        assert(mnodeman.Find(mn.vin));
+        assert(mnodeman.Find(mn.pubKeyServicenode));
+        i = (i + 1) % vServicenodes.size();
+    }
+}
+
+// Servicenodes leaving the list and announcing themselves again
+static void ServicenodeRemoveAdd(benchmark::State& state)
+{
+    std::vector<CServicenode> vServicenodes = AddBenchServicenodes();
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        mnodeman.Remove(vServicenodes[i].vin);
+        assert(mnodeman.Add(vServicenodes[i]));
+        i = (i + 1) % vServicenodes.size();
+    }
+    assert(mnodeman.size() == BENCH_SERVICENODES);
+}
+
+BENCHMARK(ServicenodeMessageLookups);
+BENCHMARK(ServicenodeRemoveAdd);
@@ -0,0 +1,98 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "obfuscation.h"
+#include "random.h"
+#include "servicenode-sigcheck.h"
+#include "servicenode.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
+
+//! Servicenodes of the synthetic list a peer sends
+static const int BENCH_SYNC_SERVICENODES = 5000;
+
+// The "mnb" messages of a list of servicenodes with random keys, signed
+// like the servicenodes sign their own
+static const std::vector<CDataStream>& GetBenchBroadcasts()
+{
+    static std::vector<CDataStream> vMessages;
+    if (!vMessages.empty())
+        return vMessages;
+
+    for (int i = 0; i < BENCH_SYNC_SERVICENODES; i++) {
+        CKey keyCollateral, keyServicenode;
+        keyCollateral.MakeNewKey(true);
+        keyServicenode.MakeNewKey(true);
+
+        CServicenodeBroadcast mnb;
+        mnb.vin = CTxIn(GetRandHash(), 0);
+        mnb.addr = CService(strprintf("1.%d.%d.%d", (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff), 41474);
+        mnb.pubKeyCollateralAddress = keyCollateral.GetPubKey();
+        mnb.pubKeyServicenode = keyServicenode.GetPubKey();
+        assert(mnb.Sign(keyCollateral));
+        mnb.lastPing.vin = mnb.vin;
+        mnb.lastPing.blockHash = GetRandHash();
+        assert(mnb.lastPing.Sign(keyServicenode, mnb.pubKeyServicenode));
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << mnb;
+        vMessages.push_back(ss);
+    }
+    return vMessages;
+}
+
+// What the message thread verifies of each broadcast as it receives the list:
+// the collateral key signature, then the ping signature once it is added
+static void ProcessBenchBroadcasts(const std::vector<CDataStream>& vMessages)
+{
+    BOOST_FOREACH (const CDataStream& msg, vMessages) {
+        CDataStream vRecv(msg);
+        CServicenodeBroadcast mnb;
+        vRecv >> mnb;
+
+        int nDoS = 0;
+        assert(mnb.CheckAndUpdate(nDoS));
+        std::string errorMessage;
+        assert(obfuScationSigner.VerifyMessage(mnb.pubKeyServicenode, mnb.lastPing.vchSig, mnb.lastPing.GetStrMessage(), errorMessage));
+    }
+}
+
+// Receiving the list with the signatures checked ahead on worker threads
+static void ServicenodeListSyncParallel(benchmark::State& state)
+{
+    const std::vector<CDataStream>& vMessages = GetBenchBroadcasts();
+
+    static boost::thread_group threadGroup;
+    if (threadGroup.size() == 0) {
+        for (unsigned int i = 1; i < std::max(2u, boost::thread::hardware_concurrency()); i++)
+            threadGroup.create_thread(boost::bind(&CServicenodeSigCheckQueue::Thread, &servicenodeSigCheckQueue));
+        MilliSleep(100);
+    }
+
+    while (state.KeepRunning()) {
+        servicenodeSigCheckQueue.ClearVerified();
+        // messages are queued as they arrive, before they are processed
+        BOOST_FOREACH (const CDataStream& msg, vMessages)
+            servicenodeSigCheckQueue.Push("mnb", msg);
+        ProcessBenchBroadcasts(vMessages);
+    }
+}
+
+// The same with every signature checked by the message thread
+static void ServicenodeListSyncSerial(benchmark::State& state)
+{
+    const std::vector<CDataStream>& vMessages = GetBenchBroadcasts();
+
+    while (state.KeepRunning()) {
+        servicenodeSigCheckQueue.ClearVerified();
+        ProcessBenchBroadcasts(vMessages);
+    }
+}
+
+BENCHMARK(ServicenodeListSyncParallel);
+BENCHMARK(ServicenodeListSyncSerial);
@@ -0,0 +1,96 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "net.h"
+#include "protocol.h"
+#include "random.h"
+#include "servicenode-sync.h"
+#include "streams.h"
+#include "version.h"
+
+#include <iostream>
+
+//! Servicenode broadcasts and budget items a synced peer has
+static const int BENCH_SYNC_ITEMS = 5000 + 500 * 50;
+//! Of which a node restarting with its caches misses one in
+static const int BENCH_SYNC_MISSING_ONE_IN = 100;
+
+// The items of the synced peer, and those of the restarting node
+static void GetBenchSyncSets(std::vector<uint256>& vPeer, std::vector<uint256>& vNode)
+{
+    static std::vector<uint256> vPeerItems, vNodeItems;
+    if (vPeerItems.empty()) {
+        for (int i = 0; i < BENCH_SYNC_ITEMS; i++) {
+            vPeerItems.push_back(GetRandHash());
+            if (i % BENCH_SYNC_MISSING_ONE_IN != 0)
+                vNodeItems.push_back(vPeerItems.back());
+        }
+    }
+    vPeer = vPeerItems;
+    vNode = vNodeItems;
+}
+
+// Size of the inv messages announcing the items
+static size_t GetInvBytes(const std::vector<CInv>& vInv)
+{
+    size_t nBytes = 0;
+    for (size_t i = 0; i < vInv.size(); i += MAX_INV_SZ) {
+        std::vector<CInv> vMessage(vInv.begin() + i, vInv.begin() + std::min(vInv.size(), i + MAX_INV_SZ));
+        nBytes += CMessageHeader::HEADER_SIZE + GetSerializeSize(vMessage, SER_NETWORK, PROTOCOL_VERSION);
+    }
+    return nBytes;
+}
+
+// A restarting node syncing the list and budget from a peer before
+// reconciliation: all items are announced ('dseg', 'mnvs')
+static void ServicenodeSyncFull(benchmark::State& state)
+{
+    std::vector<uint256> vPeer, vNode;
+    GetBenchSyncSets(vPeer, vNode);
+
+    size_t nBytes = 0;
+    while (state.KeepRunning()) {
+        std::vector<CInv> vInv;
+        for (size_t i = 0; i < vPeer.size(); i++)
+            vInv.push_back(CInv(MSG_SERVICENODE_ANNOUNCE, vPeer[i]));
+        nBytes = GetInvBytes(vInv);
+    }
+    std::cout << "# ServicenodeSyncFull bytes: " << nBytes << "\n";
+}
+
+// The same with the items the node has summarized ('dsegsum', 'mnvssum'),
+// the peer announcing those of the buckets that differ
+static void ServicenodeSyncReconciled(benchmark::State& state)
+{
+    std::vector<uint256> vPeer, vNode;
+    GetBenchSyncSets(vPeer, vNode);
+
+    size_t nBytes = 0;
+    while (state.KeepRunning()) {
+        CSyncSetSummary summary(vNode.size());
+        for (size_t i = 0; i < vNode.size(); i++)
+            summary.Add(vNode[i]);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << summary;
+        nBytes = CMessageHeader::HEADER_SIZE + ss.size();
+
+        CSyncSetSummary summaryReceived;
+        ss >> summaryReceived;
+        CSyncSetSummary summaryPeer(summaryReceived.nKey0, summaryReceived.nKey1, summaryReceived.vBuckets.size());
+        for (size_t i = 0; i < vPeer.size(); i++)
+            summaryPeer.Add(vPeer[i]);
+
+        std::vector<CInv> vInv;
+        for (size_t i = 0; i < vPeer.size(); i++)
+            if (summaryPeer.Differs(summaryReceived, vPeer[i]))
+                vInv.push_back(CInv(MSG_SERVICENODE_ANNOUNCE, vPeer[i]));
+        nBytes += GetInvBytes(vInv);
+    }
+    std::cout << "# ServicenodeSyncReconciled bytes: " << nBytes << "\n";
+}
+
+BENCHMARK(ServicenodeSyncFull);
+BENCHMARK(ServicenodeSyncReconciled);
@@ -0,0 +1,66 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "main.h"
+#include "spork.h"
+
+//! Transactions in the block checked
+static const int BENCH_SPORK_BLOCK_TXS = 2000;
+
+static const int vBenchSporks[] = {
+    SPORK_2_SWIFTTX,
+    SPORK_3_SWIFTTX_BLOCK_FILTERING,
+    SPORK_5_MAX_VALUE,
+    SPORK_7_SERVICENODE_SCANNING,
+    SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT,
+    SPORK_9_SERVICENODE_BUDGET_ENFORCEMENT,
+    SPORK_10_SERVICENODE_PAY_UPDATED_NODES,
+    SPORK_11_RESET_BUDGET,
+    SPORK_12_RECONSIDER_BLOCKS,
+    SPORK_13_ENABLE_SUPERBLOCKS,
+    SPORK_14_NEW_PROTOCOL_ENFORCEMENT,
+    SPORK_17_EXPL_FIX};
+
+// Reading every spork, as validation, the RPC and the GUI do
+static void SporkRead(benchmark::State& state)
+{
+    int64_t nSum = 0;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < sizeof(vBenchSporks) / sizeof(vBenchSporks[0]); i++) {
+            nSum += GetSporkValue(vBenchSporks[i]);
+            nSum += IsSporkActive(vBenchSporks[i]);
+        }
+    }
+    assert(nSum != 0);
+}
+
+// The spork 17 check of a block evaluated for each of its transactions, as
+// CheckTransaction does for a transaction on its own
+static void SporkCheckBlockPerTransaction(benchmark::State& state)
+{
+    int nChecked = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < BENCH_SPORK_BLOCK_TXS; i++)
+            nChecked += IsSporkActiveAtHeight(SPORK_17_EXPL_FIX, chainActive.Height());
+    }
+    assert(nChecked == 0);
+}
+
+// The same evaluated once for the block, as CheckBlock does
+static void SporkCheckBlockPerBlock(benchmark::State& state)
+{
+    int nChecked = 0;
+    while (state.KeepRunning()) {
+        bool fCheckStakeInputs = IsSporkActiveAtHeight(SPORK_17_EXPL_FIX, chainActive.Height());
+        for (int i = 0; i < BENCH_SPORK_BLOCK_TXS; i++)
+            nChecked += fCheckStakeInputs;
+    }
+    assert(nChecked == 0);
+}
+
+BENCHMARK(SporkCheckBlockPerBlock);
+BENCHMARK(SporkCheckBlockPerTransaction);
+BENCHMARK(SporkRead);
@@ -0,0 +1,151 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockhashcache.h"
+#include "chain.h"
+#include "key.h"
+#include "obfuscation.h"
+#include "random.h"
+#include "servicenode-sigcheck.h"
+#include "servicenodeman.h"
+#include "swifttx.h"
+#include "util.h"
+
+#include <boost/thread.hpp>
+
+//! Servicenodes of the list, of which the top SWIFTTX_SIGNATURES_TOTAL vote
+static const int BENCH_SWIFTTX_SERVICENODES = 2000;
+//! Transactions locked before their locks are dropped and locked again
+static const int BENCH_SWIFTTX_LOCKS = 100;
+//! Height the locks are voted on
+static const int BENCH_SWIFTTX_HEIGHT = 100;
+
+// A list of enabled servicenodes on a chain of BENCH_SWIFTTX_HEIGHT blocks,
+// and the "txlvote" messages of the servicenodes voting on each lock
+static const std::vector<std::vector<CDataStream> >& GetBenchLockVotes()
+{
+    static std::vector<uint256> vHash(BENCH_SWIFTTX_HEIGHT);
+    static std::vector<CBlockIndex> vBlocks(BENCH_SWIFTTX_HEIGHT);
+    static std::vector<std::vector<CDataStream> > vLocks;
+    blockHashCache.SetTip(&vBlocks.back());
+    if (!vLocks.empty())
+        return vLocks;
+
+    for (int i = 0; i < BENCH_SWIFTTX_HEIGHT; i++) {
+        vHash[i] = GetRandHash();
+        vBlocks[i].nHeight = i;
+        vBlocks[i].pprev = i ? &vBlocks[i - 1] : NULL;
+        vBlocks[i].phashBlock = &vHash[i];
+        vBlocks[i].BuildSkip();
+    }
+    blockHashCache.SetTip(&vBlocks.back());
+
+    mnodeman.Clear();
+    std::map<COutPoint, CKey> mapKeys;
+    for (int i = 0; i < BENCH_SWIFTTX_SERVICENODES; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+
+        CServicenode mn;
+        mn.vin = CTxIn(GetRandHash(), 0);
+        mn.pubKeyServicenode = key.GetPubKey();
+        mn.protocolVersion = PROTOCOL_VERSION;
+        mn.unitTest = true;
+        mn.lastPing.vin = mn.vin;
+        mn.lastPing.sigTime = GetAdjustedTime();
+        assert(mnodeman.Add(mn));
+        mapKeys[mn.vin.prevout] = key;
+    }
+
+    std::vector<CTxIn> vecQuorum;
+    assert(mnodeman.GetServicenodeQuorum(BENCH_SWIFTTX_HEIGHT, MIN_SWIFTTX_PROTO_VERSION, SWIFTTX_SIGNATURES_TOTAL, vecQuorum));
+    assert(vecQuorum.size() == SWIFTTX_SIGNATURES_TOTAL);
+
+    for (int i = 0; i < BENCH_SWIFTTX_LOCKS; i++) {
+        uint256 txHash = GetRandHash();
+        std::vector<CDataStream> vVotes;
+        BOOST_FOREACH (const CTxIn& vin, vecQuorum) {
+            CConsensusVote vote;
+            vote.vinServicenode = vin;
+            vote.txHash = txHash;
+            vote.nBlockHeight = BENCH_SWIFTTX_HEIGHT;
+            std::string errorMessage;
+            assert(obfuScationSigner.SignMessage(vote.GetStrMessage(), errorMessage, vote.vchServiceNodeSignature, mapKeys[vin.prevout]));
+
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << vote;
+            vVotes.push_back(ss);
+        }
+        vLocks.push_back(vVotes);
+    }
+    return vLocks;
+}
+
+// A node receiving the votes of a transaction it asked to lock, until the
+// lock is complete. Once all transactions are locked, their locks are
+// dropped so they can be locked again.
+static void BenchLockTransactions(benchmark::State& state, bool fQueue)
+{
+    const std::vector<std::vector<CDataStream> >& vLocks = GetBenchLockVotes();
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        if (i == 0) {
+            for (size_t j = 0; j < vLocks.size(); j++) {
+                CDataStream vRecv(vLocks[j][0]);
+                CConsensusVote vote;
+                vRecv >> vote;
+                mapTxLocks.erase(vote.txHash);
+            }
+            servicenodeSigCheckQueue.ClearVerified();
+        }
+
+        // the votes are queued as they arrive, before they are processed
+        if (fQueue) {
+            BOOST_FOREACH (const CDataStream& msg, vLocks[i])
+                servicenodeSigCheckQueue.Push("txlvote", msg);
+        }
+
+        uint256 txHash;
+        BOOST_FOREACH (const CDataStream& msg, vLocks[i]) {
+            CDataStream vRecv(msg);
+            CConsensusVote vote;
+            vRecv >> vote;
+            txHash = vote.txHash;
+            // asked to lock, as the "ix" does
+            GetTransactionLock(txHash).nBlockHeight = BENCH_SWIFTTX_HEIGHT;
+            assert(ProcessConsensusVote(NULL, vote));
+        }
+        assert(mapTxLocks[txHash].CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED);
+
+        if (++i == vLocks.size())
+            i = 0;
+    }
+
+    blockHashCache.SetTip(chainActive.Tip());
+}
+
+// Locking with the vote signatures checked ahead on worker threads
+static void SwiftTXLockLatency(benchmark::State& state)
+{
+    static boost::thread_group threadGroup;
+    if (threadGroup.size() == 0) {
+        for (unsigned int i = 1; i < std::max(2u, boost::thread::hardware_concurrency()); i++)
+            threadGroup.create_thread(boost::bind(&CServicenodeSigCheckQueue::Thread, &servicenodeSigCheckQueue));
+        MilliSleep(100);
+    }
+
+    BenchLockTransactions(state, true);
+}
+
+// The same with every vote signature checked by the message thread
+static void SwiftTXLockLatencySerial(benchmark::State& state)
+{
+    BenchLockTransactions(state, false);
+}
+
+BENCHMARK(SwiftTXLockLatency);
+BENCHMARK(SwiftTXLockLatencySerial);
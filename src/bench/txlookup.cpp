@@ -0,0 +1,54 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "main.h"
+#include "txdb.h"
+
+// Index the genesis coinbase so GetTransaction finds it through the txindex
+static uint256 IndexGenesisCoinbase()
+{
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Genesis();
+    CBlock block;
+    assert(ReadBlockFromDisk(block, pindex));
+
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    pos.hashBlock = pindex->GetBlockHash();
+    pos.nHeight = pindex->nHeight;
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    vPos.push_back(std::make_pair(block.vtx[0].GetHash(), pos));
+    assert(pblocktree->WriteTxIndex(vPos));
+    return block.vtx[0].GetHash();
+}
+
+// Lookups of a recently used transaction, served from memory
+static void TxLookupCached(benchmark::State& state)
+{
+    uint256 txid = IndexGenesisCoinbase();
+    SetTxLookupCacheSize(DEFAULT_TX_LOOKUP_CACHE);
+
+    CTransaction tx;
+    uint256 hashBlock;
+    while (state.KeepRunning())
+        assert(GetTransaction(txid, tx, hashBlock));
+}
+
+// Lookups through the txindex and the block file
+static void TxLookupDisk(benchmark::State& state)
+{
+    uint256 txid = IndexGenesisCoinbase();
+    SetTxLookupCacheSize(0);
+
+    CTransaction tx;
+    uint256 hashBlock;
+    while (state.KeepRunning())
+        assert(GetTransaction(txid, tx, hashBlock));
+
+    SetTxLookupCacheSize(DEFAULT_TX_LOOKUP_CACHE);
+}
+
+BENCHMARK(TxLookupCached);
+BENCHMARK(TxLookupDisk);
@@ -0,0 +1,159 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "version.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+#include <boost/foreach.hpp>
+
+//! Smallest serialized transaction, bounds the transactions a block can have
+static const unsigned int MIN_TRANSACTION_SIZE = 60;
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block)
+    : nonce(GetRand(std::numeric_limits<uint64_t>::max())), header(block.GetBlockHeader()), vchBlockSig(block.vchBlockSig)
+{
+    FillShortTxIDSelector();
+
+    // Nobody else can have the coinbase, nor the coinstake before the block
+    unsigned int nPrefilled = block.IsProofOfStake() ? 2 : 1;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        if (i < nPrefilled) {
+            CPrefilledTransaction prefilled;
+            prefilled.index = i;
+            prefilled.tx = block.vtx[i];
+            prefilledtxn.push_back(prefilled);
+        } else {
+            shorttxids.push_back(GetShortID(block.vtx[i].GetHash()));
+        }
+    }
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    uint256 hash;
+    CSHA256().Write((const unsigned char*)&stream[0], stream.size()).Finalize(hash.begin());
+    shorttxidk0 = ReadLE64(hash.begin());
+    shorttxidk1 = ReadLE64(hash.begin() + 8);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffULL;
+}
+
+ReadStatus CPartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, CTxMemPool& pool)
+{
+    if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
+        return READ_STATUS_INVALID;
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_SIZE / MIN_TRANSACTION_SIZE)
+        return READ_STATUS_INVALID;
+
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    vtx.assign(cmpctblock.BlockTxCount(), CTransaction());
+    vHave.assign(cmpctblock.BlockTxCount(), false);
+
+    BOOST_FOREACH (const CPrefilledTransaction& prefilled, cmpctblock.prefilledtxn) {
+        if (prefilled.index >= vtx.size() || vHave[prefilled.index] || prefilled.tx.IsNull())
+            return READ_STATUS_INVALID;
+        vtx[prefilled.index] = prefilled.tx;
+        vHave[prefilled.index] = true;
+    }
+
+    // The short ids fill the remaining positions in order
+    std::map<uint64_t, uint32_t> mapShortIDs;
+    uint32_t nIndex = 0;
+    BOOST_FOREACH (uint64_t shortid, cmpctblock.shorttxids) {
+        while (vHave[nIndex])
+            nIndex++;
+        // Two transactions of the block with the same short id can't be
+        // told apart, the block has to be downloaded whole
+        if (!mapShortIDs.insert(std::make_pair(shortid, nIndex)).second)
+            return READ_STATUS_FAILED;
+        nIndex++;
+    }
+
+    // A memory pool transaction colliding with the one matched first leaves
+    // the position to be requested from the peer
+    std::vector<bool> vCollided(vtx.size(), false);
+    {
+        LOCK(pool.cs);
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it) {
+            std::map<uint64_t, uint32_t>::const_iterator mi = mapShortIDs.find(cmpctblock.GetShortID(it->first));
+            if (mi == mapShortIDs.end() || vCollided[mi->second])
+                continue;
+            if (vHave[mi->second]) {
+                vtx[mi->second] = CTransaction();
+                vHave[mi->second] = false;
+                vCollided[mi->second] = true;
+            } else {
+                vtx[mi->second] = it->second.GetTx();
+                vHave[mi->second] = true;
+            }
+        }
+    }
+
+    LogPrint("cmpctblock", "Initialized compact block %s with %u transactions, %u of them prefilled or in the memory pool\n",
+        header.GetHash().ToString(), vtx.size(), std::count(vHave.begin(), vHave.end(), true));
+    return READ_STATUS_OK;
+}
+
+bool CPartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    return index < vHave.size() && vHave[index];
+}
+
+std::vector<uint32_t> CPartiallyDownloadedBlock::GetMissing() const
+{
+    std::vector<uint32_t> vMissing;
+    for (uint32_t i = 0; i < vHave.size(); i++)
+        if (!vHave[i])
+            vMissing.push_back(i);
+    return vMissing;
+}
+
+ReadStatus CPartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing) const
+{
+    if (header.IsNull())
+        return READ_STATUS_INVALID;
+
+    block.SetNull();
+    *(CBlockHeader*)&block = header;
+    block.vchBlockSig = vchBlockSig;
+    block.vtx.reserve(vtx.size());
+    size_t nMissing = 0;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vHave[i]) {
+            block.vtx.push_back(vtx[i]);
+        } else {
+            if (nMissing >= vtxMissing.size())
+                return READ_STATUS_INVALID;
+            block.vtx.push_back(vtxMissing[nMissing++]);
+        }
+    }
+    if (nMissing != vtxMissing.size())
+        return READ_STATUS_INVALID;
+
+    // A memory pool transaction with the short id of another one gives a
+    // different merkle root. That is no fault of the peer, who may have sent
+    // a valid block, so CheckBlock isn't left to reject it.
+    bool fMutated;
+    if (block.BuildMerkleTree(&fMutated) != header.hashMerkleRoot || fMutated)
+        return READ_STATUS_FAILED;
+    return READ_STATUS_OK;
+}
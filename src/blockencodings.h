@@ -0,0 +1,158 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+class CTxMemPool;
+
+//! A transaction sent in full with a compact block, at its index in the block
+struct CPrefilledTransaction {
+    uint32_t index;
+    CTransaction tx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(VARINT(index));
+        READWRITE(tx);
+    }
+};
+
+/**
+ * A block as sent to peers that likely have most of its transactions in their
+ * memory pool already: the header and block signature, the transactions no
+ * peer can have seen (the coinbase, and the coinstake of proof-of-stake
+ * blocks) and a 6-byte short id for every other transaction. Short ids are
+ * SipHash-2-4 of the txid keyed with the header and a random nonce, so nobody
+ * can make up transactions whose ids collide in the compact blocks of others.
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+    std::vector<uint64_t> shorttxids;
+    std::vector<CPrefilledTransaction> prefilledtxn;
+
+    CBlockHeaderAndShortTxIDs() : shorttxidk0(0), shorttxidk1(0), nonce(0) {}
+    explicit CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    // Short ids are written as their low 4 and high 2 bytes, and read one by
+    // one so that a forged count allocates nothing
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return ::GetSerializeSize(header, nType, nVersion) + ::GetSerializeSize(vchBlockSig, nType, nVersion) +
+               sizeof(nonce) + GetSizeOfCompactSize(shorttxids.size()) + 6 * shorttxids.size() +
+               ::GetSerializeSize(prefilledtxn, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s << header << vchBlockSig << nonce;
+        WriteCompactSize(s, shorttxids.size());
+        BOOST_FOREACH (uint64_t shortid, shorttxids)
+            s << (uint32_t)(shortid & 0xffffffff) << (uint16_t)((shortid >> 32) & 0xffff);
+        s << prefilledtxn;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        s >> header >> vchBlockSig >> nonce;
+        uint64_t nShortTxIDs = ReadCompactSize(s);
+        shorttxids.clear();
+        for (uint64_t i = 0; i < nShortTxIDs; i++) {
+            uint32_t lsb;
+            uint16_t msb;
+            s >> lsb >> msb;
+            shorttxids.push_back(((uint64_t)msb << 32) | lsb);
+        }
+        s >> prefilledtxn;
+        FillShortTxIDSelector();
+    }
+};
+
+//! Missing transactions of a compact block, requested by their indexes in the block
+struct CBlockTransactionsRequest {
+    uint256 blockhash;
+    std::vector<uint32_t> indexes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(indexes);
+    }
+};
+
+//! The transactions a CBlockTransactionsRequest asked for, in the order requested
+struct CBlockTransactions {
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+enum ReadStatus {
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //!< the peer sent something malformed
+    READ_STATUS_FAILED,  //!< short id collision, the full block has to be downloaded
+};
+
+/**
+ * A block being rebuilt from a compact block: the prefilled transactions
+ * and those of the memory pool whose short ids it lists, then whatever is
+ * still missing once the peer sent it.
+ */
+class CPartiallyDownloadedBlock
+{
+private:
+    std::vector<CTransaction> vtx;
+    std::vector<bool> vHave;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, CTxMemPool& pool);
+    bool IsTxAvailable(size_t index) const;
+    //! Indexes of the transactions neither prefilled nor found in the memory pool
+    std::vector<uint32_t> GetMissing() const;
+    //! Build the block with the missing transactions, in the order GetMissing returned them
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing) const;
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
@@ -0,0 +1,58 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockhashcache.h"
+
+#include "chain.h"
+
+#include <assert.h>
+
+CBlockHashCache blockHashCache;
+
+CBlockHashCache::CBlockHashCache() : pindexTip(NULL)
+{
+    CEntry empty;
+    empty.nHeight = -1;
+    vRing.assign(BLOCK_HASH_CACHE_SIZE, empty);
+}
+
+void CBlockHashCache::SetTip(const CBlockIndex* pindex)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+
+    bool fExtends = pindex && pindexTip && pindex->pprev == pindexTip;
+    pindexTip = pindex;
+
+    // A new block only adds its own hash, anything else rewrites the ring
+    // so none of the hashes it has left is from another chain
+    for (const CBlockIndex* pindexWalk = pindex; pindexWalk != NULL; pindexWalk = pindexWalk->pprev) {
+        CEntry& entry = vRing[pindexWalk->nHeight % BLOCK_HASH_CACHE_SIZE];
+        entry.nHeight = pindexWalk->nHeight;
+        entry.hash = pindexWalk->GetBlockHash();
+        if (fExtends || pindexWalk->nHeight <= pindex->nHeight - BLOCK_HASH_CACHE_SIZE + 1)
+            break;
+    }
+}
+
+int CBlockHashCache::Height() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return pindexTip ? pindexTip->nHeight : -1;
+}
+
+bool CBlockHashCache::GetHash(int nHeight, uint256& hash) const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+
+    if (pindexTip == NULL || nHeight < 0 || nHeight > pindexTip->nHeight)
+        return false;
+
+    if (nHeight > pindexTip->nHeight - BLOCK_HASH_CACHE_SIZE) {
+        const CEntry& entry = vRing[nHeight % BLOCK_HASH_CACHE_SIZE];
+        assert(entry.nHeight == nHeight);
+        hash = entry.hash;
+    } else
+        hash = pindexTip->GetAncestor(nHeight)->GetBlockHash();
+    return true;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKHASHCACHE_H
+#define BITCOIN_BLOCKHASHCACHE_H
+
+#include "uint256.h"
+
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+class CBlockIndex;
+
+//! Heights below the tip whose block hashes are kept in memory
+static const int BLOCK_HASH_CACHE_SIZE = 1024;
+
+/**
+ * Block hashes of the active chain by height, for the servicenode, payment
+ * and SwiftTX code that looks them up for every servicenode without holding
+ * cs_main. It follows chainActive: main sets its tip whenever that of
+ * chainActive changes, so answers never come from a chain reorganized away.
+ * The last BLOCK_HASH_CACHE_SIZE heights are answered from a ring indexed
+ * by height, older ones through the skip list of the tip.
+ */
+class CBlockHashCache
+{
+private:
+    //! A ring slot, for the block at height nHeight if any
+    struct CEntry {
+        int nHeight;
+        uint256 hash;
+    };
+
+    mutable boost::mutex cs;
+    std::vector<CEntry> vRing;
+    const CBlockIndex* pindexTip;
+
+public:
+    CBlockHashCache();
+
+    //! Follow the new tip of the active chain, or NULL when the chain is unloaded
+    void SetTip(const CBlockIndex* pindex);
+
+    //! Height of the tip, -1 without a chain
+    int Height() const;
+
+    //! Hash of the active chain's block at nHeight, false above the tip
+    bool GetHash(int nHeight, uint256& hash) const;
+};
+
+extern CBlockHashCache blockHashCache;
+
+#endif // BITCOIN_BLOCKHASHCACHE_H
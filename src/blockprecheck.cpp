@@ -0,0 +1,207 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockprecheck.h"
+
+#include "coins.h"
+#include "hash.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
+#include "util.h"
+
+#include <boost/foreach.hpp>
+
+CBlockPrecheckQueue blockPrecheckQueue;
+
+// Merkle root of the hashes, computed like CBlock::BuildMerkleTree but without
+// the block's own tree, which the validating thread may be building meanwhile
+static uint256 ComputeMerkleRoot(std::vector<uint256> vHashes, bool& fMutated)
+{
+    fMutated = false;
+    while (vHashes.size() > 1) {
+        size_t nSize = vHashes.size();
+        if (nSize % 2 == 0 && vHashes[nSize - 2] == vHashes[nSize - 1])
+            fMutated = true;
+        std::vector<uint256> vNext;
+        vNext.reserve((nSize + 1) / 2);
+        for (size_t i = 0; i < nSize; i += 2) {
+            size_t i2 = std::min(i + 1, nSize - 1);
+            vNext.push_back(Hash(vHashes[i].begin(), vHashes[i].end(), vHashes[i2].begin(), vHashes[i2].end()));
+        }
+        vHashes.swap(vNext);
+    }
+    return vHashes.empty() ? uint256() : vHashes[0];
+}
+
+// The block hash does not cover the block signature, so both identify a result
+static uint256 GetSignatureKey(const CBlock& block)
+{
+    uint256 hash = block.GetHash();
+    return Hash(hash.begin(), hash.end(), block.vchBlockSig.begin(), block.vchBlockSig.end());
+}
+
+void CBlockPrecheckQueue::Thread()
+{
+    RenameThread("blocknetdx-blkcheck");
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers++;
+    }
+    try {
+        while (true) {
+            CJob job;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (queue.empty())
+                    cond.wait(lock);
+                job = queue.front();
+                queue.pop_front();
+            }
+            if (job.pmsg) {
+                CBlock* pblock = new CBlock();
+                job.pblock.reset(pblock);
+                try {
+                    *job.pmsg >> *pblock;
+                } catch (const std::exception&) {
+                    // ProcessMessage reports malformed messages
+                    continue;
+                }
+            }
+            Check(job.pblock);
+        }
+    } catch (boost::thread_interrupted) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers--;
+        throw;
+    }
+}
+
+bool CBlockPrecheckQueue::Push(const CJob& job)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (nWorkers == 0 || queue.size() >= MAX_PRECHECK_QUEUE_SIZE)
+            return false;
+        queue.push_back(job);
+    }
+    cond.notify_one();
+    return true;
+}
+
+bool CBlockPrecheckQueue::Push(const boost::shared_ptr<const CBlock>& pblock)
+{
+    CJob job;
+    job.pblock = pblock;
+    return Push(job);
+}
+
+bool CBlockPrecheckQueue::Push(const CDataStream& vRecv)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (nWorkers == 0)
+            return false;
+    }
+    CJob job;
+    job.pmsg.reset(new CDataStream(vRecv));
+    return Push(job);
+}
+
+bool CBlockPrecheckQueue::HaveValidSignature(const CBlock& block)
+{
+    uint256 key = GetSignatureKey(block);
+    bool fValid = false;
+    boost::unique_lock<boost::mutex> lock(cs);
+    return signatures.get(key, fValid) && fValid;
+}
+
+void CBlockPrecheckQueue::SetCoinsView(CCoinsView* pcoinsviewIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    pcoinsview = pcoinsviewIn;
+}
+
+void CBlockPrecheckQueue::Check(const boost::shared_ptr<const CBlock>& pblock)
+{
+    const CBlock& block = *pblock;
+
+    // Blocks that don't match their header aren't worth any more work
+    std::vector<uint256> vHashes;
+    vHashes.reserve(block.vtx.size());
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        vHashes.push_back(tx.GetHash());
+    bool fMutated;
+    if (vHashes.empty() || ComputeMerkleRoot(vHashes, fMutated) != block.hashMerkleRoot || fMutated)
+        return;
+    if (!block.CheckBlockSignature())
+        return;
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        signatures.insert(GetSignatureKey(block), true);
+    }
+    AddToWindow(pblock);
+
+    // Run the input scripts, valid signatures are kept by the signature cache
+    std::map<uint256, const CTransaction*> mapBlockTx;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (!tx.IsCoinBase()) {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                CScript scriptPubKey;
+                if (GetSpentOutput(tx.vin[i].prevout, mapBlockTx, scriptPubKey))
+                    VerifyScript(tx.vin[i].scriptSig, scriptPubKey, SCRIPT_VERIFY_P2SH, CachingTransactionSignatureChecker(&tx, i, true));
+            }
+        }
+        mapBlockTx[tx.GetHash()] = &tx;
+    }
+}
+
+void CBlockPrecheckQueue::AddToWindow(const boost::shared_ptr<const CBlock>& pblock)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    window.push_back(pblock);
+    BOOST_FOREACH (const CTransaction& tx, pblock->vtx)
+        mapWindowTx[tx.GetHash()] = &tx;
+
+    while (window.size() > PRECHECK_WINDOW_SIZE) {
+        BOOST_FOREACH (const CTransaction& tx, window.front()->vtx) {
+            std::map<uint256, const CTransaction*>::iterator it = mapWindowTx.find(tx.GetHash());
+            if (it != mapWindowTx.end() && it->second == &tx)
+                mapWindowTx.erase(it);
+        }
+        window.pop_front();
+    }
+}
+
+bool CBlockPrecheckQueue::GetSpentOutput(const COutPoint& prevout, const std::map<uint256, const CTransaction*>& mapBlockTx, CScript& scriptPubKey)
+{
+    std::map<uint256, const CTransaction*>::const_iterator it = mapBlockTx.find(prevout.hash);
+    if (it != mapBlockTx.end()) {
+        if (prevout.n >= it->second->vout.size())
+            return false;
+        scriptPubKey = it->second->vout[prevout.n].scriptPubKey;
+        return true;
+    }
+
+    CCoinsView* pview;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        it = mapWindowTx.find(prevout.hash);
+        if (it != mapWindowTx.end()) {
+            if (prevout.n >= it->second->vout.size())
+                return false;
+            scriptPubKey = it->second->vout[prevout.n].scriptPubKey;
+            return true;
+        }
+        pview = pcoinsview;
+    }
+
+    // The database lags the coins cache, but whatever output it returns is
+    // only used to check signatures, never to accept the block
+    CCoins coins;
+    if (!pview || !pview->GetCoins(prevout.hash, coins) || !coins.IsAvailable(prevout.n))
+        return false;
+    scriptPubKey = coins.vout[prevout.n].scriptPubKey;
+    return true;
+}
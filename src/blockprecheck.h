@@ -0,0 +1,89 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPRECHECK_H
+#define BITCOIN_BLOCKPRECHECK_H
+
+#include "lrucache.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CCoinsView;
+class CScript;
+
+//! Blocks waiting to be checked above which no more are queued
+static const unsigned int MAX_PRECHECK_QUEUE_SIZE = 256;
+//! Number of valid block signatures remembered
+static const unsigned int PRECHECK_SIGNATURE_CACHE_SIZE = 1024;
+//! Checked blocks kept to find the outputs spent by the blocks after them
+static const unsigned int PRECHECK_WINDOW_SIZE = 128;
+
+/**
+ * Checks blocks on worker threads before they are connected, which happens
+ * one block at a time under cs_main. The merkle root and the proof-of-stake
+ * block signature of each block are verified, then the scripts of its inputs
+ * are run against the outputs they spend wherever those can be found without
+ * cs_main: earlier in the block, in recently checked blocks or in the coins
+ * database. That fills the signature cache ConnectBlock looks up, so during
+ * the initial download most of its script checks become cache hits.
+ *
+ * Blocks we asked a peer for and whose parent we know are queued from the
+ * network before their message is processed, and others are queued by
+ * LoadExternalBlockFile as it reads ahead. Without worker threads nothing
+ * is queued and validation runs exactly as before.
+ */
+class CBlockPrecheckQueue
+{
+private:
+    //! A block to check, or the message it still has to be read from
+    struct CJob {
+        boost::shared_ptr<const CBlock> pblock;
+        boost::shared_ptr<CDataStream> pmsg;
+    };
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<CJob> queue;
+    int nWorkers;
+    CCoinsView* pcoinsview;
+    //! blocks whose signature was verified, by block hash and signature
+    lrucache<uint256, bool> signatures;
+    //! recently checked blocks and their transactions by hash
+    std::deque<boost::shared_ptr<const CBlock> > window;
+    std::map<uint256, const CTransaction*> mapWindowTx;
+
+    bool Push(const CJob& job);
+    void Check(const boost::shared_ptr<const CBlock>& pblock);
+    void AddToWindow(const boost::shared_ptr<const CBlock>& pblock);
+    bool GetSpentOutput(const COutPoint& prevout, const std::map<uint256, const CTransaction*>& mapBlockTx, CScript& scriptPubKey);
+
+public:
+    CBlockPrecheckQueue() : nWorkers(0), pcoinsview(NULL), signatures(PRECHECK_SIGNATURE_CACHE_SIZE) {}
+
+    //! Worker thread loop, returns when interrupted
+    void Thread();
+
+    //! Queue a block, returns false when it is not going to be checked
+    bool Push(const boost::shared_ptr<const CBlock>& pblock);
+    //! Queue the block a "block" message carries, read on the worker thread
+    bool Push(const CDataStream& vRecv);
+
+    //! Whether the block signature was found valid, in which case it needn't be checked again
+    bool HaveValidSignature(const CBlock& block);
+
+    //! Database the spent outputs missing from recent blocks are looked up in, or NULL
+    void SetCoinsView(CCoinsView* pcoinsviewIn);
+};
+
+extern CBlockPrecheckQueue blockPrecheckQueue;
+
+#endif // BITCOIN_BLOCKPRECHECK_H
@@ -0,0 +1,246 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileCache blockFileCache;
+CBlockWriteQueue blockWriteQueue;
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+boost::shared_ptr<CMappedBlockFile> CMappedBlockFile::Map(const boost::filesystem::path& path)
+{
+    boost::shared_ptr<CMappedBlockFile> map;
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return map;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* pdata = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (pdata != MAP_FAILED)
+            map.reset(new CMappedBlockFile((const char*)pdata, st.st_size));
+        else
+            LogPrint("db", "%s : mmap of %s failed\n", __func__, path.string());
+    }
+    close(fd);
+#endif
+    return map;
+}
+
+boost::shared_ptr<CMappedBlockFile> CBlockFileCache::MapFile(int nFile)
+{
+    return CMappedBlockFile::Map(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+}
+
+bool CBlockFileCache::GetBlockBytes(const CDiskBlockPos& pos, boost::shared_ptr<CMappedBlockFile>& map, const char*& pbegin, const char*& pend)
+{
+    // blocks are stored after their message start and size
+    if (pos.IsNull() || pos.nPos < 4)
+        return false;
+
+    LOCK(cs);
+    if (maps.max_size() == 0)
+        return false;
+
+    // a file still being appended to may have grown past the map
+    bool fFresh = false;
+    if (!maps.get(pos.nFile, map) || map->size() < pos.nPos) {
+        map = MapFile(pos.nFile);
+        if (!map)
+            return false;
+        maps.insert(pos.nFile, map);
+        fFresh = true;
+    }
+    if (map->size() < pos.nPos)
+        return false;
+    unsigned int nSize = ReadLE32((const unsigned char*)map->data() + pos.nPos - 4);
+    if (map->size() - pos.nPos < nSize) {
+        if (fFresh || !(map = MapFile(pos.nFile)))
+            return false;
+        maps.insert(pos.nFile, map);
+        if (map->size() - pos.nPos < nSize)
+            return false;
+    }
+    pbegin = map->data() + pos.nPos;
+    pend = pbegin + nSize;
+
+    // prefetch the following blocks when the file is read front to back
+    unsigned int& nLastReadEnd = mapLastReadEnd[pos.nFile];
+    if (pos.nPos >= nLastReadEnd && pos.nPos - nLastReadEnd <= 8) {
+#ifndef WIN32
+        static const size_t nPageSize = sysconf(_SC_PAGESIZE);
+        size_t nBegin = (pos.nPos + nSize) & ~(nPageSize - 1);
+        if (nBegin < map->size())
+            madvise((void*)(map->data() + nBegin), std::min((size_t)BLOCK_READ_AHEAD_SIZE, map->size() - nBegin), MADV_WILLNEED);
+#endif
+    }
+    nLastReadEnd = pos.nPos + nSize;
+    return true;
+}
+
+void CBlockFileCache::SetMaxFiles(size_t nMaxFiles)
+{
+    LOCK(cs);
+    maps.max_size(nMaxFiles);
+}
+
+void CBlockFileCache::Invalidate(int nFile)
+{
+    LOCK(cs);
+    maps.erase(nFile);
+    mapLastReadEnd.erase(nFile);
+}
+
+//! Offset of a block's data from its message start
+static const unsigned int BLOCK_HEADER_SIZE = MESSAGE_START_SIZE + sizeof(unsigned int);
+
+// Write serialized block data and the header in front of it, see WriteBlockToDisk
+static bool WriteBlockData(const CDiskBlockPos& pos, const CSerializeData& data)
+{
+    try {
+        CAutoFile fileout(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - BLOCK_HEADER_SIZE)), SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s : OpenBlockFile failed", __func__);
+        unsigned int nSize = data.size();
+        fileout << FLATDATA(Params().MessageStart()) << nSize;
+        fileout.write(&data[0], data.size());
+    } catch (std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+void CBlockWriteQueue::Thread()
+{
+    RenameThread("blocknetdx-blkwrite");
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWriters++;
+    }
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (queue.empty())
+                    cond.wait(lock);
+            }
+            bool fWritten;
+            WriteNext(fWritten);
+        }
+    } catch (boost::thread_interrupted) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWriters--;
+        throw;
+    }
+}
+
+bool CBlockWriteQueue::Push(const CBlock& block, CDiskBlockPos& pos)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    boost::shared_ptr<CSerializeData> data(new CSerializeData());
+    ss.GetAndClear(*data);
+    pos.nPos += BLOCK_HEADER_SIZE;
+
+    bool fWriteHere;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        mapPending[std::make_pair(pos.nFile, pos.nPos)] = data;
+        queue.push_back(pos);
+        nPendingBytes += data->size();
+        fWriteHere = nWriters == 0;
+    }
+    if (fWriteHere)
+        return Flush();
+    cond.notify_one();
+
+    // don't let the writer fall behind without bound
+    bool fWritten = true;
+    while (fWritten) {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (nPendingBytes <= MAX_BLOCK_WRITE_QUEUE_SIZE)
+                break;
+        }
+        if (!WriteNext(fWritten))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockWriteQueue::WriteNext(bool& fWritten)
+{
+    boost::unique_lock<boost::mutex> lockWrite(csWrite);
+    CDiskBlockPos pos;
+    boost::shared_ptr<CSerializeData> data;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fWritten = !queue.empty();
+        if (!fWritten)
+            return true;
+        pos = queue.front();
+        data = mapPending[std::make_pair(pos.nFile, pos.nPos)];
+    }
+
+    // the block stays readable from the queue until it is in the file
+    bool fOk = WriteBlockData(pos, *data);
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        queue.pop_front();
+        mapPending.erase(std::make_pair(pos.nFile, pos.nPos));
+        nPendingBytes -= data->size();
+    }
+    if (!fOk)
+        return AbortNode("Failed to write block");
+    return true;
+}
+
+bool CBlockWriteQueue::Flush()
+{
+    bool fWritten = true;
+    while (fWritten) {
+        if (!WriteNext(fWritten))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockWriteQueue::WaitWritten(const CDiskBlockPos& pos)
+{
+    boost::shared_ptr<CSerializeData> data;
+    bool fWritten = true;
+    while (fWritten && GetPending(pos, data)) {
+        if (!WriteNext(fWritten))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockWriteQueue::GetPending(const CDiskBlockPos& pos, boost::shared_ptr<CSerializeData>& data)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    std::map<std::pair<int, unsigned int>, boost::shared_ptr<CSerializeData> >::iterator it = mapPending.find(std::make_pair(pos.nFile, pos.nPos));
+    if (it == mapPending.end())
+        return false;
+    data = it->second;
+    return true;
+}
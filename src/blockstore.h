@@ -0,0 +1,166 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTORE_H
+#define BITCOIN_BLOCKSTORE_H
+
+#include "chain.h"
+#include "clientversion.h"
+#include "lrucache.h"
+#include "streams.h"
+#include "sync.h"
+
+#include <deque>
+#include <map>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+
+//! -blockfilemaps default (number of block files kept memory-mapped)
+static const int DEFAULT_BLOCK_FILE_MAPS = sizeof(void*) > 4 ? 16 : 2;
+//! Bytes after a sequentially read block that are prefetched
+static const unsigned int BLOCK_READ_AHEAD_SIZE = 0x400000; // 4 MiB
+//! Bytes of queued block writes above which the writing thread is not waited for
+static const size_t MAX_BLOCK_WRITE_QUEUE_SIZE = 0x2000000; // 32 MiB
+
+/** Read-only memory map of a block file, as large as the file was when it was mapped */
+class CMappedBlockFile
+{
+private:
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+    const char* pdata;
+    size_t nSize;
+
+public:
+    CMappedBlockFile(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    ~CMappedBlockFile();
+
+    //! Map the whole file at path, NULL if it is empty or cannot be mapped
+    static boost::shared_ptr<CMappedBlockFile> Map(const boost::filesystem::path& path);
+
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Serves reads of stored blocks from memory maps of the most recently used
+ * block files, shared by all threads. Blocks are deserialized straight from
+ * the mapped bytes. When a file is read front to back, as when a peer fetches
+ * consecutive blocks during its initial download, the bytes following each
+ * block are prefetched.
+ */
+class CBlockFileCache
+{
+private:
+    CCriticalSection cs;
+    lrucache<int, boost::shared_ptr<CMappedBlockFile> > maps;
+    //! end of the last block read from each file, to detect sequential reads
+    std::map<int, unsigned int> mapLastReadEnd;
+
+    boost::shared_ptr<CMappedBlockFile> MapFile(int nFile);
+    bool GetBlockBytes(const CDiskBlockPos& pos, boost::shared_ptr<CMappedBlockFile>& map, const char*& pbegin, const char*& pend);
+
+public:
+    CBlockFileCache(size_t nMaxFiles = DEFAULT_BLOCK_FILE_MAPS) : maps(nMaxFiles) {}
+
+    //! Change the number of mapped files, 0 disables the cache
+    void SetMaxFiles(size_t nMaxFiles);
+    //! Forget the map of a file that was truncated or rewritten
+    void Invalidate(int nFile);
+
+    /**
+     * Deserialize obj from nOffset bytes into the block stored at pos.
+     * Returns false when the file cannot be mapped, in which case the caller
+     * reads it through a regular file stream. Throws on deserialization
+     * errors, like the file streams do.
+     */
+    template <typename T>
+    bool Read(const CDiskBlockPos& pos, unsigned int nOffset, T& obj)
+    {
+        boost::shared_ptr<CMappedBlockFile> map;
+        const char* pbegin;
+        const char* pend;
+        if (!GetBlockBytes(pos, map, pbegin, pend))
+            return false;
+        if (nOffset > (size_t)(pend - pbegin))
+            throw std::ios_base::failure("CBlockFileCache::Read : offset past the end of the block");
+        CBufferReader reader(pbegin + nOffset, pend, SER_DISK, CLIENT_VERSION);
+        reader >> obj;
+        return true;
+    }
+};
+
+extern CBlockFileCache blockFileCache;
+
+/**
+ * Writes accepted blocks to their block files on a background thread, so the
+ * thread connecting blocks does not wait on the disk. Room for a block is
+ * allocated before it is queued, and until it is written the block is read
+ * back from the queue. Without a running writer, or once the queue is full,
+ * blocks are written by the thread queueing them.
+ */
+class CBlockWriteQueue
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    //! serialized blocks by file and position of their data, until written
+    std::map<std::pair<int, unsigned int>, boost::shared_ptr<CSerializeData> > mapPending;
+    //! positions in the order the blocks were queued
+    std::deque<CDiskBlockPos> queue;
+    size_t nPendingBytes;
+    int nWriters;
+    //! held while a block is written, so Flush() waits for a write in progress
+    boost::mutex csWrite;
+
+    bool GetPending(const CDiskBlockPos& pos, boost::shared_ptr<CSerializeData>& data);
+    bool WriteNext(bool& fWritten);
+
+public:
+    CBlockWriteQueue() : nPendingBytes(0), nWriters(0) {}
+
+    //! Writer thread loop, returns when interrupted
+    void Thread();
+
+    /**
+     * Queue block to be stored at pos, which points at its message start like
+     * for WriteBlockToDisk, and is likewise moved to the block data.
+     */
+    bool Push(const CBlock& block, CDiskBlockPos& pos);
+    //! Write all queued blocks, returns false if a write failed
+    bool Flush();
+    //! Return once the block stored at pos is in its file
+    bool WaitWritten(const CDiskBlockPos& pos);
+
+    //! Like CBlockFileCache::Read, for blocks that are not written yet
+    template <typename T>
+    bool Read(const CDiskBlockPos& pos, unsigned int nOffset, T& obj)
+    {
+        boost::shared_ptr<CSerializeData> data;
+        if (!GetPending(pos, data))
+            return false;
+        if (nOffset > data->size())
+            throw std::ios_base::failure("CBlockWriteQueue::Read : offset past the end of the block");
+        CBufferReader reader(&(*data)[0] + nOffset, &(*data)[0] + data->size(), SER_DISK, CLIENT_VERSION);
+        reader >> obj;
+        return true;
+    }
+};
+
+extern CBlockWriteQueue blockWriteQueue;
+
+/** Deserialize obj from a stored block without opening its file, see CBlockFileCache::Read */
+template <typename T>
+bool ReadFromBlockStore(const CDiskBlockPos& pos, unsigned int nOffset, T& obj)
+{
+    return blockWriteQueue.Read(pos, nOffset, obj) || blockFileCache.Read(pos, nOffset, obj);
+}
+
+#endif // BITCOIN_BLOCKSTORE_H
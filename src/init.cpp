@@ -14,12 +14,15 @@
 #include "activeservicenode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockprecheck.h"
+#include "blockstore.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "key.h"
 #include "main.h"
 #include "servicenode-budget.h"
 #include "servicenode-payments.h"
+#include "servicenode-sigcheck.h"
 #include "servicenodeconfig.h"
 #include "servicenodeman.h"
 #include "miner.h"
@@ -66,6 +69,8 @@ CWallet* pwalletMain = NULL;
 int nWalletBackups = 10;
 #endif
 bool fFeeEstimatesInitialized = false;
+//! Set once the saved memory pool was loaded, so that an early shutdown doesn't overwrite it
+static bool fDumpMempoolLater = false;
 bool fRestartRequested = false; // true: restart false: shutdown
 
 #if ENABLE_ZMQ
@@ -187,6 +192,10 @@ void PrepareShutdown()
     DumpServicenodePayments();
     UnregisterNodeSignals(GetNodeSignals());
 
+    // Together with the fee estimates, which track the same transactions
+    if (fDumpMempoolLater)
+        DumpMempool();
+
     if (fFeeEstimatesInitialized) {
         boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
         CAutoFile est_fileout(fopen(est_path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
@@ -209,6 +218,7 @@ void PrepareShutdown()
         pcoinsTip = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
+        blockPrecheckQueue.SetCoinsView(NULL);
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
@@ -306,9 +316,12 @@ std::string HelpMessage(HelpMessageMode mode)
     string strUsage = HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of the outputs paying and spent by each address, used by the getaddress* rpc calls and the block explorer (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-blockfilemaps=<n>", strprintf(_("Keep at most <n> block files memory-mapped to serve block reads, 0 to disable (default: %u)"), DEFAULT_BLOCK_FILE_MAPS));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
+    strUsage += HelpMessageOpt("-checkblockhashes", strprintf(_("Rehash every block header in the block index at startup and check it against the stored hash and proof of work (default: %u)"), DEFAULT_CHECKBLOCKHASHES));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "blocknetdx.conf"));
@@ -319,17 +332,23 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-fastimport", strprintf(_("Import bootstrap.dat and -loadblock files through a memory map, decoding their blocks in parallel and flushing the chain state in bulk (default: %u)"), DEFAULT_FAST_IMPORT));
+    strUsage += HelpMessageOpt("-importcheckpoint=<hash>", _("Skip the script checks of this block and its ancestors when importing them with -fastimport"));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "blocknetdxd.pid"));
 #endif
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Save the memory pool on shutdown and load it on startup (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain an index of the input spending each output, used by the getspentinfo rpc call and the block explorer (default: %u)"), DEFAULT_SPENTINDEX));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-txlookupcache=<n>", strprintf(_("Keep at most <n> recently looked up confirmed transactions in memory (default: %u)"), DEFAULT_TX_LOOKUP_CACHE));
+    strUsage += HelpMessageOpt("-txscriptcache=<n>", strprintf(_("Remember the scripts of at most <n> memory pool transactions as valid, so connecting blocks skips them (default: %u)"), DEFAULT_TX_SCRIPT_CACHE));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -337,6 +356,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), 86400));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-compactblocks", strprintf(_("Relay new blocks as compact blocks, rebuilt from the memory pool, to and from peers supporting them (default: %u)"), DEFAULT_COMPACT_BLOCKS));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP address (default: 1 when listening and no -externalip)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
@@ -497,7 +517,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 41414, 41419));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
-    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), 4));
+    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_RPC_THREADS));
+    strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf(_("Set the depth of the work queue to service RPC calls, further requests are refused (default: %d)"), DEFAULT_RPC_WORKQUEUE));
+    strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf(_("Close idle RPC connections after <n> seconds (default: %d)"), DEFAULT_RPC_SERVER_TIMEOUT));
     strUsage += HelpMessageOpt("-rpckeepalive", strprintf(_("RPC support for HTTP persistent connections (default: %d)"), 1));
 
     strUsage += HelpMessageGroup(_("RPC SSL options: (see the Bitcoin Wiki for SSL setup instructions)"));
@@ -573,6 +595,9 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         InitBlockIndex();
     }
 
+    bool fFastImport = GetBoolArg("-fastimport", DEFAULT_FAST_IMPORT);
+    uint256 hashCheckpoint(GetArg("-importcheckpoint", ""));
+
     // hardcoded $DATADIR/bootstrap.dat
     filesystem::path pathBootstrap = GetDataDir() / "bootstrap.dat";
     if (filesystem::exists(pathBootstrap)) {
@@ -581,7 +606,12 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
             CImportingNow imp;
             filesystem::path pathBootstrapOld = GetDataDir() / "bootstrap.dat.old";
             LogPrintf("Importing bootstrap.dat...\n");
-            LoadExternalBlockFile(file);
+            if (fFastImport) {
+                fclose(file);
+                LoadExternalBlockFileFast(pathBootstrap, hashCheckpoint);
+            } else {
+                LoadExternalBlockFile(file);
+            }
             RenameOver(pathBootstrap, pathBootstrapOld);
         } else {
             LogPrintf("Warning: Could not open bootstrap file %s\n", pathBootstrap.string());
@@ -594,7 +624,12 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         if (file) {
             CImportingNow imp;
             LogPrintf("Importing blocks file %s...\n", path.string());
-            LoadExternalBlockFile(file);
+            if (fFastImport) {
+                fclose(file);
+                LoadExternalBlockFileFast(path, hashCheckpoint);
+            } else {
+                LoadExternalBlockFile(file);
+            }
         } else {
             LogPrintf("Warning: Could not open blocks file %s\n", path.string());
         }
@@ -604,6 +639,11 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        LoadMempool();
+        fDumpMempoolLater = !ShutdownRequested();
+    }
 }
 
 /** Sanity checks
@@ -888,6 +928,8 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     if (GetBoolArg("-peerbloomfilters", false))
         nLocalServices |= NODE_BLOOM;
+    if (GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS))
+        nLocalServices |= NODE_COMPACT_BLOCKS;
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
@@ -942,8 +984,23 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // the checks of a block that need no locks, by as many threads
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadBlockCheck);
     }
 
+    // Blocks are checked ahead of the tip by as many threads, at least one,
+    // and written to disk by one more
+    int nPrecheckThreads = std::max(nScriptCheckThreads - 1, 1);
+    LogPrintf("Using %u threads for checking blocks ahead\n", nPrecheckThreads);
+    for (int i = 0; i < nPrecheckThreads; i++)
+        threadGroup.create_thread(boost::bind(&CBlockPrecheckQueue::Thread, &blockPrecheckQueue));
+    threadGroup.create_thread(boost::bind(&CBlockWriteQueue::Thread, &blockWriteQueue));
+
+    // Servicenode message signatures are checked ahead by as many threads again
+    for (int i = 0; i < nPrecheckThreads; i++)
+        threadGroup.create_thread(boost::bind(&CServicenodeSigCheckQueue::Thread, &servicenodeSigCheckQueue));
+
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
         if (!sporkManager.SetPrivKey(GetArg("-sporkkey", "")))
@@ -1226,6 +1283,9 @@ bool AppInit2(boost::thread_group& threadGroup)
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    SetTxLookupCacheSize(std::max((int64_t)0, GetArg("-txlookupcache", DEFAULT_TX_LOOKUP_CACHE)));
+    SetTxScriptCacheSize(std::max((int64_t)0, GetArg("-txscriptcache", DEFAULT_TX_SCRIPT_CACHE)));
+    blockFileCache.SetMaxFiles(std::max((int64_t)0, GetArg("-blockfilemaps", DEFAULT_BLOCK_FILE_MAPS)));
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -1273,6 +1333,16 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
 
+                // Check for changed -addressindex and -spentindex state
+                if (fAddressIndex != GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -addressindex");
+                    break;
+                }
+                if (fSpentIndex != GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
+                    break;
+                }
+
                 uiInterface.InitMessage(_("Verifying blocks..."));
                 if (!CVerifyDB().VerifyDB(pcoinsdbview, GetArg("-checklevel", 3),
                         GetArg("-checkblocks", 500))) {
@@ -1461,6 +1531,7 @@ bool AppInit2(boost::thread_group& threadGroup)
         BOOST_FOREACH (string strFile, mapMultiArgs["-loadblock"])
             vImportFiles.push_back(strFile);
     }
+    blockPrecheckQueue.SetCoinsView(pcoinsdbview);
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
@@ -1483,6 +1554,10 @@ bool AppInit2(boost::thread_group& threadGroup)
         else
             LogPrintf("file format is unknown or invalid, please fix it manually\n");
     }
+    // changes received after the file was written
+    servicenodeCacheLog.Load(mndb.GetLogGeneration(), mnodeman);
+    // tell the servicenode list about collateral spends from here on
+    RegisterValidationInterface(&mnodeman);
 
     uiInterface.InitMessage(_("Loading budget cache..."));
 
@@ -1498,6 +1573,7 @@ bool AppInit2(boost::thread_group& threadGroup)
         else
             LogPrintf("file format is unknown or invalid, please fix it manually\n");
     }
+    budgetCacheLog.Load(budgetdb.GetLogGeneration(), budget);
 
     //flag our cached items so we send them to our peers
     budget.ResetSync();
@@ -1518,6 +1594,7 @@ bool AppInit2(boost::thread_group& threadGroup)
         else
             LogPrintf("file format is unknown or invalid, please fix it manually\n");
     }
+    servicenodePaymentsCacheLog.Load(mnpayments.GetLogGeneration(), servicenodePayments);
 
     fServiceNode = GetBoolArg("-servicenode", false);
 
@@ -1628,6 +1705,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     obfuScationPool.InitCollateralAddress();
 
     threadGroup.create_thread(boost::bind(&ThreadCheckObfuScationPool));
+    threadGroup.create_thread(boost::bind(&ThreadDumpServicenodeCaches));
 
     // ********************************************************* Step 11: start node
 
@@ -0,0 +1,95 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LRUCACHE_H
+#define BITCOIN_LRUCACHE_H
+
+#include <list>
+#include <map>
+#include <utility>
+
+/**
+ * STL-like map container that only keeps the N most recently used elements.
+ * Both lookups and insertions count as a use. Not thread-safe.
+ */
+template <typename K, typename V>
+class lrucache
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef typename std::list<value_type>::size_type size_type;
+
+protected:
+    //! elements, most recently used first
+    std::list<value_type> list;
+    typedef typename std::list<value_type>::iterator list_iterator;
+    std::map<K, list_iterator> map;
+    typedef typename std::map<K, list_iterator>::iterator map_iterator;
+    size_type nMaxSize;
+
+public:
+    lrucache(size_type nMaxSizeIn = 0) { nMaxSize = nMaxSizeIn; }
+    size_type size() const { return list.size(); }
+    bool empty() const { return list.empty(); }
+    bool contains(const key_type& k) const { return map.count(k) != 0; }
+    void clear()
+    {
+        map.clear();
+        list.clear();
+    }
+
+    /** Copy the value for k into v and mark it as most recently used. */
+    bool get(const key_type& k, mapped_type& v)
+    {
+        map_iterator it = map.find(k);
+        if (it == map.end())
+            return false;
+        list.splice(list.begin(), list, it->second);
+        v = it->second->second;
+        return true;
+    }
+
+    /** Insert or replace the value for k, evicting the least recently used element when full. */
+    void insert(const key_type& k, const mapped_type& v)
+    {
+        if (nMaxSize == 0)
+            return;
+        map_iterator it = map.find(k);
+        if (it != map.end()) {
+            it->second->second = v;
+            list.splice(list.begin(), list, it->second);
+            return;
+        }
+        list.push_front(std::make_pair(k, v));
+        map.insert(std::make_pair(k, list.begin()));
+        while (list.size() > nMaxSize) {
+            map.erase(list.back().first);
+            list.pop_back();
+        }
+    }
+
+    void erase(const key_type& k)
+    {
+        map_iterator it = map.find(k);
+        if (it == map.end())
+            return;
+        list.erase(it->second);
+        map.erase(it);
+    }
+
+    size_type max_size() const { return nMaxSize; }
+    size_type max_size(size_type s)
+    {
+        while (list.size() > s) {
+            map.erase(list.back().first);
+            list.pop_back();
+        }
+        nMaxSize = s;
+        return nMaxSize;
+    }
+};
+
+#endif // BITCOIN_LRUCACHE_H
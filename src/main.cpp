@@ -11,13 +11,20 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockencodings.h"
+#include "blockhashcache.h"
+#include "blockprecheck.h"
+#include "blockstore.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "crypto/common.h"
 #include "init.h"
 #include "kernel.h"
+#include "lrucache.h"
 #include "servicenode-budget.h"
 #include "servicenode-payments.h"
+#include "servicenode-sigcheck.h"
 #include "servicenodeman.h"
 #include "merkleblock.h"
 #include "net.h"
@@ -36,6 +43,7 @@
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
@@ -67,6 +75,8 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 unsigned int nCoinCacheSize = 5000;
@@ -156,6 +166,16 @@ uint32_t nBlockSequenceId = 1;
      */
 map<uint256, NodeId> mapBlockSource;
 
+/**
+ * Set by LoadExternalBlockFileFast while it connects blocks. Protected by cs_main.
+ * fBulkImport leaves flushing the chain state to the import, which flushes
+ * between batches of blocks. hashImportAssumeValid is the block being
+ * connected when it is an ancestor of the import checkpoint, whose scripts
+ * are then not checked.
+ */
+bool fBulkImport = false;
+uint256 hashImportAssumeValid;
+
 /** Blocks that are in flight, and that are in the queue to be downloaded. Protected by cs_main. */
 struct QueuedBlock {
     uint256 hash;
@@ -166,6 +186,20 @@ struct QueuedBlock {
 };
 map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+/**
+ * Blocks downloaded during headers-first sync before their parent, by hash,
+ * with the peer they came from. Checking a proof-of-stake block needs its
+ * parent connected, so they wait here until it is. Protected by cs_main.
+ */
+struct CBlockAhead {
+    NodeId nodeid;
+    boost::shared_ptr<CBlock> pblock;
+    unsigned int nSize;
+};
+map<uint256, CBlockAhead> mapBlocksAhead;
+multimap<uint256, uint256> mapBlocksAheadByPrev;
+size_t nBlocksAheadSize = 0;
+
 /** Number of blocks in flight with validated headers. */
 int nQueuedValidatedHeaders = 0;
 
@@ -285,12 +319,24 @@ struct CNodeState {
     CBlockIndex* pindexLastCommonBlock;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
+    //! When we last asked this peer whether it has our best header (in microseconds).
+    int64_t nHeadersProbeTime;
+    //! The best header we last asked this peer about.
+    CBlockIndex* pindexHeadersProbed;
+    //! Headers messages from this peer in a row that did not connect to our index.
+    int nUnconnectingHeaders;
+    //! Headers messages from this peer that added a chain with no more work than our tip.
+    int nLowWorkHeaders;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
     list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Blocks asked from this peer with getdata after it announced them, until they arrive.
+    set<uint256> setBlocksRequested;
+    //! The compact block from this peer waiting for the transactions we asked for.
+    boost::shared_ptr<CPartiallyDownloadedBlock> partialBlock;
 
     CNodeState()
         : fCurrentlyConnected(false)
@@ -299,6 +345,10 @@ struct CNodeState {
         , pindexBestKnownBlock(nullptr)
         , pindexLastCommonBlock(nullptr)
         , fSyncStarted(false)
+        , nHeadersProbeTime(0)
+        , pindexHeadersProbed(nullptr)
+        , nUnconnectingHeaders(0)
+        , nLowWorkHeaders(0)
         , nStallingSince(0)
         , nBlocksInFlight(0)
         , fPreferredDownload(false)
@@ -515,9 +565,12 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             if (pindex->nStatus & BLOCK_HAVE_DATA) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
+            } else if (mapBlocksAhead.count(pindex->GetBlockHash())) {
+                // Downloaded, waiting for its parent.
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
-                if (pindex->nHeight > nWindowEnd) {
+                // Blocks waiting for one in flight count against the window too.
+                if (pindex->nHeight > nWindowEnd || (waitingfor != -1 && nBlocksAheadSize >= MAX_BLOCKS_AHEAD_SIZE)) {
                     // We reached the end of the window.
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
@@ -968,6 +1021,13 @@ bool GetCoinAge(const CTransaction& tx, const unsigned int nTxTime, uint64_t& nC
 }
 
 bool CheckTransaction(const CTransaction& tx, CValidationState& state)
+{
+    if (!CheckTransactionContextFree(tx, state))
+        return false;
+    return !IsSporkActiveAtHeight(SPORK_17_EXPL_FIX, chainActive.Height()) || CheckTransactionStakeInputs(tx, state);
+}
+
+bool CheckTransactionContextFree(const CTransaction& tx, CValidationState& state)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -981,9 +1041,6 @@ bool CheckTransaction(const CTransaction& tx, CValidationState& state)
         return state.DoS(100, error("CheckTransaction() : size limits failed"),
             REJECT_INVALID, "bad-txns-oversize");
 
-    // Store all recipients
-    std::vector<RedeemData> recipients;
-
     // Check for negative or overflow output values
     CAmount nValueOut = 0;
     BOOST_FOREACH (const CTxOut& txout, tx.vout) {
@@ -1000,47 +1057,17 @@ bool CheckTransaction(const CTransaction& tx, CValidationState& state)
         if (!MoneyRange(nValueOut))
             return state.DoS(100, error("CheckTransaction() : txout total out of range"),
                 REJECT_INVALID, "bad-txns-txouttotal-toolarge");
-
-        // Track all valid recipients
-        if (!txout.IsEmpty())
-            recipients.emplace_back(tx.GetHash().ToString(), txout.scriptPubKey, txout.nValue);
     }
 
-    // Bad stake inputs
-    std::vector<RedeemData> exploited;
-
     // Check for duplicate inputs
     set<COutPoint> vInOutPoints;
     BOOST_FOREACH (const CTxIn& txin, tx.vin) {
         if (vInOutPoints.count(txin.prevout))
             return state.DoS(100, error("CheckTransaction() : duplicate inputs"),
                 REJECT_INVALID, "bad-txns-inputs-duplicate");
-
-        // Check for bad stake inputs
-        if (IsSporkActive(SPORK_17_EXPL_FIX) && chainActive.Height() >= GetSporkValue(SPORK_17_EXPL_FIX)) {
-            if (!coinValidator.IsCoinValid(txin.prevout.hash)) {
-                CTransaction prevtx; uint256 prevblock;
-                // If bad transaction or bad prev tx then reject tx
-                if (!GetTransaction(txin.prevout.hash, prevtx, prevblock, true) || prevtx.IsNull()) {
-                    return state.DoS(100, error("CheckTransaction() : bad inputs"),
-                                     REJECT_INVALID, "bad-txns-inputs-stake");
-                }
-                // Track exploited coin
-                exploited.emplace_back(prevtx.GetHash().ToString(), prevtx.vout[txin.prevout.n].scriptPubKey, prevtx.vout[txin.prevout.n].nValue);
-            }
-        }
-
         vInOutPoints.insert(txin.prevout);
     }
 
-    // Check bad stakes
-    if (!exploited.empty()) {
-        if (!coinValidator.RedeemAddressVerified(exploited, recipients)) {
-            return state.DoS(100, error("CheckTransaction() : bad inputs"),
-                             REJECT_INVALID, "bad-txns-inputs-stake");
-        }
-    }
-
     if (tx.IsCoinBase()) {
         if (/*tx.vin[0].scriptSig.size() < 2 || */ tx.vin[0].scriptSig.size() > 150)
             return state.DoS(100, error("CheckTransaction() : coinbase script size=%d", tx.vin[0].scriptSig.size()),
@@ -1055,6 +1082,39 @@ bool CheckTransaction(const CTransaction& tx, CValidationState& state)
     return true;
 }
 
+bool CheckTransactionStakeInputs(const CTransaction& tx, CValidationState& state)
+{
+    // Bad stake inputs
+    std::vector<RedeemData> exploited;
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (!coinValidator.IsCoinValid(txin.prevout.hash)) {
+            CTransaction prevtx; uint256 prevblock;
+            // If bad transaction or bad prev tx then reject tx
+            if (!GetTransaction(txin.prevout.hash, prevtx, prevblock, true) || prevtx.IsNull()) {
+                return state.DoS(100, error("CheckTransaction() : bad inputs"),
+                                 REJECT_INVALID, "bad-txns-inputs-stake");
+            }
+            // Track exploited coin
+            exploited.emplace_back(prevtx.GetHash().ToString(), prevtx.vout[txin.prevout.n].scriptPubKey, prevtx.vout[txin.prevout.n].nValue);
+        }
+    }
+
+    // Check bad stakes against all valid recipients
+    if (!exploited.empty()) {
+        std::vector<RedeemData> recipients;
+        BOOST_FOREACH (const CTxOut& txout, tx.vout) {
+            if (!txout.IsEmpty())
+                recipients.emplace_back(tx.GetHash().ToString(), txout.scriptPubKey, txout.nValue);
+        }
+        if (!coinValidator.RedeemAddressVerified(exploited, recipients)) {
+            return state.DoS(100, error("CheckTransaction() : bad inputs"),
+                             REJECT_INVALID, "bad-txns-inputs-stake");
+        }
+    }
+
+    return true;
+}
+
 bool CheckFinalTx(const CTransaction& tx, int flags)
 {
     AssertLockHeld(cs_main);
@@ -1113,8 +1173,37 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
     return nMinFee;
 }
 
+namespace
+{
+/**
+ * Transactions accepted to the memory pool, with the script verification
+ * flags all their scripts passed under, so that CheckInputs needn't run them
+ * again when they are mined. Every flag only adds restrictions, so scripts
+ * that passed under some flags pass under any subset of them too. The txid
+ * commits to the outputs spent, hence to the scripts run. Protected by cs_main.
+ */
+lrucache<uint256, unsigned int> txScriptCache(DEFAULT_TX_SCRIPT_CACHE);
+
+bool HaveValidScripts(const uint256& hash, unsigned int flags)
+{
+    AssertLockHeld(cs_main);
+    unsigned int nValidFlags;
+    return txScriptCache.get(hash, nValidFlags) && (nValidFlags & flags) == flags;
+}
+} // anon namespace
+
+void SetTxScriptCacheSize(unsigned int nSize)
+{
+    LOCK(cs_main);
+    txScriptCache.max_size(nSize);
+}
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), chainActive.Height(), fRejectInsaneFee, ignoreFees);
+}
+
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, unsigned int nAcceptHeight, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1238,7 +1327,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, nAcceptHeight);
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1304,6 +1393,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
+        txScriptCache.insert(hash, STANDARD_SCRIPT_VERIFY_FLAGS);
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
@@ -1505,50 +1595,164 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     return true;
 }
 
+namespace
+{
+/** A confirmed transaction and the main chain block that contains it */
+struct CTxLookupEntry {
+    CTransaction tx;
+    uint256 hashBlock;
+    int nHeight;
+};
+
+CCriticalSection cs_txLookupCache;
+lrucache<uint256, CTxLookupEntry> txLookupCache(DEFAULT_TX_LOOKUP_CACHE);
+
+/** Whether hashBlock is the main chain block at nHeight. Requires cs_main. */
+bool IsInMainChain(const uint256& hashBlock, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    CBlockIndex* pindex = chainActive[nHeight];
+    return pindex && pindex->GetBlockHash() == hashBlock;
+}
+
+void CacheTxLookup(const CTransaction& tx, const uint256& hashBlock, int nHeight)
+{
+    CTxLookupEntry entry;
+    entry.tx = tx;
+    entry.hashBlock = hashBlock;
+    entry.nHeight = nHeight;
+    LOCK(cs_txLookupCache);
+    txLookupCache.insert(tx.GetHash(), entry);
+}
+} // anon namespace
+
+void SetTxLookupCacheSize(unsigned int nSize)
+{
+    LOCK(cs_txLookupCache);
+    txLookupCache.max_size(nSize);
+}
+
+bool GetAddressIndexKey(const CScript& script, uint160& hashBytes, int& type)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(script, dest))
+        return false;
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        type = ADDRESS_TYPE_PUBKEYHASH;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        type = ADDRESS_TYPE_SCRIPTHASH;
+        return true;
+    }
+    return false;
+}
+
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+        return error("%s : unable to get txids for address", __func__);
+    return true;
+}
+
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("%s : unable to get txids for address", __func__);
+    return true;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
-    CBlockIndex* pindexSlow = NULL;
+    if (mempool.lookup(hash, txOut))
+        return true;
+
+    // Recently looked up, as long as its block is still in the main chain
     {
-        LOCK(cs_main);
+        CTxLookupEntry entry;
+        bool fCached;
         {
-            if (mempool.lookup(hash, txOut)) {
+            LOCK(cs_txLookupCache);
+            fCached = txLookupCache.get(hash, entry);
+        }
+        if (fCached) {
+            LOCK(cs_main);
+            if (IsInMainChain(entry.hashBlock, entry.nHeight)) {
+                txOut = entry.tx;
+                hashBlock = entry.hashBlock;
                 return true;
             }
         }
+    }
+
+    // Locate the transaction under cs_main, read it from disk without holding it
+    CDiskTxPos postx;
+    CBlockIndex* pindexSlow = NULL;
+    {
+        LOCK(cs_main);
+        if (!fTxIndex || !pblocktree->ReadTxIndex(hash, postx)) {
+            postx.SetNull();
+            if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+                int nHeight = -1;
+                {
+                    CCoinsViewCache& view = *pcoinsTip;
+                    const CCoins* coins = view.AccessCoins(hash);
+                    if (coins)
+                        nHeight = coins->nHeight;
+                }
+                if (nHeight > 0)
+                    pindexSlow = chainActive[nHeight];
+            }
+        }
+    }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
+    if (!postx.IsNull()) {
+        CBlockHeader header;
+        try {
+            if (!ReadFromBlockStore(postx, 0, header) ||
+                !ReadFromBlockStore(postx, ::GetSerializeSize(header, SER_DISK, CLIENT_VERSION) + postx.nTxOffset, txOut)) {
                 CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
                 if (file.IsNull())
                     return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut.GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
+                file >> header;
+                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                file >> txOut;
             }
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
+        if (txOut.GetHash() != hash)
+            return error("%s : txid mismatch", __func__);
 
-        if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
-            int nHeight = -1;
-            {
-                CCoinsViewCache& view = *pcoinsTip;
-                const CCoins* coins = view.AccessCoins(hash);
-                if (coins)
-                    nHeight = coins->nHeight;
-            }
-            if (nHeight > 0)
-                pindexSlow = chainActive[nHeight];
+        // Index entries from older versions don't know their block
+        if (postx.hashBlock == 0) {
+            hashBlock = header.GetHash();
+            return true;
         }
+
+        hashBlock = postx.hashBlock;
+        bool fInMainChain;
+        {
+            LOCK(cs_main);
+            fInMainChain = IsInMainChain(postx.hashBlock, postx.nHeight);
+        }
+        if (fInMainChain)
+            CacheTxLookup(txOut, postx.hashBlock, postx.nHeight);
+        return true;
     }
 
     if (pindexSlow) {
@@ -1558,6 +1762,7 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
                 if (tx.GetHash() == hash) {
                     txOut = tx;
                     hashBlock = pindexSlow->GetBlockHash();
+                    CacheTxLookup(tx, hashBlock, pindexSlow->nHeight);
                     return true;
                 }
             }
@@ -1598,14 +1803,14 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read block, from memory if possible
     try {
-        filein >> block;
+        if (!ReadFromBlockStore(pos, 0, block)) {
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk : OpenBlockFile failed");
+            filein >> block;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -1939,7 +2144,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // Skip ECDSA signature verification when connecting blocks
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
-        if (fScriptChecks) {
+        // Scripts that passed when the transaction entered the memory pool aren't run again.
+        if (fScriptChecks && !HaveValidScripts(tx.GetHash(), flags)) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
@@ -1979,7 +2185,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& /*state*/, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -1998,11 +2204,26 @@ bool DisconnectBlock(CBlock& block, CValidationState& /*state*/, CBlockIndex* pi
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
         uint256 hash = tx.GetHash();
 
+        if (fAddressIndex) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                uint160 hashBytes;
+                int addressType;
+                if (!GetAddressIndexKey(tx.vout[k].scriptPubKey, hashBytes, addressType))
+                    continue;
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), tx.vout[k].nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, hash, k), CAddressUnspentValue()));
+            }
+        }
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly. Note that transactions with only provably unspendable outputs won't
         // have outputs available even in the block itself, so we handle that case
@@ -2051,10 +2272,27 @@ bool DisconnectBlock(CBlock& block, CValidationState& /*state*/, CBlockIndex* pi
                 if (coins->vout.size() < out.n + 1)
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
+
+                if (fAddressIndex || fSpentIndex) {
+                    uint160 hashBytes;
+                    int addressType;
+                    bool fAddress = GetAddressIndexKey(undo.txout.scriptPubKey, hashBytes, addressType);
+                    if (fAddressIndex && fAddress) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), undo.txout.nValue * -1));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, out.hash, out.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins->nHeight)));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
+                }
             }
         }
     }
 
+    // the indexes follow the chain, not the trial disconnects done by VerifyDB
+    if (!pfClean && (fAddressIndex || fSpentIndex))
+        if (!pblocktree->UpdateBlockIndexes(std::vector<std::pair<uint256, CDiskTxPos> >(), addressIndex, true, addressUnspentIndex, spentIndex))
+            return state.Abort("Failed to write address and spent indexes");
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2070,12 +2308,17 @@ void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
+    // Blocks still queued must reach the file before it is committed
+    blockWriteQueue.Flush();
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
     FILE* fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+            blockFileCache.Invalidate(nLastBlockFile);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2099,6 +2342,49 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CBlockCheck> blockcheckqueue(16);
+//! held by the thread whose checks blockcheckqueue runs
+static boost::mutex csBlockCheckQueue;
+
+void ThreadBlockCheck()
+{
+    RenameThread("blocknetdx-blockch");
+    blockcheckqueue.Thread();
+}
+
+CBlockCheckControl::CBlockCheckControl() : lock(csBlockCheckQueue, boost::defer_lock), fOk(true), fPending(false)
+{
+    if (nScriptCheckThreads)
+        lock.try_lock();
+}
+
+CBlockCheckControl::~CBlockCheckControl()
+{
+    Wait();
+}
+
+void CBlockCheckControl::Add(std::vector<CBlockCheck>& vChecks)
+{
+    if (lock.owns_lock()) {
+        blockcheckqueue.Add(vChecks);
+        fPending = true;
+        return;
+    }
+    BOOST_FOREACH (CBlockCheck& check, vChecks) {
+        if (fOk)
+            fOk = check();
+    }
+}
+
+bool CBlockCheckControl::Wait()
+{
+    if (fPending) {
+        fOk = blockcheckqueue.Wait() && fOk;
+        fPending = false;
+    }
+    return fOk;
+}
+
 //static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex) {
 //    AssertLockHeld(cs_main);
 
@@ -2166,7 +2452,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, error("ConnectBlock() : PoW period ended"),
             REJECT_INVALID, "PoW-ended");
 
-    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate() && pindex->GetBlockHash() != hashImportAssumeValid;
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
@@ -2217,9 +2503,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int nInputs = 0;
     unsigned int nSigOps = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    pos.hashBlock = pindex->GetBlockHash();
+    pos.nHeight = pindex->nHeight;
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     int64_t nValueOut = 0;
     int64_t nValueIn = 0;
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
@@ -2253,9 +2544,42 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
             control.Add(vChecks);
+
+            // the spent outputs leave the view in UpdateCoins below
+            if ((fAddressIndex || fSpentIndex) && !fJustCheck) {
+                const uint256 hash = tx.GetHash();
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const COutPoint& prevout = tx.vin[j].prevout;
+                    const CTxOut& out = view.GetOutputFor(tx.vin[j]);
+                    uint160 hashBytes;
+                    int addressType;
+                    if (!GetAddressIndexKey(out.scriptPubKey, hashBytes, addressType)) {
+                        hashBytes = 0;
+                        addressType = ADDRESS_TYPE_NONE;
+                    }
+                    if (fAddressIndex && addressType != ADDRESS_TYPE_NONE) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, j, true), out.nValue * -1));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(hash, j, pindex->nHeight, out.nValue, addressType, hashBytes)));
+                }
+            }
         }
         nValueOut += tx.GetValueOut();
 
+        if (fAddressIndex && !fJustCheck) {
+            const uint256 hash = tx.GetHash();
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                uint160 hashBytes;
+                int addressType;
+                if (!GetAddressIndexKey(tx.vout[k].scriptPubKey, hashBytes, addressType))
+                    continue;
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, hash, k, false), tx.vout[k].nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, hash, k), CAddressUnspentValue(tx.vout[k].nValue, tx.vout[k].scriptPubKey, pindex->nHeight)));
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -2271,8 +2595,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     pindex->nMoneySupply = nMoneySupplyPrev + nValueOut - nValueIn;
     pindex->nMint = pindex->nMoneySupply - nMoneySupplyPrev;
 
-    if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)))
-        return error("Connect() : WriteBlockIndex for pindex failed");
+    // The index entry points at the block data, which may still be queued for
+    // writing. It is written by the next flush, after the queued blocks.
+    if (!fJustCheck)
+        setDirtyBlockIndex.insert(pindex);
 
     int64_t nTime1 = GetTimeMicros();
     nTimeConnect += nTime1 - nTimeStart;
@@ -2300,6 +2626,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    // the transactions are confirmed, their scripts won't be checked again
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        txScriptCache.erase(tx.GetHash());
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
@@ -2318,9 +2648,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return state.Abort("Failed to write transaction index");
+    // one batch, so that the indexes of a block are all written or none
+    if (fTxIndex || fAddressIndex || fSpentIndex)
+        if (!pblocktree->UpdateBlockIndexes(fTxIndex ? vPos : std::vector<std::pair<uint256, CDiskTxPos> >(), addressIndex, false, addressUnspentIndex, spentIndex))
+            return state.Abort("Failed to write transaction, address and spent indexes");
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2356,6 +2687,8 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
+    if (fBulkImport && mode != FLUSH_STATE_ALWAYS)
+        return true;
     try {
         if ((mode == FLUSH_STATE_ALWAYS) ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
@@ -2413,6 +2746,7 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    blockHashCache.SetTip(pindexNew);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -2924,6 +3258,54 @@ bool ReconsiderBlock(CValidationState& /*state*/, CBlockIndex* pindex)
     return true;
 }
 
+/**
+ * Set the proof-of-stake fields of a block index entry, which depend on the
+ * block's transactions and on the same fields of its ancestors. Blocks synced
+ * headers-first get them when the block itself is accepted, in chain order.
+ */
+void static SetBlockIndexStakeData(CBlockIndex* pindexNew, const CBlock& block)
+{
+    uint256 hash = pindexNew->GetBlockHash();
+
+    if (block.IsProofOfStake()) {
+        pindexNew->SetProofOfStake();
+        pindexNew->prevoutStake = block.vtx[1].vin[0].prevout;
+        pindexNew->nStakeTime = block.nTime;
+
+        //mark as PoS seen
+        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    }
+
+    if (pindexNew->pprev == NULL)
+        return;
+
+    // ppcoin: compute chain trust score
+    pindexNew->bnChainTrust = pindexNew->pprev->bnChainTrust + pindexNew->GetBlockTrust();
+
+    // ppcoin: compute stake entropy bit for stake modifier
+    pindexNew->nFlags &= ~CBlockIndex::BLOCK_STAKE_ENTROPY;
+    if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
+        LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
+
+    // ppcoin: record proof-of-stake hash value
+    if (pindexNew->IsProofOfStake()) {
+        if (!mapProofOfStake.count(hash))
+            LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
+        pindexNew->hashProofOfStake = mapProofOfStake[hash];
+    }
+
+    // ppcoin: compute stake modifier
+    uint64_t nStakeModifier = 0;
+    bool fGeneratedStakeModifier = false;
+    if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
+        LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
+    pindexNew->nFlags &= ~CBlockIndex::BLOCK_STAKE_MODIFIER;
+    pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+    pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
+    if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
+        LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, boost::lexical_cast<std::string>(nStakeModifier));
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -2941,10 +3323,6 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
 
-    //mark as PoS seen
-    if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
     pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end()) {
@@ -2954,31 +3332,12 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
-
-        // ppcoin: compute chain trust score
-        pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
-
-        // ppcoin: compute stake entropy bit for stake modifier
-        if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
-            LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
-
-        // ppcoin: record proof-of-stake hash value
-        if (pindexNew->IsProofOfStake()) {
-            if (!mapProofOfStake.count(hash))
-                LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
-        }
-
-        // ppcoin: compute stake modifier
-        uint64_t nStakeModifier = 0;
-        bool fGeneratedStakeModifier = false;
-        if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
-            LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
-        pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
-        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
-        if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
-            LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, boost::lexical_cast<std::string>(nStakeModifier));
     }
+
+    // A header alone doesn't tell whether the block is proof-of-stake, its
+    // stake fields are set once the block arrives
+    if (!block.vtx.empty())
+        SetBlockIndexStakeData(pindexNew, block);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
@@ -3128,7 +3487,7 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/, bool fCheckMerkleRoot, bool /*fCheckSig*/)
+bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/, bool fCheckMerkleRoot, bool fCheckSig)
 {
     // These are checks that are independent of context.
 
@@ -3192,6 +3551,15 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/
                 return state.DoS(100, error("CheckBlock() : more than one coinstake"));
     }
 
+    CBlockCheckControl control;
+    std::vector<CBlockCheck> vChecks;
+    vChecks.reserve(block.vtx.size() + 1);
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        vChecks.push_back(CBlockCheck(boost::bind(&CheckTransactionContextFree, boost::cref(tx), CValidationState())));
+    if (fCheckSig)
+        vChecks.push_back(CBlockCheck(boost::bind(&CBlock::CheckBlockSignature, &block)));
+    control.Add(vChecks);
+
     // ----------- swiftTX transaction scanning -----------
 
     if (IsSporkActive(SPORK_3_SWIFTTX_BLOCK_FILTERING)) {
@@ -3241,10 +3609,22 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/
 
     // -------------------------------------------
 
-    // Check transactions
+    // Check transactions. Stake inputs need the chain state and are checked
+    // here, while the block check threads do the rest of each transaction
+    // and the block signature. On failure everything is checked again in
+    // order, to report the same error as checking one by one. Spork 17 is
+    // evaluated once for the block.
+    bool fCheckStakeInputs = IsSporkActiveAtHeight(SPORK_17_EXPL_FIX, chainActive.Height());
     BOOST_FOREACH (const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state))
+        if (fCheckStakeInputs && !CheckTransactionStakeInputs(tx, state))
             return error("CheckBlock() : CheckTransaction failed");
+    if (!control.Wait()) {
+        BOOST_FOREACH (const CTransaction& tx, block.vtx)
+            if (!CheckTransactionContextFree(tx, state))
+                return error("CheckBlock() : CheckTransaction failed");
+        return state.DoS(100, error("CheckBlock() : bad proof-of-stake block signature"),
+            REJECT_INVALID, "bad-blk-sig", true);
+    }
 
     unsigned int nSigOps = 0;
     BOOST_FOREACH (const CTransaction& tx, block.vtx) {
@@ -3257,7 +3637,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool /*fCheckPOW*/
     return true;
 }
 
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
+bool CheckWork(const CBlock& block, CBlockIndex* const pindexPrev)
 {
     if (pindexPrev == NULL)
         return error("%s : null pindexPrev for block %s", __func__, block.GetHash().ToString().c_str());
@@ -3314,6 +3694,20 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
             REJECT_INVALID, "time-too-old");
     }
 
+    // Check the difficulty, a header synced headers-first is added to the
+    // index before CheckWork sees its block
+    unsigned int nBitsRequired = GetNextWorkRequired(pindexPrev, &block);
+    if (nHeight <= Params().LAST_POW_BLOCK() && nHeight <= 68589) {
+        double n1 = ConvertBitsToDouble(block.nBits);
+        double n2 = ConvertBitsToDouble(nBitsRequired);
+        if (abs(n1 - n2) > n1 * 0.5)
+            return state.DoS(100, error("%s : incorrect proof of work (DGW pre-fork) at %d", __func__, nHeight),
+                REJECT_INVALID, "bad-diffbits");
+    } else if (block.nBits != nBitsRequired) {
+        return state.DoS(100, error("%s : incorrect difficulty at %d", __func__, nHeight),
+            REJECT_INVALID, "bad-diffbits");
+    }
+
     // Check that the block chain matches the known block chain up to a checkpoint
     if (!Checkpoints::CheckBlock(nHeight, hash))
         return state.DoS(100, error("%s : rejected by checkpoint lock-in at %d", __func__, nHeight),
@@ -3364,6 +3758,34 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
+/**
+ * Check a header that isn't in the index yet against its parent, which has to
+ * be, without adding it. The parent is returned in ppindexPrev.
+ */
+bool static CheckBlockHeaderConnects(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindexPrev)
+{
+    // Get prev block index
+    CBlockIndex* pindexPrev = NULL;
+    if (block.GetHash() != Params().HashGenesisBlock()) {
+        BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+        if (mi == mapBlockIndex.end())
+            return state.DoS(0, error("%s : prev block %s not found", __func__, block.hashPrevBlock.ToString().c_str()), 0, "bad-prevblk");
+        pindexPrev = (*mi).second;
+        if (pindexPrev->nStatus & BLOCK_FAILED_MASK)
+            return state.DoS(100, error("%s : prev block invalid", __func__), REJECT_INVALID, "bad-prevblk");
+    }
+    if (ppindexPrev)
+        *ppindexPrev = pindexPrev;
+
+    // Headers of the proof-of-work blocks carry their proof
+    if (!CheckBlockHeader(block, state, pindexPrev != NULL && pindexPrev->nHeight + 1 <= Params().LAST_POW_BLOCK())) {
+        LogPrintf("AcceptBlockHeader(): CheckBlockHeader failed \n");
+        return false;
+    }
+
+    return ContextualCheckBlockHeader(block, state, pindexPrev);
+}
+
 bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
@@ -3383,23 +3805,7 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
         return true;
     }
 
-    if (!CheckBlockHeader(block, state, false)) {
-        LogPrintf("AcceptBlockHeader(): CheckBlockHeader failed \n");
-        return false;
-    }
-
-    // Get prev block index
-    CBlockIndex* pindexPrev = NULL;
-    if (hash != Params().HashGenesisBlock()) {
-        BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
-        if (mi == mapBlockIndex.end())
-            return state.DoS(0, error("%s : prev block %s not found", __func__, block.hashPrevBlock.ToString().c_str()), 0, "bad-prevblk");
-        pindexPrev = (*mi).second;
-        if (pindexPrev->nStatus & BLOCK_FAILED_MASK)
-            return state.DoS(100, error("%s : prev block invalid", __func__), REJECT_INVALID, "bad-prevblk");
-    }
-
-    if (!ContextualCheckBlockHeader(block, state, pindexPrev))
+    if (!CheckBlockHeaderConnects(block, state, NULL))
         return false;
 
     if (pindex == NULL)
@@ -3431,6 +3837,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
     if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev))
         return false;
 
+    bool fKnownHeader = mapBlockIndex.count(block.GetHash()) > 0;
     if (!AcceptBlockHeader(block, state, &pindex))
         return false;
 
@@ -3448,6 +3855,12 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         return false;
     }
 
+    // The entry may have been added from the header alone
+    if (fKnownHeader) {
+        SetBlockIndexStakeData(pindex, block);
+        setDirtyBlockIndex.insert(pindex);
+    }
+
     int nHeight = pindex->nHeight;
 
     // Write block to history file
@@ -3459,7 +3872,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         if (!FindBlockPos(state, blockPos, nBlockSize + 8, nHeight, block.GetBlockTime(), dbp != NULL))
             return error("AcceptBlock() : FindBlockPos failed");
         if (dbp == NULL)
-            if (!WriteBlockToDisk(block, blockPos))
+            if (!blockWriteQueue.Push(block, blockPos))
                 return state.Abort("Failed to write block");
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock() : ReceivedBlockTransactions failed");
@@ -3533,13 +3946,14 @@ void CBlockIndex::BuildSkip()
 
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
 {
-    if (IsSporkActive(SPORK_17_EXPL_FIX) && chainActive.Height() >= GetSporkValue(SPORK_17_EXPL_FIX))
+    if (IsSporkActiveAtHeight(SPORK_17_EXPL_FIX, chainActive.Height()))
         coinValidator.Load(static_cast<int>(GetSporkValue(SPORK_17_EXPL_FIX)));
     else if (coinValidator.IsLoaded())
         coinValidator.Clear();
 
-    // Preliminary checks
-    bool checked = CheckBlock(*pblock, state);
+    // Preliminary checks, with the proof-of-stake block signature (NovaCoin)
+    // unless that was verified ahead
+    bool checked = CheckBlock(*pblock, state, true, true, !blockPrecheckQueue.HaveValidSignature(*pblock));
 
     // ppcoin: check proof-of-stake
     // Limited duplicity on stake: prevents block flood attack
@@ -3547,10 +3961,6 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     //if (pblock->IsProofOfStake() && setStakeSeen.count(pblock->GetProofOfStake())/* && !mapOrphanBlocksByPrev.count(hash)*/)
     //    return error("ProcessNewBlock() : duplicate proof-of-stake (%s, %d) for block %s", pblock->GetProofOfStake().first.ToString().c_str(), pblock->GetProofOfStake().second, pblock->GetHash().ToString().c_str());
 
-    // NovaCoin: check proof-of-stake block signature
-    if (!pblock->CheckBlockSignature())
-        return error("ProcessNewBlock() : bad proof-of-stake block signature");
-
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
@@ -3720,14 +4130,22 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+static void GetBlockProofs(const vector<pair<int, CBlockIndex*> >* pvIndex, vector<uint256>* pvProof, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++)
+        (*pvProof)[i] = GetBlockProof(*(*pvIndex)[i].second);
+}
+
 bool static LoadBlockIndexDB()
 {
-    if (!pblocktree->LoadBlockIndexGuts())
+    int64_t nStart = GetTimeMillis();
+    if (!pblocktree->LoadBlockIndexGuts(GetBoolArg("-checkblockhashes", DEFAULT_CHECKBLOCKHASHES)))
         return false;
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
+    // Calculate nChainWork. The proof of each block does not depend on its
+    // ancestors, so it is computed up front on all cores.
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     BOOST_FOREACH (const PAIRTYPE(uint256, CBlockIndex*) & item, mapBlockIndex) {
@@ -3735,10 +4153,14 @@ bool static LoadBlockIndexDB()
         vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH (const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight) {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+    vector<uint256> vBlockProof(vSortedByHeight.size());
+    ParallelForRange(vSortedByHeight.size(), boost::bind(&GetBlockProofs, &vSortedByHeight, &vBlockProof, _1, _2));
+    set<int> setBlkDataFiles;
+    for (size_t i = 0; i < vSortedByHeight.size(); i++) {
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + vBlockProof[i];
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            setBlkDataFiles.insert(pindex->nFile);
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3779,13 +4201,6 @@ bool static LoadBlockIndexDB()
 
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
-    set<int> setBlkDataFiles;
-    BOOST_FOREACH (const PAIRTYPE(uint256, CBlockIndex*) & item, mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
-            setBlkDataFiles.insert(pindex->nFile);
-        }
-    }
     for (std::set<int>::iterator it = setBlkDataFiles.begin(); it != setBlkDataFiles.end(); it++) {
         CDiskBlockPos pos(*it, 0);
         if (CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION).IsNull()) {
@@ -3835,6 +4250,7 @@ bool static LoadBlockIndexDB()
 
         //set the chain to the block before lastMeta so that the meta block will be seen as new
         chainActive.SetTip(pindexLastMeta->pprev);
+        blockHashCache.SetTip(pindexLastMeta->pprev);
 
         //Process the lastMetaBlock again, using the known location on disk
         CDiskBlockPos blockPos = pindexLastMeta->GetBlockPos();
@@ -3887,14 +4303,23 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address and spent indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
+    LogPrintf("LoadBlockIndexDB(): loaded %u block index entries in %dms\n", mapBlockIndex.size(), GetTimeMillis() - nStart);
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    blockHashCache.SetTip(it->second);
 
     PruneBlockIndexCandidates();
 
@@ -3998,6 +4423,7 @@ void UnloadBlockIndex()
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    blockHashCache.SetTip(NULL);
     pindexBestInvalid = NULL;
 }
 
@@ -4020,6 +4446,10 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4050,20 +4480,93 @@ bool InitBlockIndex()
 }
 
 
+// Connect a block read by LoadExternalBlockFile, and the earlier read blocks
+// waiting for it. Returns false when importing has to stop.
+static bool ProcessExternalBlock(CBlock& block, CDiskBlockPos* dbp, std::multimap<uint256, CDiskBlockPos>& mapBlocksUnknownParent, int& nLoaded)
+{
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+            block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        CValidationState state;
+        if (ProcessNewBlock(state, NULL, &block, dbp))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block, read
+    // into a block of their own as the precheck threads may still use this one
+    CBlock blockChild;
+    deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            if (ReadBlockFromDisk(blockChild, it->second)) {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
+                    head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, NULL, &blockChild, &it->second)) {
+                    nLoaded++;
+                    queue.push_back(blockChild.GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
+    // Blocks read ahead of the one being connected, checked meanwhile by the
+    // precheck threads, with their position in the file
+    std::deque<std::pair<boost::shared_ptr<CBlock>, CDiskBlockPos> > vReadAhead;
+
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        bool fEnd = false;
+        bool fStop = false;
+        while (!fStop) {
             boost::this_thread::interruption_point();
 
+            fEnd = fEnd || blkdat.eof();
+            if (fEnd && vReadAhead.empty())
+                break;
+            if (fEnd || vReadAhead.size() >= IMPORT_READ_AHEAD_BLOCKS) {
+                boost::shared_ptr<CBlock> pblock = vReadAhead.front().first;
+                CDiskBlockPos pos = vReadAhead.front().second;
+                vReadAhead.pop_front();
+                try {
+                    fStop = !ProcessExternalBlock(*pblock, dbp ? &pos : NULL, mapBlocksUnknownParent, nLoaded);
+                } catch (std::exception& e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+                }
+                continue;
+            }
+
             blkdat.SetPos(nRewind);
             nRewind++;         // start one byte further next time, in case of failure
             blkdat.SetLimit(); // remove former limit
@@ -4082,7 +4585,8 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
-                break;
+                fEnd = true;
+                continue;
             }
             try {
                 // read block
@@ -4091,60 +4595,212 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                     dbp->nPos = nBlockPos;
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
+                boost::shared_ptr<CBlock> pblock(new CBlock());
+                blkdat >> *pblock;
                 nRewind = blkdat.GetPos();
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
+                blockPrecheckQueue.Push(pblock);
+                vReadAhead.push_back(std::make_pair(pblock, dbp ? *dbp : CDiskBlockPos()));
+            } catch (std::exception& e) {
+                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+    } catch (std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
+
+// Block located in a file imported by LoadExternalBlockFileFast
+struct CImportBlock {
+    size_t nPos;
+    unsigned int nSize;
+    uint256 hash;
+    uint256 hashPrevBlock;
+};
+
+static void HashImportHeaders(const char* pdata, vector<CImportBlock>* pvBlocks, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CImportBlock& blk = (*pvBlocks)[i];
+        CBufferReader reader(pdata + blk.nPos, pdata + blk.nPos + blk.nSize, SER_DISK, CLIENT_VERSION);
+        CBlockHeader header;
+        reader >> header;
+        blk.hash = header.GetHash();
+        blk.hashPrevBlock = header.hashPrevBlock;
+    }
+}
+
+static void ReadImportBlocks(const char* pdata, const vector<CImportBlock>* pvBlocks, const size_t* pnOrder, vector<boost::shared_ptr<CBlock> >* pvBatch, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        const CImportBlock& blk = (*pvBlocks)[pnOrder[i]];
+        boost::shared_ptr<CBlock> pblock(new CBlock());
+        try {
+            CBufferReader reader(pdata + blk.nPos, pdata + blk.nPos + blk.nSize, SER_DISK, CLIENT_VERSION);
+            reader >> *pblock;
+            (*pvBatch)[i] = pblock;
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize error - %s\n", __func__, e.what());
+        }
+    }
+}
+
+// Leaves flushing the chain state to the fast import while it lives
+class CBulkImport
+{
+public:
+    CBulkImport()
+    {
+        LOCK(cs_main);
+        fBulkImport = true;
+    }
+    ~CBulkImport()
+    {
+        LOCK(cs_main);
+        fBulkImport = false;
+        hashImportAssumeValid.SetNull();
+    }
+};
+
+bool LoadExternalBlockFileFast(const boost::filesystem::path& path, const uint256& hashCheckpoint)
+{
+    boost::shared_ptr<CMappedBlockFile> map = CMappedBlockFile::Map(path);
+    if (!map) {
+        LogPrintf("%s : cannot map %s, importing it block by block\n", __func__, path.string());
+        FILE* file = fopen(path.string().c_str(), "rb");
+        return file && LoadExternalBlockFile(file);
+    }
+    const char* pdata = map->data();
+    size_t nFileSize = map->size();
+    int64_t nStart = GetTimeMillis();
+
+    // Locate the blocks, skipping over each one found
+    vector<CImportBlock> vBlocks;
+    const unsigned char* pchMessageStart = Params().MessageStart();
+    size_t nPos = 0;
+    while (nPos + MESSAGE_START_SIZE + 4 <= nFileSize) {
+        const char* p = (const char*)memchr(pdata + nPos, pchMessageStart[0], nFileSize - nPos);
+        if (!p)
+            break;
+        nPos = p - pdata;
+        if (nPos + MESSAGE_START_SIZE + 4 > nFileSize)
+            break;
+        unsigned int nSize = ReadLE32((const unsigned char*)p + MESSAGE_START_SIZE);
+        if (memcmp(p, pchMessageStart, MESSAGE_START_SIZE) || nSize < 80 || nSize > MAX_BLOCK_SIZE ||
+            nSize > nFileSize - nPos - MESSAGE_START_SIZE - 4) {
+            nPos++;
+            continue;
+        }
+        CImportBlock blk;
+        blk.nPos = nPos + MESSAGE_START_SIZE + 4;
+        blk.nSize = nSize;
+        vBlocks.push_back(blk);
+        nPos = blk.nPos + nSize;
+    }
+    ParallelForRange(vBlocks.size(), boost::bind(&HashImportHeaders, pdata, &vBlocks, _1, _2));
+
+    // Put the blocks in an order connecting each after its parent, keeping
+    // out of order blocks in memory until their parent comes up
+    vector<size_t> vOrder;
+    vector<bool> vOrdered(vBlocks.size(), false);
+    std::map<uint256, size_t> mapByHash;
+    std::multimap<uint256, size_t> mapUnknownParent;
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            const CImportBlock& blk = vBlocks[i];
+            if (!mapByHash.insert(std::make_pair(blk.hash, i)).second)
+                continue;
+            std::map<uint256, size_t>::iterator it = mapByHash.find(blk.hashPrevBlock);
+            if (blk.hash != Params().HashGenesisBlock() && mapBlockIndex.count(blk.hashPrevBlock) == 0 &&
+                (it == mapByHash.end() || !vOrdered[it->second])) {
+                mapUnknownParent.insert(std::make_pair(blk.hashPrevBlock, i));
+                continue;
+            }
+            deque<size_t> queue;
+            queue.push_back(i);
+            while (!queue.empty()) {
+                size_t j = queue.front();
+                queue.pop_front();
+                vOrder.push_back(j);
+                vOrdered[j] = true;
+                std::pair<std::multimap<uint256, size_t>::iterator, std::multimap<uint256, size_t>::iterator> range = mapUnknownParent.equal_range(vBlocks[j].hash);
+                for (std::multimap<uint256, size_t>::iterator itChild = range.first; itChild != range.second; itChild++)
+                    queue.push_back(itChild->second);
+                mapUnknownParent.erase(range.first, range.second);
+            }
+        }
+    }
+    LogPrintf("%s : %u blocks in %s, %u of them connectable\n", __func__, vBlocks.size(), path.string(), vOrder.size());
+
+    // The checkpoint and its ancestors are connected without their scripts checked
+    vector<bool> vAssumeValid(vBlocks.size(), false);
+    if (!hashCheckpoint.IsNull()) {
+        std::map<uint256, size_t>::iterator it = mapByHash.find(hashCheckpoint);
+        if (it != mapByHash.end() && vOrdered[it->second]) {
+            while (it != mapByHash.end() && vOrdered[it->second] && !vAssumeValid[it->second]) {
+                vAssumeValid[it->second] = true;
+                it = mapByHash.find(vBlocks[it->second].hashPrevBlock);
+            }
+        } else {
+            LogPrintf("%s : import checkpoint %s not found, checking all scripts\n", __func__, hashCheckpoint.ToString());
+        }
+    }
+
+    // Decode each batch on all cores, then connect it with the precheck
+    // threads checking ahead, and flush the chain state once the cache is full
+    int nLoaded = 0;
+    try {
+        CBulkImport bulk;
+        bool fStop = false;
+        for (size_t nBatch = 0; nBatch < vOrder.size() && !fStop; nBatch += FAST_IMPORT_BATCH_BLOCKS) {
+            size_t nBatchSize = std::min((size_t)FAST_IMPORT_BATCH_BLOCKS, vOrder.size() - nBatch);
+            vector<boost::shared_ptr<CBlock> > vBatch(nBatchSize);
+            ParallelForRange(nBatchSize, boost::bind(&ReadImportBlocks, pdata, &vBlocks, &vOrder[nBatch], &vBatch, _1, _2), 16);
+
+            size_t nQueued = 0;
+            for (size_t i = 0; i < nBatchSize && !fStop; i++) {
+                boost::this_thread::interruption_point();
+                for (; nQueued < nBatchSize && nQueued <= i + IMPORT_READ_AHEAD_BLOCKS; nQueued++) {
+                    if (vBatch[nQueued])
+                        blockPrecheckQueue.Push(vBatch[nQueued]);
                 }
+                if (!vBatch[i])
+                    continue;
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
+                const CImportBlock& blk = vBlocks[vOrder[nBatch + i]];
+                {
+                    LOCK(cs_main);
+                    BlockMap::iterator mi = mapBlockIndex.find(blk.hash);
+                    if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                        continue;
+                    hashImportAssumeValid = vAssumeValid[vOrder[nBatch + i]] ? blk.hash : uint256();
+                }
+                CValidationState state;
+                try {
+                    if (ProcessNewBlock(state, NULL, vBatch[i].get()))
                         nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                } catch (const std::exception& e) {
+                    LogPrintf("%s : Error connecting block %s - %s\n", __func__, blk.hash.ToString(), e.what());
                 }
+                fStop = state.IsError();
+            }
 
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+            LOCK(cs_main);
+            hashImportAssumeValid.SetNull();
+            if (!fStop && pcoinsTip->GetCacheSize() > nCoinCacheSize) {
+                CValidationState state;
+                fStop = !FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
             }
         }
-    } catch (std::runtime_error& e) {
+    } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
+    FlushStateToDisk();
+
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
@@ -4556,7 +5212,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end()) {
@@ -4580,7 +5236,14 @@ void static ProcessGetData(CNode* pfrom)
                         assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
                         pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    else if (inv.type == MSG_CMPCT_BLOCK) {
+                        // A peer asking for an older block is catching up and
+                        // won't have its transactions
+                        if (mi->second->nHeight + MAX_CMPCT_BLOCK_DEPTH >= chainActive.Height())
+                            pfrom->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block));
+                        else
+                            pfrom->PushMessage("block", block);
+                    } else // MSG_FILTERED_BLOCK)
                     {
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
@@ -4750,7 +5413,7 @@ void static ProcessGetData(CNode* pfrom)
             // Track requests for our stuff.
             g_signals.Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -4769,6 +5432,103 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+// Process the blocks that were downloaded ahead of the one just processed, then
+// those waiting for them in turn
+void static ProcessBlocksAhead(const uint256& hash)
+{
+    vector<uint256> vWorkQueue(1, hash);
+    for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
+        vector<CBlockAhead> vChildren;
+        {
+            LOCK(cs_main);
+            // Children of a block that failed are processed too, to be rejected
+            BlockMap::iterator mi = mapBlockIndex.find(vWorkQueue[i]);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)))
+                continue;
+            pair<multimap<uint256, uint256>::iterator, multimap<uint256, uint256>::iterator> range = mapBlocksAheadByPrev.equal_range(vWorkQueue[i]);
+            for (multimap<uint256, uint256>::iterator it = range.first; it != range.second; ++it) {
+                map<uint256, CBlockAhead>::iterator itAhead = mapBlocksAhead.find(it->second);
+                mapBlockSource[it->second] = itAhead->second.nodeid;
+                nBlocksAheadSize -= itAhead->second.nSize;
+                vChildren.push_back(itAhead->second);
+                mapBlocksAhead.erase(itAhead);
+            }
+            mapBlocksAheadByPrev.erase(range.first, range.second);
+        }
+
+        BOOST_FOREACH (const CBlockAhead& child, vChildren) {
+            CValidationState state;
+            ProcessNewBlock(state, NULL, child.pblock.get());
+            int nDoS;
+            if (state.IsInvalid(nDoS) && nDoS > 0) {
+                LOCK(cs_main);
+                Misbehaving(child.nodeid, nDoS);
+            }
+            vWorkQueue.push_back(child.pblock->GetHash());
+        }
+    }
+}
+
+// Process a block a peer sent, punishing it for invalid ones
+void static ProcessBlockFromPeer(CNode* pfrom, CBlock& block)
+{
+    uint256 hash = block.GetHash();
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+        if (mi != mapBlockIndex.end() && !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            // Downloaded ahead of its parent, keep it if we asked this peer for it
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId()) {
+                LogPrint("net", "unrequested block %s ahead of its parent from peer=%d, ignoring\n", hash.ToString(), pfrom->id);
+                return;
+            }
+            MarkBlockAsReceived(hash);
+            CBlockAhead& blockAhead = mapBlocksAhead[hash];
+            blockAhead.nodeid = pfrom->GetId();
+            blockAhead.pblock.reset(new CBlock(block));
+            blockAhead.nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+            mapBlocksAheadByPrev.insert(make_pair(block.hashPrevBlock, hash));
+            nBlocksAheadSize += blockAhead.nSize;
+            LogPrint("net", "block %s from peer=%d waits for its parent %s\n", hash.ToString(), pfrom->id, block.hashPrevBlock.ToString());
+            return;
+        }
+    }
+
+    CValidationState state;
+    ProcessNewBlock(state, pfrom, &block);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", (string) "block", state.GetRejectCode(),
+            state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), hash);
+        if (nDoS > 0) {
+            TRY_LOCK(cs_main, lockMain);
+            if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+    ProcessBlocksAhead(hash);
+}
+
+// Rebuild a compact block with the transactions that were missing from the
+// memory pool, or fall back to downloading it whole when short ids collided
+void static ProcessCompactBlock(CNode* pfrom, const CPartiallyDownloadedBlock& partialBlock, const std::vector<CTransaction>& vtxMissing)
+{
+    CBlock block;
+    ReadStatus status = partialBlock.FillBlock(block, vtxMissing);
+    if (status == READ_STATUS_INVALID) {
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 100);
+        LogPrintf("peer %d sent us invalid transactions for compact block %s\n", pfrom->id, partialBlock.header.GetHash().ToString());
+        return;
+    }
+    if (status == READ_STATUS_FAILED) {
+        LogPrint("net", "compact block %s from peer=%d didn't match its merkle root, downloading it whole\n", partialBlock.header.GetHash().ToString(), pfrom->id);
+        pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, partialBlock.header.GetHash())));
+        return;
+    }
+    ProcessBlockFromPeer(pfrom, block);
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -4979,6 +5739,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         LOCK(cs_main);
 
         std::vector<CInv> vToFetch;
+        bool fCompactBlocks = (nLocalServices & NODE_COMPACT_BLOCKS) && (pfrom->nServices & NODE_COMPACT_BLOCKS) && !IsInitialBlockDownload();
+        bool fHeadersFirst = Params().HeadersFirstSyncingActive() && pfrom->nVersion >= HEADERS_FIRST_VERSION;
 
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
             const CInv& inv = vInv[nInv];
@@ -4995,9 +5757,24 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
-                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
+                if (!fAlreadyHave && !fImporting && !fReindex && fHeadersFirst) {
+                    // Get the headers up to the announced block, during the
+                    // initial download the blocks are fetched from them
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
+                    LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                }
+                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash) && !(fHeadersFirst && IsInitialBlockDownload())) {
+                    // Add this to the list of blocks to request, new blocks
+                    // as compact blocks when the peer can send them
+                    if (fCompactBlocks) {
+                        vToFetch.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                        MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                    } else {
+                        vToFetch.push_back(inv);
+                        CNodeState* nodestate = State(pfrom->GetId());
+                        if (nodestate->setBlocksRequested.size() < MAX_BLOCKS_REQUESTED_PER_PEER)
+                            nodestate->setBlocksRequested.insert(inv.hash);
+                    }
                     LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
                 }
             }
@@ -5035,7 +5812,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
+    else if (strCommand == "getblocks" || (strCommand == "getheaders" && pfrom->nVersion < HEADERS_FIRST_VERSION)) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -5067,7 +5844,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == "getheaders" && Params().HeadersFirstSyncingActive()) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -5079,9 +5856,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         CBlockIndex* pindex = NULL;
         if (locator.IsNull()) {
-            // If locator is null, return the hashStop block
+            // If locator is null, return the hashStop block, if we can send it
             BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end())
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA))
                 return true;
             pindex = (*mi).second;
         } else {
@@ -5277,6 +6054,20 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
+
+        // Headers that don't connect can't be checked. Ask for the ones in
+        // between, and punish peers that keep sending them.
+        CNodeState* nodestate = State(pfrom->GetId());
+        if (!mapBlockIndex.count(headers[0].hashPrevBlock) && headers[0].GetHash() != Params().HashGenesisBlock()) {
+            if (++nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0)
+                Misbehaving(pfrom->GetId(), 20);
+            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+            LogPrint("net", "headers from peer=%d don't connect (%d in a row), getheaders (%d)\n", pfrom->id, nodestate->nUnconnectingHeaders, pindexBestHeader->nHeight);
+            return true;
+        }
+        nodestate->nUnconnectingHeaders = 0;
+
+        size_t nIndexSize = mapBlockIndex.size();
         CBlockIndex* pindexLast = NULL;
         BOOST_FOREACH (const CBlockHeader& header, headers) {
             CValidationState state;
@@ -5302,6 +6093,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
+        // New headers that end on a chain with no more work than our tip are
+        // a fork we won't download, only tolerate a few of them
+        if (pindexLast && mapBlockIndex.size() > nIndexSize && nCount < MAX_HEADERS_RESULTS &&
+            pindexLast->nChainWork <= chainActive.Tip()->nChainWork && ++nodestate->nLowWorkHeaders > MAX_LOW_WORK_HEADERS) {
+            Misbehaving(pfrom->GetId(), 20);
+            return error("too many low-work headers chains from peer=%d", pfrom->id);
+        }
+
         if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
@@ -5320,9 +6119,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         uint256 hashBlock = block.GetHash();
         CInv inv(MSG_BLOCK, hashBlock);
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+        {
+            LOCK(cs_main);
+            State(pfrom->GetId())->setBlocksRequested.erase(hashBlock);
+        }
 
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(block.hashPrevBlock)) {
+        if (!mapBlockIndex.count(block.hashPrevBlock) && Params().HeadersFirstSyncingActive() && pfrom->nVersion >= HEADERS_FIRST_VERSION) {
+            LOCK(cs_main);
+            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hashBlock);
+        } else if (!mapBlockIndex.count(block.hashPrevBlock)) {
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
                 pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
@@ -5334,20 +6140,125 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         } else {
             pfrom->AddInventoryKnown(inv);
+            ProcessBlockFromPeer(pfrom, block);
+        }
+
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint("net", "received compact block %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+
+        boost::shared_ptr<CPartiallyDownloadedBlock> partialBlock(new CPartiallyDownloadedBlock());
+        {
+            LOCK(cs_main);
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hashBlock));
+
+            // Compact blocks are only sent on request, and rebuilding one
+            // scans the memory pool
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId()) {
+                LogPrint("net", "ignoring unrequested compact block %s from peer=%d\n", hashBlock.ToString(), pfrom->id);
+                return true;
+            }
+
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                MarkBlockAsReceived(hashBlock);
+                return true;
+            }
 
+            // A block that doesn't build on one we know is fetched whole,
+            // which starts syncing to it. It stays in flight from this peer.
+            if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hashBlock)));
+                return true;
+            }
+
+            // The header is checked before the transactions are looked for
             CValidationState state;
-            ProcessNewBlock(state, pfrom, &block);
-            int nDoS;
-            if (state.IsInvalid(nDoS)) {
-                pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                    state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                if (nDoS > 0) {
-                    TRY_LOCK(cs_main, lockMain);
-                    if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                }
+            if (!CheckBlockHeaderConnects(cmpctblock.header, state, NULL)) {
+                MarkBlockAsReceived(hashBlock);
+                int nDoS;
+                if (state.IsInvalid(nDoS) && nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("peer %d sent us compact block %s with an invalid header", pfrom->id, hashBlock.ToString());
+            }
+
+            ReadStatus status = partialBlock->InitData(cmpctblock, mempool);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hashBlock);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us an invalid compact block", pfrom->id);
+            }
+            if (status == READ_STATUS_FAILED) {
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hashBlock)));
+                return true;
+            }
+
+            CBlockTransactionsRequest req;
+            req.blockhash = hashBlock;
+            req.indexes = partialBlock->GetMissing();
+            if (!req.indexes.empty()) {
+                LogPrint("net", "requesting %u transactions of compact block %s from peer=%d\n", req.indexes.size(), hashBlock.ToString(), pfrom->id);
+                State(pfrom->GetId())->partialBlock = partialBlock;
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
             }
         }
+        ProcessCompactBlock(pfrom, *partialBlock, vector<CTransaction>());
+    }
 
+
+    else if (strCommand == "getblocktxn") {
+        CBlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+        // Only the blocks sent as compact blocks are expected here
+        BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second) ||
+            mi->second->nHeight + MAX_CMPCT_BLOCK_DEPTH < chainActive.Height()) {
+            LogPrint("net", "ignoring getblocktxn for %s from peer=%d, not a recent block\n", req.blockhash.ToString(), pfrom->id);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, mi->second))
+            assert(!"cannot load block from disk");
+        CBlockTransactions resp;
+        resp.blockhash = req.blockhash;
+        BOOST_FOREACH (uint32_t index, req.indexes) {
+            if (index >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d asked for transaction %u of block %s, which has %u", pfrom->id, index, req.blockhash.ToString(), block.vtx.size());
+            }
+            resp.txn.push_back(block.vtx[index]);
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockTransactions resp;
+        vRecv >> resp;
+
+        boost::shared_ptr<CPartiallyDownloadedBlock> partialBlock;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (!nodestate->partialBlock || nodestate->partialBlock->header.GetHash() != resp.blockhash) {
+                LogPrint("net", "ignoring unrequested block transactions for %s from peer=%d\n", resp.blockhash.ToString(), pfrom->id);
+                return true;
+            }
+            partialBlock.swap(nodestate->partialBlock);
+        }
+        ProcessCompactBlock(pfrom, *partialBlock, resp.txn);
     }
 
 
@@ -5689,6 +6600,31 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+// Whether a "block" message carries a block we asked this peer for, through
+// getdata after an inv or as one in flight, and whose parent we know. Only
+// those are worth checking ahead of processing.
+bool static IsExpectedBlock(CNode* pfrom, const CDataStream& vRecv)
+{
+    if (vRecv.empty())
+        return false;
+    CBlockHeader header;
+    try {
+        CBufferReader reader(&vRecv.begin()[0], &vRecv.begin()[0] + vRecv.size(), SER_NETWORK, PROTOCOL_VERSION);
+        reader >> header;
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    uint256 hash = header.GetHash();
+    LOCK(cs_main);
+    if (!mapBlockIndex.count(header.hashPrevBlock))
+        return false;
+    if (State(pfrom->GetId())->setBlocksRequested.count(hash))
+        return true;
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    return itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -5711,6 +6647,22 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // Check the blocks and the servicenode message signatures waiting behind
+    // other messages while those are processed
+    BOOST_FOREACH (CNetMessage& msg, pfrom->vRecvMsg) {
+        if (!msg.complete())
+            break;
+        if (!msg.fPrecheckQueued) {
+            std::string strCommand = msg.hdr.GetCommand();
+            if (strCommand == "block") {
+                if (!fImporting && !fReindex && IsExpectedBlock(pfrom, msg.vRecv))
+                    blockPrecheckQueue.Push(msg.vRecv);
+            } else
+                servicenodeSigCheckQueue.Push(strCommand, msg.vRecv);
+        }
+        msg.fPrecheckQueued = true;
+    }
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -5905,13 +6857,26 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
-                pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256());
+                if (Params().HeadersFirstSyncingActive() && pto->nVersion >= HEADERS_FIRST_VERSION) {
+                    CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256());
+                } else {
+                    pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256());
+                }
             }
         }
 
+        // Headers come from the sync peer only. Ask the other peers whether they
+        // have the best header, so that they can be downloaded from as well.
+        if (Params().HeadersFirstSyncingActive() && pto->nVersion >= HEADERS_FIRST_VERSION && !state.fSyncStarted && !pto->fClient && fFetch &&
+            pindexBestHeader->nChainWork > chainActive.Tip()->nChainWork && state.pindexBestKnownBlock != pindexBestHeader &&
+            state.nHeadersProbeTime < GetTimeMicros() - (state.pindexHeadersProbed == pindexBestHeader ? HEADERS_PROBE_INTERVAL * 1000000 : 1000000)) {
+            state.nHeadersProbeTime = GetTimeMicros();
+            state.pindexHeadersProbed = pindexBestHeader;
+            pto->PushMessage("getheaders", CBlockLocator(), pindexBestHeader->GetBlockHash());
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -6085,6 +7050,169 @@ std::string CBlockFileInfo::ToString() const
 }
 
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+// Append a memory pool transaction to vEntries after its parents in the pool
+void static AddMempoolEntrySorted(const uint256& hash, set<uint256>& setAdded, vector<CTxMemPoolEntry>& vEntries)
+{
+    if (!setAdded.insert(hash).second)
+        return;
+    const CTxMemPoolEntry& entry = mempool.mapTx[hash];
+    BOOST_FOREACH (const CTxIn& txin, entry.GetTx().vin)
+        if (mempool.mapTx.count(txin.prevout.hash))
+            AddMempoolEntrySorted(txin.prevout.hash, setAdded, vEntries);
+    vEntries.push_back(entry);
+}
+
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMillis();
+
+    vector<CTxMemPoolEntry> vEntries;
+    map<uint256, pair<double, CAmount> > mapDeltas;
+    {
+        LOCK(mempool.cs);
+        set<uint256> setAdded;
+        vEntries.reserve(mempool.mapTx.size());
+        for (map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+            AddMempoolEntrySorted(it->first, setAdded, vEntries);
+        mapDeltas = mempool.mapDeltas;
+    }
+
+    try {
+        boost::filesystem::path path = GetDataDir() / "mempool.dat";
+        boost::filesystem::path pathNew = GetDataDir() / "mempool.dat.new";
+        CAutoFile file(fopen(pathNew.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s : failed to open %s", __func__, pathNew.string());
+
+        file << MEMPOOL_DUMP_VERSION << (uint64_t)vEntries.size();
+        BOOST_FOREACH (const CTxMemPoolEntry& entry, vEntries) {
+            pair<double, CAmount> deltas(0.0, 0);
+            map<uint256, pair<double, CAmount> >::const_iterator it = mapDeltas.find(entry.GetTx().GetHash());
+            if (it != mapDeltas.end())
+                deltas = it->second;
+            file << entry.GetTx() << entry.GetTime() << entry.GetHeight() << deltas.first << deltas.second;
+        }
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathNew, path);
+    } catch (const std::exception& e) {
+        return error("%s : failed to dump the memory pool - %s", __func__, e.what());
+    }
+
+    LogPrintf("Dumped %u memory pool transactions in %dms\n", vEntries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+//! A transaction read from mempool.dat, with what it entered the memory pool with
+struct CMempoolDumpEntry {
+    CTransaction tx;
+    int64_t nTime;
+    unsigned int nHeight;
+    double dPriorityDelta;
+    CAmount nFeeDelta;
+};
+
+/**
+ * Accept a batch of saved transactions to the memory pool. Their scripts are
+ * first run on the script check threads, for those whose inputs are already
+ * confirmed or in the pool; when all of them pass they are remembered as
+ * valid, so that AcceptToMemoryPool doesn't run them one by one.
+ */
+void static LoadMempoolBatch(const vector<CMempoolDumpEntry>& vBatch, int& nAccepted, int& nConfirmed, int& nFailed)
+{
+    LOCK(cs_main);
+
+    vector<const CMempoolDumpEntry*> vPending;
+    BOOST_FOREACH (const CMempoolDumpEntry& entry, vBatch) {
+        // Some outputs of a transaction confirmed since are unspent
+        if (pcoinsTip->HaveCoins(entry.tx.GetHash()))
+            nConfirmed++;
+        else
+            vPending.push_back(&entry);
+    }
+
+    if (nScriptCheckThreads) {
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        vector<uint256> vChecked;
+        {
+            CCoinsView dummy;
+            CCoinsViewCache view(&dummy);
+            LOCK(mempool.cs);
+            CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+            view.SetBackend(viewMemPool);
+            BOOST_FOREACH (const CMempoolDumpEntry* pentry, vPending) {
+                // Transactions spending others of the batch are checked when accepted
+                CValidationState state;
+                vector<CScriptCheck> vChecks;
+                if (view.HaveInputs(pentry->tx) && CheckInputs(pentry->tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, &vChecks)) {
+                    control.Add(vChecks);
+                    vChecked.push_back(pentry->tx.GetHash());
+                }
+            }
+            view.SetBackend(dummy);
+        }
+        if (control.Wait()) {
+            BOOST_FOREACH (const uint256& hash, vChecked)
+                txScriptCache.insert(hash, STANDARD_SCRIPT_VERIFY_FLAGS);
+        }
+    }
+
+    BOOST_FOREACH (const CMempoolDumpEntry* pentry, vPending) {
+        uint256 hash = pentry->tx.GetHash();
+        if (pentry->dPriorityDelta != 0.0 || pentry->nFeeDelta != 0)
+            mempool.PrioritiseTransaction(hash, hash.ToString(), pentry->dPriorityDelta, pentry->nFeeDelta);
+
+        // Keep the time and height the transaction first entered the pool
+        // with, the fee estimates count the blocks it takes to confirm from
+        // there. Fees and priority passed the rate limiter back then.
+        CValidationState state;
+        if (AcceptToMemoryPoolWithTime(mempool, state, pentry->tx, false, NULL, pentry->nTime, std::min(pentry->nHeight, (unsigned int)chainActive.Height())))
+            nAccepted++;
+        else
+            nFailed++;
+    }
+}
+
+bool LoadMempool()
+{
+    int64_t nStart = GetTimeMillis();
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("No memory pool saved in %s\n", path.string());
+        return false;
+    }
+
+    int nAccepted = 0, nConfirmed = 0, nFailed = 0;
+    try {
+        uint64_t nVersion, nCount;
+        file >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s : unknown memory pool file version %d", __func__, nVersion);
+        file >> nCount;
+
+        vector<CMempoolDumpEntry> vBatch;
+        while (nCount > 0) {
+            vBatch.resize(std::min<uint64_t>(nCount, MEMPOOL_LOAD_BATCH));
+            BOOST_FOREACH (CMempoolDumpEntry& entry, vBatch)
+                file >> entry.tx >> entry.nTime >> entry.nHeight >> entry.dPriorityDelta >> entry.nFeeDelta;
+            nCount -= vBatch.size();
+
+            LoadMempoolBatch(vBatch, nAccepted, nConfirmed, nFailed);
+            if (ShutdownRequested())
+                return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s : failed to read the memory pool, continuing anyway - %s\n", __func__, e.what());
+    }
+
+    LogPrintf("Loaded %d memory pool transactions in %dms, %d confirmed since and %d not accepted left out\n",
+        nAccepted, GetTimeMillis() - nStart, nConfirmed, nFailed);
+    return true;
+}
+
 class CMainCleanup
 {
 public:
@@ -12,6 +12,7 @@
 #include "config/blocknetdx-config.h"
 #endif
 
+#include "addressindex.h"
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -38,6 +39,9 @@
 #include <utility>
 #include <vector>
 
+#include <boost/function.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
@@ -80,20 +84,55 @@ static const int COINBASE_MATURITY = 100;
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Blocks LoadExternalBlockFile reads and has checked ahead of the one it connects */
+static const unsigned int IMPORT_READ_AHEAD_BLOCKS = 64;
+/** -fastimport default (import files through a memory map, see LoadExternalBlockFileFast) */
+static const bool DEFAULT_FAST_IMPORT = false;
+/** Blocks LoadExternalBlockFileFast decodes at a time, after which the coins cache may be flushed */
+static const unsigned int FAST_IMPORT_BATCH_BLOCKS = 1000;
+/** -txlookupcache default (number of confirmed transactions GetTransaction keeps in memory) */
+static const unsigned int DEFAULT_TX_LOOKUP_CACHE = 5000;
+/** -txscriptcache default (number of memory pool transactions whose valid scripts are remembered) */
+static const unsigned int DEFAULT_TX_SCRIPT_CACHE = 50000;
+/** -persistmempool default (save the memory pool on shutdown and load it on startup) */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Transactions LoadMempool checks and accepts at a time, under one lock */
+static const unsigned int MEMPOOL_LOAD_BATCH = 1000;
+/** -checkblockhashes default (rehash every stored block header at startup) */
+static const bool DEFAULT_CHECKBLOCKHASHES = false;
+/** -addressindex default (maintain an index of the outputs paying and spent by each address) */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** -spentindex default (maintain an index of the input spending each output) */
+static const bool DEFAULT_SPENTINDEX = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Announced blocks asked from a peer that are remembered, to check them ahead when they arrive. */
+static const unsigned int MAX_BLOCKS_REQUESTED_PER_PEER = 1024;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached their tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Headers messages in a row that don't connect to our index after which the peer is punished. */
+static const int MAX_UNCONNECTING_HEADERS = 10;
+/** Headers messages adding a chain with no more work than our tip tolerated from a peer. */
+static const int MAX_LOW_WORK_HEADERS = 8;
+/** Time (in seconds) between asking a peer again whether it has the same best header. */
+static const int64_t HEADERS_PROBE_INTERVAL = 30;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Memory taken by blocks downloaded ahead of their parent, beyond which no more are requested
+ *  until the block they wait for arrives. */
+static const size_t MAX_BLOCKS_AHEAD_SIZE = 64 * 1000 * 1000;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
+/** -compactblocks default (advertise NODE_COMPACT_BLOCKS, and ask peers advertising it for compact blocks) */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
+/** Depth below the tip up to which requested blocks are sent as compact blocks, deeper ones are sent whole */
+static const int MAX_CMPCT_BLOCK_DEPTH = 5;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 
@@ -126,6 +165,8 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
@@ -186,6 +227,13 @@ FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
+/**
+ * Import blocks from an external file by mapping it into memory, decoding its
+ * blocks in parallel and connecting them in chain order, with the coins cache
+ * flushed between batches instead of as usual. Scripts are not checked for
+ * hashCheckpoint and its ancestors in the file.
+ */
+bool LoadExternalBlockFileFast(const boost::filesystem::path& path, const uint256& hashCheckpoint = uint256());
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex();
 /** Load the block tree and coins database from disk */
@@ -205,6 +253,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the block checking thread, see CBlockCheckControl */
+void ThreadBlockCheck();
 
 // ***TODO*** probably not the right place for these 2
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
@@ -216,6 +266,16 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false);
+/** Resize the cache of recently looked up transactions, 0 disables it */
+void SetTxLookupCacheSize(unsigned int nSize);
+/** Map a P2PKH, P2PK or P2SH script to the address type and hash used by the address and spent indexes */
+bool GetAddressIndexKey(const CScript& script, uint160& hashBytes, int& type);
+/** Look up the credits and debits of an address, optionally within a range of heights (requires -addressindex) */
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+/** Look up the unspent outputs paying an address (requires -addressindex) */
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+/** Look up the input spending an output (requires -spentindex) */
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
 /** Find the best known block, and make it the tip of the block chain */
 
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -243,6 +303,15 @@ void FlushStateToDisk();
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool ignoreFees = false);
 
+/** (try to) add transaction to memory pool, as first seen at the given time and height */
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, unsigned int nAcceptHeight, bool fRejectInsaneFee = false, bool ignoreFees = false);
+
+/** Save the memory pool to mempool.dat, parents before the transactions spending them */
+bool DumpMempool();
+
+/** Load the memory pool saved by DumpMempool, leaving out the transactions confirmed since */
+bool LoadMempool();
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
 int GetInputAge(CTxIn& vin);
@@ -259,17 +328,40 @@ struct CNodeStateStats {
 
 struct CDiskTxPos : public CDiskBlockPos {
     unsigned int nTxOffset; // after header
+    uint256 hashBlock;      // block containing the transaction, 0 for entries written by older versions
+    int nHeight;
 
-    ADD_SERIALIZE_METHODS;
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return ::GetSerializeSize(*(CDiskBlockPos*)this, nType, nVersion) +
+               ::GetSerializeSize(VARINT(nTxOffset), nType, nVersion) +
+               ::GetSerializeSize(hashBlock, nType, nVersion) +
+               ::GetSerializeSize(VARINT(nHeight), nType, nVersion);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, *(CDiskBlockPos*)this, nType, nVersion);
+        ::Serialize(s, VARINT(nTxOffset), nType, nVersion);
+        ::Serialize(s, hashBlock, nType, nVersion);
+        ::Serialize(s, VARINT(nHeight), nType, nVersion);
+    }
+
+    //! Only read from the txindex database: older entries end after nTxOffset
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
     {
-        READWRITE(*(CDiskBlockPos*)this);
-        READWRITE(VARINT(nTxOffset));
+        SetNull();
+        ::Unserialize(s, *(CDiskBlockPos*)this, nType, nVersion);
+        ::Unserialize(s, VARINT(nTxOffset), nType, nVersion);
+        if (!s.empty()) {
+            ::Unserialize(s, hashBlock, nType, nVersion);
+            ::Unserialize(s, VARINT(nHeight), nType, nVersion);
+        }
     }
 
-    CDiskTxPos(const CDiskBlockPos& blockIn, unsigned int nTxOffsetIn) : CDiskBlockPos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn)
+    CDiskTxPos(const CDiskBlockPos& blockIn, unsigned int nTxOffsetIn) : CDiskBlockPos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn), hashBlock(), nHeight(0)
     {
     }
 
@@ -282,6 +374,8 @@ struct CDiskTxPos : public CDiskBlockPos {
     {
         CDiskBlockPos::SetNull();
         nTxOffset = 0;
+        hashBlock = 0;
+        nHeight = 0;
     }
 };
 
@@ -330,12 +424,18 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  * instead of being performed inline.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL);
+/** Resize the cache of memory pool transactions whose scripts CheckInputs needn't run again, 0 disables it */
+void SetTxScriptCacheSize(unsigned int nSize);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state);
+/** The part of CheckTransaction that reads no chain state, and so needs no locks */
+bool CheckTransactionContextFree(const CTransaction& tx, CValidationState& state);
+/** The part of CheckTransaction rejecting inputs from exploited stakes, checked once spork 17 is active */
+bool CheckTransactionStakeInputs(const CTransaction& tx, CValidationState& state);
 
 /**
  * Check if transaction will be final in the next block to be created.
@@ -406,6 +506,48 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing one check of a block that reads no chain state, like
+ * the context free checks of a transaction or a proof-of-stake signature.
+ * Note that the closure usually holds references to the block.
+ */
+class CBlockCheck
+{
+private:
+    boost::function<bool()> check;
+
+public:
+    CBlockCheck() {}
+    CBlockCheck(const boost::function<bool()>& checkIn) : check(checkIn) {}
+
+    bool operator()() { return check(); }
+
+    void swap(CBlockCheck& other) { check.swap(other.check); }
+};
+
+/**
+ * Runs block checks on the block check threads while the calling thread goes
+ * on with the checks that need cs_main, and joins them in Wait(). Blocks are
+ * validated on several threads (message handler, import, staking, rpc), so
+ * when the check threads are taken, or there are none, the checks are run
+ * right away on the calling thread instead.
+ */
+class CBlockCheckControl
+{
+private:
+    boost::unique_lock<boost::mutex> lock;
+    bool fOk;
+    bool fPending;
+
+public:
+    CBlockCheckControl();
+    ~CBlockCheckControl();
+
+    void Add(std::vector<CBlockCheck>& vChecks);
+    //! Whether all checks added passed
+    bool Wait();
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
@@ -429,8 +571,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
+//! With fCheckSig the block signature, which the block hash doesn't cover, is verified too
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = false);
+bool CheckWork(const CBlock& block, CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
@@ -183,6 +183,8 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
+    bool fPrecheckQueued; // handed to the checks that run ahead of processing
+
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
     {
         hdrbuf.resize(24);
@@ -190,6 +192,7 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fPrecheckQueued = false;
     }
 
     bool complete() const
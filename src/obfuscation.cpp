@@ -8,6 +8,7 @@
 #include "init.h"
 #include "main.h"
 #include "servicenodeman.h"
+#include "servicenode-sigcheck.h"
 #include "script/sign.h"
 #include "swifttx.h"
 #include "ui_interface.h"
@@ -1527,6 +1528,9 @@ bool CObfuscationPool::DoAutomaticDenominating(bool fDryRun)
 
         //don't use the queues all of the time for mixing
         if (nUseQueue > 33) {
+            // the denominations we have inputs to mix of, for all the queues at once
+            int nDenomsMixable = pwalletMain->GetObfuscationDenominations(0, nObfuscationRounds);
+
             // Look through the queues and see if anything matches
             BOOST_FOREACH (CObfuscationQueue& dsq, vecObfuscationQueue) {
                 CService addr;
@@ -1552,6 +1556,9 @@ bool CObfuscationPool::DoAutomaticDenominating(bool fDryRun)
                 }
                 if (fUsed) continue;
 
+                //no inputs of some of their denominations
+                if ((dsq.nDenom & nDenomsMixable) != dsq.nDenom) continue;
+
                 std::vector<CTxIn> vTempCoins;
                 std::vector<COutput> vTempCoins2;
                 // Try to match their denominations if possible
@@ -2162,6 +2169,9 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
 
 bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
 {
+    if (servicenodeSigCheckQueue.IsVerified(pubkey, vchSig, strMessage))
+        return true;
+
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
@@ -2175,7 +2185,10 @@ bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vc
     if (fDebug && pubkey2.GetID() != pubkey.GetID())
         LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    if (pubkey2.GetID() != pubkey.GetID())
+        return false;
+    servicenodeSigCheckQueue.SetVerified(pubkey, vchSig, strMessage);
+    return true;
 }
 
 bool CObfuscationQueue::Sign()
@@ -2309,8 +2322,6 @@ void ThreadCheckObfuScationPool()
                 CleanTransactionLocksList();
             }
 
-            //if(c % SERVICENODES_DUMP_SECONDS == 0) DumpServicenodes();
-
             obfuScationPool.CheckTimeout();
             obfuScationPool.CheckForCompleteQueue();
 
@@ -72,6 +72,11 @@ enum {
     // but no longer do as of protocol version 70011 (= NO_BLOOM_VERSION)
     NODE_BLOOM = (1 << 2),
 
+    // NODE_COMPACT_BLOCKS means the node sends and rebuilds compact blocks, the
+    // header and short transaction ids a peer rebuilds the block from with its
+    // memory pool. Nodes ask peers advertising it for new blocks that way.
+    NODE_COMPACT_BLOCKS = (1 << 3),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
@@ -164,7 +169,10 @@ enum {
     MSG_SERVICENODE_QUORUM,
     MSG_SERVICENODE_ANNOUNCE,
     MSG_SERVICENODE_PING,
-    MSG_DSTX
+    MSG_DSTX,
+    // Like MSG_FILTERED_BLOCK, MSG_CMPCT_BLOCK only appears in a getdata, to
+    // ask for a "cmpctblock" instead of the full block
+    MSG_CMPCT_BLOCK
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -158,12 +158,15 @@ CTxOut getPrevOut(const COutPoint& out)
     return CTxOut();
 }
 
-void getNextIn(const COutPoint& /*Out*/, uint256& /*Hash*/, unsigned int& /*n*/)
+void getNextIn(const COutPoint& Out, uint256& Hash, unsigned int& n)
 {
-    // Hash = 0;
-    // n = 0;
-    // if (paddressmap)
-    //    paddressmap->ReadNextIn(Out, Hash, n);
+    Hash = 0;
+    n = 0;
+    CSpentIndexValue spent;
+    if (GetSpentIndex(CSpentIndexKey(Out.hash, Out.n), spent)) {
+        Hash = spent.txid;
+        n = spent.inputIndex;
+    }
 }
 
 const CBlockIndex* getexplorerBlockIndex(int64_t height)
@@ -324,7 +327,7 @@ std::string TxToString(uint256 BlockHash, const CTransaction& tx)
         const CTxOut& Out = tx.vout[i];
         uint256 HashNext = uint256S("0");
         unsigned int nNext = 0;
-        bool fAddrIndex = false;
+        bool fAddrIndex = fSpentIndex;
         getNextIn(COutPoint(TxHash, i), HashNext, nNext);
         std::string OutputsContentCells[] =
             {
@@ -386,37 +389,34 @@ std::string AddressToString(const CBitcoinAddress& Address)
             _("Balance")};
     std::string TxContent = table + makeHTMLTableRow(TxLabels, sizeof(TxLabels) / sizeof(std::string));
 
-    std::set<COutPoint> PrevOuts;
-    /*
-    CScript AddressScript;
-    AddressScript.SetDestination(Address.Get());
+    CScript AddressScript = GetScriptForDestination(Address.Get());
+    uint160 hashBytes;
+    int type;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!fAddressIndex || !GetAddressIndexKey(AddressScript, hashBytes, type) || !GetAddressIndex(hashBytes, type, addressIndex))
+        return ""; // it will take too long to find transactions by address
 
     int64_t Sum = 0;
-    bool fAddrIndex = false;
-
-    if (!fAddrIndex)
-        return ""; // it will take too long to find transactions by address
-    else
-    {
-        std::vector<CDiskTxPos> Txs;
-        paddressmap->GetTxs(Txs, AddressScript.GetID());
-        BOOST_FOREACH (const CDiskTxPos& pos, Txs)
-        {
-            CTransaction tx;
-            CBlock block;
-            uint256 bhash = block.GetHash();
-            GetTransaction(pos.nTxOffset, tx, bhash);
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
-            if (mi == mapBlockIndex.end())
-                continue;
-            CBlockIndex* pindex = (*mi).second;
-            if (!pindex || !chainActive.Contains(pindex))
-                continue;
-            std::string Prepend = "<a href=\"" + itostr(pindex->nHeight) + "\">" + TimeToString(pindex->nTime) + "</a>";
-            TxContent += TxToRow(tx, AddressScript, Prepend, &Sum);
-        }
+    uint256 hashLast = 0;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        // the entries of one transaction are next to each other, show it once
+        if (it->first.txhash == hashLast)
+            continue;
+        hashLast = it->first.txhash;
+
+        CTransaction tx;
+        uint256 hashBlock;
+        if (!GetTransaction(it->first.txhash, tx, hashBlock, true))
+            continue;
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
+            continue;
+        CBlockIndex* pindex = mi->second;
+        if (!pindex || !chainActive.Contains(pindex))
+            continue;
+        std::string Prepend = "<a href=\"" + itostr(pindex->nHeight) + "\">" + TimeToString(pindex->nTime) + "</a>";
+        TxContent += TxToRow(tx, AddressScript, Prepend, &Sum);
     }
-    */
     TxContent += "</table>";
 
     std::string Content;
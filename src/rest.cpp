@@ -3,20 +3,32 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockstore.h"
+#include "clientversion.h"
+#include "coins.h"
 #include "main.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "rpcserver.h"
 #include "streams.h"
 #include "sync.h"
+#include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
 
 using namespace std;
 using namespace json_spirit;
 
+//! Allow a max of 15 outpoints to be queried at once
+static const size_t MAX_GETUTXOS_OUTPOINTS = 15;
+//! Most headers returned by a single /rest/headers request
+static const long MAX_REST_HEADERS_RESULTS = 2000;
+//! Bytes copied from the block files per write when streaming a block
+static const size_t REST_STREAM_CHUNK_SIZE = 64 * 1024;
+
 enum RetFormat {
     RF_UNDEF,
     RF_BINARY,
@@ -41,8 +53,26 @@ public:
     string message;
 };
 
+struct CCoin {
+    uint32_t nTxVer; // Don't call this nVersion, that name has a special meaning inside IMPLEMENT_SERIALIZE
+    uint32_t nHeight;
+    CTxOut out;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nTxVer);
+        READWRITE(nHeight);
+        READWRITE(out);
+    }
+};
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry);
 extern Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern Object blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex);
+extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, Object& out, bool fIncludeHex);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -89,6 +119,52 @@ static bool ParseHashStr(const string& strReq, uint256& v)
     return true;
 }
 
+/**
+ * Send a block exactly as it is stored in the block files, which is also its
+ * network serialization, without deserializing it or holding it in memory.
+ * Errors after the reply header went out cannot be reported to the client;
+ * they propagate as exceptions and the connection is dropped.
+ */
+static void StreamBlockFromDisk(AcceptedConnection* conn, const CDiskBlockPos& pos, const string& hashStr, bool fRun, bool fHex)
+{
+    // The block size precedes the block in the file
+    if (pos.nPos < sizeof(unsigned int))
+        throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+    if (!blockWriteQueue.WaitWritten(pos))
+        throw RESTERR(HTTP_INTERNAL_SERVER_ERROR, "Error reading " + hashStr);
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+
+    unsigned int nSize = 0;
+    try {
+        filein >> nSize;
+    } catch (std::exception& e) {
+        throw RESTERR(HTTP_INTERNAL_SERVER_ERROR, "Error reading " + hashStr);
+    }
+    if (nSize == 0 || nSize > MAX_BLOCK_SIZE)
+        throw RESTERR(HTTP_INTERNAL_SERVER_ERROR, "Error reading " + hashStr);
+
+    if (fHex)
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, nSize * 2 + 1, "text/plain");
+    else
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, nSize, "application/octet-stream");
+
+    vector<char> vchChunk(std::min((size_t)nSize, REST_STREAM_CHUNK_SIZE));
+    while (nSize > 0) {
+        size_t nChunk = std::min((size_t)nSize, vchChunk.size());
+        filein.read(&vchChunk[0], nChunk);
+        if (fHex)
+            conn->stream() << HexStr(vchChunk.begin(), vchChunk.begin() + nChunk);
+        else
+            conn->stream().write(&vchChunk[0], nChunk);
+        nSize -= nChunk;
+    }
+    if (fHex)
+        conn->stream() << "\n";
+    conn->stream() << std::flush;
+}
+
 static bool rest_block(AcceptedConnection* conn,
     string& strReq,
     map<string, string>& /*mapHeaders*/,
@@ -103,36 +179,41 @@ static bool rest_block(AcceptedConnection* conn,
     if (!ParseHashStr(hashStr, hash))
         throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
     CBlockIndex* pblockindex = NULL;
+    CDiskBlockPos pos;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
         pblockindex = mapBlockIndex[hash];
-        if (!ReadBlockFromDisk(block, pblockindex))
+        if (!(pblockindex->nStatus & BLOCK_HAVE_DATA))
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        pos = pblockindex->GetBlockPos();
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
+    // Block files are only appended to, so they can be read without cs_main
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
-        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryBlock.size(), "application/octet-stream") << binaryBlock << std::flush;
+        StreamBlockFromDisk(conn, pos, hashStr, fRun, false);
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        StreamBlockFromDisk(conn, pos, hashStr, fRun, true);
         return true;
     }
 
     case RF_JSON: {
-        Object objBlock = blockToJSON(block, pblockindex, showTxDetails);
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pblockindex))
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+
+        Object objBlock;
+        {
+            LOCK(cs_main);
+            objBlock = blockToJSON(block, pblockindex, showTxDetails);
+        }
         string strJSON = write_string(Value(objBlock), false) + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
         return true;
@@ -214,6 +295,250 @@ static bool rest_tx(AcceptedConnection* conn,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_headers(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& /*mapHeaders*/,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+    if (path.size() != 2)
+        throw RESTERR(HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
+
+    long count = strtol(path[0].c_str(), NULL, 10);
+    if (count < 1 || count > MAX_REST_HEADERS_RESULTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Header count out of range: %s", path[0]));
+
+    string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    // Block index entries are never deleted, so they stay valid once cs_main is released
+    vector<const CBlockIndex*> headers;
+    headers.reserve(count);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        const CBlockIndex* pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
+        while (pindex != NULL && chainActive.Contains(pindex)) {
+            headers.push_back(pindex);
+            if (headers.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_FOREACH (const CBlockIndex* pindex, headers)
+        ssHeader << pindex->GetBlockHeader();
+
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryHeader = ssHeader.str();
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryHeader.size(), "application/octet-stream") << binaryHeader << std::flush;
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        return true;
+    }
+
+    case RF_JSON: {
+        Array jsonHeaders;
+        BOOST_FOREACH (const CBlockIndex* pindex, headers) {
+            Object objHeader = blockHeaderToJSON(CBlock(pindex->GetBlockHeader()), pindex);
+            objHeader.insert(objHeader.begin(), Pair("height", pindex->nHeight));
+            objHeader.insert(objHeader.begin(), Pair("hash", pindex->GetBlockHash().GetHex()));
+            jsonHeaders.push_back(objHeader);
+        }
+        string strJSON = write_string(Value(jsonHeaders), false) + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_chaininfo(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& /*mapHeaders*/,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    switch (rf) {
+    case RF_JSON: {
+        Value chainInfoObject;
+        {
+            LOCK(cs_main);
+            chainInfoObject = getblockchaininfo(Array(), false);
+        }
+        string strJSON = write_string(chainInfoObject, false) + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_getutxos(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& /*mapHeaders*/,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    // Request is /rest/getutxos[/checkmempool]/<txid>-<n>/<txid>-<n>/...
+    vector<string> uriParts;
+    boost::split(uriParts, params[0], boost::is_any_of("/"));
+
+    bool fCheckMemPool = false;
+    size_t nFirst = 0;
+    if (!uriParts.empty() && uriParts[0] == "checkmempool") {
+        fCheckMemPool = true;
+        nFirst = 1;
+    }
+
+    vector<COutPoint> vOutPoints;
+    for (size_t i = nFirst; i < uriParts.size(); i++) {
+        size_t nDash = uriParts[i].find('-');
+        if (nDash == string::npos)
+            throw RESTERR(HTTP_BAD_REQUEST, "Parse error");
+
+        uint256 txid;
+        int32_t nOutput;
+        if (!ParseHashStr(uriParts[i].substr(0, nDash), txid) ||
+            !ParseInt32(uriParts[i].substr(nDash + 1), &nOutput) || nOutput < 0)
+            throw RESTERR(HTTP_BAD_REQUEST, "Parse error");
+
+        vOutPoints.push_back(COutPoint(txid, (uint32_t)nOutput));
+    }
+
+    if (vOutPoints.empty())
+        throw RESTERR(HTTP_BAD_REQUEST, "Error: empty request");
+    if (vOutPoints.size() > MAX_GETUTXOS_OUTPOINTS)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_GETUTXOS_OUTPOINTS, vOutPoints.size()));
+
+    // One bit per requested outpoint, set when it is unspent
+    vector<unsigned char> bitmap((vOutPoints.size() + 7) / 8);
+    string bitmapStringRepresentation;
+    vector<CCoin> outs;
+    int nChainHeight;
+    uint256 hashChainTip;
+    {
+        LOCK2(cs_main, mempool.cs);
+
+        CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
+        const CCoinsView& view = fCheckMemPool ? (const CCoinsView&)viewMempool : (const CCoinsView&)*pcoinsTip;
+
+        for (size_t i = 0; i < vOutPoints.size(); i++) {
+            CCoins coins;
+            uint256 hash = vOutPoints[i].hash;
+            bool hit = false;
+            if (view.GetCoins(hash, coins)) {
+                if (fCheckMemPool)
+                    mempool.pruneSpent(hash, coins);
+                if (coins.IsAvailable(vOutPoints[i].n)) {
+                    hit = true;
+                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
+                    // n is valid but points to an already spent output (IsNull).
+                    CCoin coin;
+                    coin.nTxVer = coins.nVersion;
+                    coin.nHeight = coins.nHeight;
+                    coin.out = coins.vout.at(vOutPoints[i].n);
+                    assert(!coin.out.IsNull());
+                    outs.push_back(coin);
+                }
+            }
+
+            bitmapStringRepresentation.append(hit ? "1" : "0");
+            bitmap[i / 8] |= ((unsigned char)hit) << (i % 8);
+        }
+
+        nChainHeight = chainActive.Height();
+        hashChainTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        // serialize data
+        // use exact same output as mentioned in Bip64
+        CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
+        string ssGetUTXOResponseString = ssGetUTXOResponse.str();
+
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, ssGetUTXOResponseString.size(), "application/octet-stream") << ssGetUTXOResponseString << std::flush;
+        return true;
+    }
+
+    case RF_HEX: {
+        CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
+        string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
+
+        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        return true;
+    }
+
+    case RF_JSON: {
+        Object objGetUTXOResponse;
+
+        // pack in some essentials
+        // use more or less the same output as mentioned in Bip64
+        objGetUTXOResponse.push_back(Pair("chainHeight", nChainHeight));
+        objGetUTXOResponse.push_back(Pair("chaintipHash", hashChainTip.GetHex()));
+        objGetUTXOResponse.push_back(Pair("bitmap", bitmapStringRepresentation));
+
+        Array utxos;
+        BOOST_FOREACH (const CCoin& coin, outs) {
+            Object utxo;
+            utxo.push_back(Pair("txvers", (int32_t)coin.nTxVer));
+            utxo.push_back(Pair("height", (int32_t)coin.nHeight));
+            utxo.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
+
+            // include the script in a json output
+            Object o;
+            ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
+            utxo.push_back(Pair("scriptPubKey", o));
+            utxos.push_back(utxo);
+        }
+        objGetUTXOResponse.push_back(Pair("utxos", utxos));
+
+        // return json string
+        string strJSON = write_string(Value(objGetUTXOResponse), false) + "\n";
+        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(AcceptedConnection* conn,
@@ -224,6 +549,9 @@ static const struct {
     {"/rest/tx/", rest_tx},
     {"/rest/block/notxdetails/", rest_block_notxdetails},
     {"/rest/block/", rest_block_extended},
+    {"/rest/chaininfo", rest_chaininfo},
+    {"/rest/headers/", rest_headers},
+    {"/rest/getutxos/", rest_getutxos},
 };
 
 bool HTTPReq_REST(AcceptedConnection* conn,
@@ -27,6 +27,7 @@ public:
 static const CRPCConvertParam vRPCConvertParams[] =
     {
         {"stop", 0},
+        {"getrpcstats", 0},
         {"setmocktime", 0},
         {"getaddednodeinfo", 0},
         {"setgenerate", 0},
@@ -74,6 +75,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getblockheader", 1},
         {"gettransaction", 1},
         {"getrawtransaction", 1},
+        {"getaddressdeltas", 1},
+        {"getaddressdeltas", 2},
+        {"getaddresstxids", 1},
+        {"getaddresstxids", 2},
+        {"getspentinfo", 1},
         {"createrawtransaction", 0},
         {"createrawtransaction", 1},
         {"signrawtransaction", 1},
@@ -441,6 +441,241 @@ Value verifymessage(const Array& params, bool fHelp)
     return (pubkey.GetID() == keyID);
 }
 
+/** Resolve an address parameter to the type and hash it is stored under in the address index */
+static void AddressIndexKeyFromParam(const Value& param, uint160& hashBytes, int& type)
+{
+    CBitcoinAddress address(param.get_str());
+    if (!address.IsValid())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid BlocknetDX address");
+    if (!GetAddressIndexKey(GetScriptForDestination(address.Get()), hashBytes, type))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+}
+
+static std::string AddressFromIndexKey(const uint160& hashBytes, int type)
+{
+    if (type == ADDRESS_TYPE_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+static void HeightRangeFromParams(const Array& params, int& start, int& end)
+{
+    start = 0;
+    end = 0;
+    if (params.size() > 2) {
+        start = params[1].get_int();
+        end = params[2].get_int();
+        if (start <= 0 || end <= 0 || end < start)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end must be positive heights, with end not below start");
+    }
+}
+
+Value getaddressbalance(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"blocknetdxaddress\"\n"
+            "\nReturns the balance of an address (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"blocknetdxaddress\"  (string, required) The address\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,    (numeric) The current balance in satoshis\n"
+            "  \"received\": n,   (numeric) The total amount received in satoshis, including change\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"") + HelpExampleRpc("getaddressbalance", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\""));
+
+    uint160 hashBytes;
+    int type;
+    AddressIndexKeyFromParam(params[0], hashBytes, type);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!GetAddressIndex(hashBytes, type, addressIndex))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        if (it->second > 0)
+            received += it->second;
+        balance += it->second;
+    }
+
+    Object result;
+    result.push_back(Pair("balance", balance));
+    result.push_back(Pair("received", received));
+    return result;
+}
+
+Value getaddressdeltas(const Array& params, bool fHelp)
+{
+    if (fHelp || (params.size() != 1 && params.size() != 3))
+        throw runtime_error(
+            "getaddressdeltas \"blocknetdxaddress\" ( start end )\n"
+            "\nReturns all credits and debits of an address in chain order (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"blocknetdxaddress\"  (string, required) The address\n"
+            "2. start               (numeric, optional) The first block height to include\n"
+            "3. end                 (numeric, optional) The last block height to include\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\": n,     (numeric) The amount, negative when spent\n"
+            "    \"txid\": \"hash\",    (string) The transaction id\n"
+            "    \"index\": n,        (numeric) The input or output index\n"
+            "    \"blockindex\": n,   (numeric) The position of the transaction in its block\n"
+            "    \"height\": n,       (numeric) The block height\n"
+            "    \"address\": \"addr\"  (string) The address\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressdeltas", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\" 1000 2000") + HelpExampleRpc("getaddressdeltas", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\""));
+
+    uint160 hashBytes;
+    int type;
+    int start, end;
+    AddressIndexKeyFromParam(params[0], hashBytes, type);
+    HeightRangeFromParams(params, start, end);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!GetAddressIndex(hashBytes, type, addressIndex, start, end))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+    std::string strAddress = AddressFromIndexKey(hashBytes, type);
+    Array result;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        Object delta;
+        delta.push_back(Pair("satoshis", it->second));
+        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)it->first.index));
+        delta.push_back(Pair("blockindex", (int)it->first.txindex));
+        delta.push_back(Pair("height", it->first.blockHeight));
+        delta.push_back(Pair("address", strAddress));
+        result.push_back(delta);
+    }
+    return result;
+}
+
+Value getaddresstxids(const Array& params, bool fHelp)
+{
+    if (fHelp || (params.size() != 1 && params.size() != 3))
+        throw runtime_error(
+            "getaddresstxids \"blocknetdxaddress\" ( start end )\n"
+            "\nReturns the ids of the transactions paying or spending from an address in chain order (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"blocknetdxaddress\"  (string, required) The address\n"
+            "2. start               (numeric, optional) The first block height to include\n"
+            "3. end                 (numeric, optional) The last block height to include\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"") + HelpExampleRpc("getaddresstxids", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\""));
+
+    uint160 hashBytes;
+    int type;
+    int start, end;
+    AddressIndexKeyFromParam(params[0], hashBytes, type);
+    HeightRangeFromParams(params, start, end);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!GetAddressIndex(hashBytes, type, addressIndex, start, end))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+    // a transaction shows up once per input and output touching the address
+    Array result;
+    std::set<uint256> setSeen;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
+        if (setSeen.insert(it->first.txhash).second)
+            result.push_back(it->first.txhash.GetHex());
+    }
+    return result;
+}
+
+Value getaddressutxos(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"blocknetdxaddress\"\n"
+            "\nReturns the unspent outputs paying an address (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"blocknetdxaddress\"  (string, required) The address\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"addr\",  (string) The address\n"
+            "    \"txid\": \"hash\",     (string) The transaction id\n"
+            "    \"outputIndex\": n,   (numeric) The output index\n"
+            "    \"script\": \"hex\",    (string) The script hex\n"
+            "    \"satoshis\": n,      (numeric) The amount of the output\n"
+            "    \"height\": n         (numeric) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"") + HelpExampleRpc("getaddressutxos", "\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\""));
+
+    uint160 hashBytes;
+    int type;
+    AddressIndexKeyFromParam(params[0], hashBytes, type);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    if (!GetAddressUnspent(hashBytes, type, unspentOutputs))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+    std::string strAddress = AddressFromIndexKey(hashBytes, type);
+    Array result;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        Object output;
+        output.push_back(Pair("address", strAddress));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("satoshis", it->second.satoshis));
+        output.push_back(Pair("height", it->second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+Value getspentinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "getspentinfo \"txid\" index\n"
+            "\nReturns the input spending an output (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. \"txid\"   (string, required) The id of the transaction holding the output\n"
+            "2. index    (numeric, required) The output index\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",  (string) The id of the spending transaction\n"
+            "  \"index\": n,      (numeric) The spending input index\n"
+            "  \"height\": n      (numeric) The height of the block with the spending transaction\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\" 0") + HelpExampleRpc("getspentinfo", "\"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", 0"));
+
+    uint256 txid = ParseHashV(params[0], "txid");
+    int outputIndex = params[1].get_int();
+    if (outputIndex < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid output index");
+
+    CSpentIndexValue value;
+    if (!GetSpentIndex(CSpentIndexKey(txid, outputIndex), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    Object result;
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.inputIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    return result;
+}
+
 Value setmocktime(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
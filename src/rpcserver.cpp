@@ -28,6 +28,9 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
+#include <deque>
+
 using namespace boost;
 using namespace boost::asio;
 using namespace json_spirit;
@@ -49,6 +52,34 @@ static boost::asio::io_service::work* rpc_dummy_work = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector<boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
 
+/**
+ * Connections with a request waiting to be answered. Filled by the I/O thread,
+ * drained by the RPC worker threads. Once nMaxDepth connections are waiting
+ * new ones are refused, so a flood of calls cannot pile up without bound.
+ */
+class RPCWorkQueue
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<boost::shared_ptr<AcceptedConnection> > queue;
+    size_t nMaxDepth;
+    uint64_t nRejected;
+    bool fRunning;
+
+public:
+    RPCWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), nRejected(0), fRunning(true) {}
+
+    bool Enqueue(const boost::shared_ptr<AcceptedConnection>& conn);
+    /** Worker thread loop, returns after Interrupt() */
+    void Run();
+    void Interrupt();
+    void GetStats(size_t& nDepthRet, size_t& nMaxDepthRet, uint64_t& nRejectedRet);
+};
+
+static RPCWorkQueue* rpc_work_queue = NULL;
+static int rpc_worker_threads = 0;
+
 void RPCTypeCheck(const Array& params,
                   const list<Value_type>& typesExpected,
                   bool fAllowNull)
@@ -229,6 +260,116 @@ Value stop(const Array& params, bool fHelp)
     return "BlocknetDX server stopping";
 }
 
+//! Upper bounds of the latency histogram buckets in microseconds, the last bucket is open ended
+static const int64_t RPC_LATENCY_BOUNDS[] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+static const unsigned int RPC_LATENCY_BUCKETS = sizeof(RPC_LATENCY_BOUNDS) / sizeof(RPC_LATENCY_BOUNDS[0]) + 1;
+
+/** Call statistics of one RPC method. Latencies include waiting for cs_main and cs_wallet. */
+struct CRPCMethodStats {
+    uint64_t nCalls;
+    uint64_t nErrors;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    uint64_t vBuckets[RPC_LATENCY_BUCKETS];
+
+    CRPCMethodStats() : nCalls(0), nErrors(0), nTotalMicros(0), nMaxMicros(0)
+    {
+        std::fill(vBuckets, vBuckets + RPC_LATENCY_BUCKETS, 0);
+    }
+};
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+
+static void RecordRPCCall(const std::string& strMethod, int64_t nMicros, bool fError)
+{
+    unsigned int nBucket = std::lower_bound(RPC_LATENCY_BOUNDS, RPC_LATENCY_BOUNDS + RPC_LATENCY_BUCKETS - 1, nMicros) - RPC_LATENCY_BOUNDS;
+
+    LOCK(cs_rpcStats);
+    CRPCMethodStats& stats = mapRPCStats[strMethod];
+    stats.nCalls++;
+    if (fError)
+        stats.nErrors++;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+    stats.vBuckets[nBucket]++;
+}
+
+Value getrpcstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrpcstats ( reset )\n"
+            "\nReturns the state of the RPC work queue and call statistics for every RPC method used so far.\n"
+            "\nArguments:\n"
+            "1. reset     (boolean, optional, default=false) Clear the method statistics after reporting them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workqueue\": {\n"
+            "    \"threads\": n,     (numeric) Number of threads answering requests\n"
+            "    \"depth\": n,       (numeric) Requests waiting for a free thread\n"
+            "    \"maxdepth\": n,    (numeric) Depth at which new requests are refused\n"
+            "    \"rejected\": n     (numeric) Requests refused because the queue was full\n"
+            "  },\n"
+            "  \"methods\": {\n"
+            "    \"method\": {\n"
+            "      \"calls\": n,         (numeric) Number of calls\n"
+            "      \"errors\": n,        (numeric) Number of calls that failed\n"
+            "      \"avgms\": x.xxx,     (numeric) Average latency in milliseconds\n"
+            "      \"maxms\": x.xxx,     (numeric) Highest latency in milliseconds\n"
+            "      \"histogram\": {      (json object) Number of calls per latency bucket\n"
+            "        \"<=0.1ms\": n,\n"
+            "        ...\n"
+            "        \">1000ms\": n\n"
+            "      }\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcstats", "") + HelpExampleRpc("getrpcstats", ""));
+
+    Object ret;
+    if (rpc_work_queue) {
+        size_t nDepth, nMaxDepth;
+        uint64_t nRejected;
+        rpc_work_queue->GetStats(nDepth, nMaxDepth, nRejected);
+
+        Object queue;
+        queue.push_back(Pair("threads", rpc_worker_threads));
+        queue.push_back(Pair("depth", (uint64_t)nDepth));
+        queue.push_back(Pair("maxdepth", (uint64_t)nMaxDepth));
+        queue.push_back(Pair("rejected", nRejected));
+        ret.push_back(Pair("workqueue", queue));
+    }
+
+    Object methods;
+    {
+        LOCK(cs_rpcStats);
+        BOOST_FOREACH (const PAIRTYPE(std::string, CRPCMethodStats) & item, mapRPCStats) {
+            const CRPCMethodStats& stats = item.second;
+            Object histogram;
+            for (unsigned int i = 0; i < RPC_LATENCY_BUCKETS; i++) {
+                if (i < RPC_LATENCY_BUCKETS - 1)
+                    histogram.push_back(Pair(strprintf("<=%gms", RPC_LATENCY_BOUNDS[i] / 1000.0), stats.vBuckets[i]));
+                else
+                    histogram.push_back(Pair(strprintf(">%gms", RPC_LATENCY_BOUNDS[i - 1] / 1000.0), stats.vBuckets[i]));
+            }
+
+            Object method;
+            method.push_back(Pair("calls", stats.nCalls));
+            method.push_back(Pair("errors", stats.nErrors));
+            method.push_back(Pair("avgms", stats.nTotalMicros / 1000.0 / stats.nCalls));
+            method.push_back(Pair("maxms", stats.nMaxMicros / 1000.0));
+            method.push_back(Pair("histogram", histogram));
+            methods.push_back(Pair(item.first, method));
+        }
+        if (params.size() > 0 && params[0].get_bool())
+            mapRPCStats.clear();
+    }
+    ret.push_back(Pair("methods", methods));
+    return ret;
+}
+
 
 /**
  * Call Table
@@ -241,6 +382,7 @@ static const CRPCCommand vRPCCommands[] =
         {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
         {"control", "help", &help, true, true, false},
         {"control", "stop", &stop, true, true, false},
+        {"control", "getrpcstats", &getrpcstats, true, true, false},
 
         /* P2P networking */
         {"network", "getnetworkinfo", &getnetworkinfo, true, false, false},
@@ -291,6 +433,13 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, false, false},
+        {"addressindex", "getaddressdeltas", &getaddressdeltas, true, false, false},
+        {"addressindex", "getaddresstxids", &getaddresstxids, true, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, false, false},
+        {"addressindex", "getspentinfo", &getspentinfo, true, false, false},
+
         /* Utility functions */
         {"util", "createmultisig", &createmultisig, true, true, false},
         {"util", "validateaddress", &validateaddress, true, false, false}, /* uses wallet if enabled */
@@ -451,6 +600,7 @@ public:
         asio::io_service& io_service,
         ssl::context& context,
         bool fUseSSL) : sslStream(io_service, context),
+                        fUseSSL(fUseSSL),
                         _d(sslStream, fUseSSL),
                         _stream(_d)
     {
@@ -468,18 +618,168 @@ public:
 
     virtual void close()
     {
-        _stream.close();
+        if (_stream.is_open())
+            _stream.close();
+        boost::system::error_code ec;
+        sslStream.lowest_layer().close(ec);
+    }
+
+    virtual bool uses_ssl() const
+    {
+        return fUseSSL;
+    }
+
+    virtual bool input_buffered()
+    {
+        return _stream.rdbuf()->in_avail() > 0;
+    }
+
+    virtual void async_wait_readable(boost::function<void(const boost::system::error_code&)> handler)
+    {
+        sslStream.next_layer().async_read_some(asio::null_buffers(), boost::bind(handler, _1));
     }
 
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
 private:
+    const bool fUseSSL;
     SSLIOStreamDevice<Protocol> _d;
     iostreams::stream<SSLIOStreamDevice<Protocol> > _stream;
 };
 
 void ServiceConnection(AcceptedConnection* conn);
+static bool ServiceRequest(AcceptedConnection* conn);
+
+/** A connection handed to the I/O thread until its next request arrives or it idles out */
+struct RPCIdleWait {
+    boost::shared_ptr<AcceptedConnection> conn;
+    deadline_timer timer;
+    bool fDone;
+
+    RPCIdleWait(const boost::shared_ptr<AcceptedConnection>& connIn, asio::io_service& io_service) : conn(connIn), timer(io_service), fDone(false) {}
+};
+
+static void RPCRejectConnection(boost::shared_ptr<AcceptedConnection> conn)
+{
+    // Like the 403 below, skip the reply on SSL connections so the handshake cannot stall the I/O thread
+    if (!conn->uses_ssl())
+        conn->stream() << HTTPError(HTTP_SERVICE_UNAVAILABLE, false) << std::flush;
+    conn->close();
+}
+
+//! Both handlers run on the single I/O thread, so fDone needs no lock
+static void RPCIdleTimeout(boost::shared_ptr<RPCIdleWait> wait, const boost::system::error_code& error)
+{
+    if (wait->fDone || error == asio::error::operation_aborted)
+        return;
+    wait->fDone = true;
+    wait->conn->close();
+}
+
+static void RPCRequestReady(boost::shared_ptr<RPCIdleWait> wait, const boost::system::error_code& error)
+{
+    if (wait->fDone)
+        return;
+    wait->fDone = true;
+    boost::system::error_code ec;
+    wait->timer.cancel(ec);
+
+    if (error)
+        wait->conn->close();
+    else if (!rpc_work_queue->Enqueue(wait->conn)) {
+        LogPrint("rpc", "RPC work queue full, refusing request from %s\n", wait->conn->peer_address_to_string());
+        RPCRejectConnection(wait->conn);
+    }
+}
+
+/**
+ * Watch a connection from the I/O thread until the client sends a request,
+ * so idle persistent connections do not tie up a worker thread.
+ */
+static void RPCWaitForRequest(boost::shared_ptr<AcceptedConnection> conn)
+{
+    boost::shared_ptr<RPCIdleWait> wait(new RPCIdleWait(conn, *rpc_io_service));
+    wait->timer.expires_from_now(posix_time::seconds(GetArg("-rpcservertimeout", DEFAULT_RPC_SERVER_TIMEOUT)));
+    wait->timer.async_wait(boost::bind(&RPCIdleTimeout, wait, _1));
+    conn->async_wait_readable(boost::bind(&RPCRequestReady, wait, _1));
+}
+
+/**
+ * Answer the requests a client has sent, then give the connection back to the
+ * I/O thread to wait for more. Runs on an RPC worker thread.
+ */
+static void RPCServiceQueued(boost::shared_ptr<AcceptedConnection> conn)
+{
+    if (conn->uses_ssl()) {
+        ServiceConnection(conn.get());
+        conn->close();
+        return;
+    }
+
+    // Pipelined requests may already be buffered, answer them without another trip through the queue
+    bool fKeepAlive;
+    do {
+        fKeepAlive = !ShutdownRequested() && ServiceRequest(conn.get());
+    } while (fKeepAlive && conn->input_buffered());
+
+    if (fKeepAlive)
+        RPCWaitForRequest(conn);
+    else
+        conn->close();
+}
+
+bool RPCWorkQueue::Enqueue(const boost::shared_ptr<AcceptedConnection>& conn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (!fRunning)
+        return false;
+    if (queue.size() >= nMaxDepth) {
+        nRejected++;
+        return false;
+    }
+    queue.push_back(conn);
+    cond.notify_one();
+    return true;
+}
+
+void RPCWorkQueue::Run()
+{
+    while (true) {
+        boost::shared_ptr<AcceptedConnection> conn;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (fRunning && queue.empty())
+                cond.wait(lock);
+            if (!fRunning)
+                break;
+            conn = queue.front();
+            queue.pop_front();
+        }
+        try {
+            RPCServiceQueued(conn);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Error: %s\n", __func__, e.what());
+            conn->close();
+        }
+    }
+}
+
+void RPCWorkQueue::Interrupt()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    fRunning = false;
+    queue.clear();
+    cond.notify_all();
+}
+
+void RPCWorkQueue::GetStats(size_t& nDepthRet, size_t& nMaxDepthRet, uint64_t& nRejectedRet)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    nDepthRet = queue.size();
+    nMaxDepthRet = nMaxDepth;
+    nRejectedRet = nRejected;
+}
 
 //! Forward declaration required for RPCListen
 template <typename Protocol, typename SocketAcceptorService>
@@ -541,8 +841,7 @@ static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, S
             conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
         conn->close();
     } else {
-        ServiceConnection(conn.get());
-        conn->close();
+        RPCWaitForRequest(conn);
     }
 }
 
@@ -604,6 +903,7 @@ void StartRPCThreads()
 
     assert(rpc_io_service == NULL);
     rpc_io_service = new asio::io_service();
+    rpc_work_queue = new RPCWorkQueue(std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORKQUEUE), 1));
     rpc_ssl_context = new ssl::context(*rpc_io_service, ssl::context::sslv23);
 
     const bool fUseSSL = GetBoolArg("-rpcssl", false);
@@ -702,9 +1002,12 @@ void StartRPCThreads()
         return;
     }
 
+    // One I/O thread accepts connections and watches idle ones, the workers answer requests
+    rpc_worker_threads = std::max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    for (int i = 0; i < rpc_worker_threads; i++)
+        rpc_worker_group->create_thread(boost::bind(&RPCWorkQueue::Run, rpc_work_queue));
     fRPCRunning = true;
 }
 
@@ -745,9 +1048,14 @@ void StopRPCThreads()
     deadlineTimers.clear();
 
     rpc_io_service->stop();
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
     cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
+    delete rpc_work_queue;
+    rpc_work_queue = NULL;
+    rpc_worker_threads = 0;
     delete rpc_dummy_work;
     rpc_dummy_work = NULL;
     delete rpc_worker_group;
@@ -937,40 +1245,46 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
     return true;
 }
 
-void ServiceConnection(AcceptedConnection* conn)
+/** Read and answer one request. Returns whether the connection stays open for the next one. */
+static bool ServiceRequest(AcceptedConnection* conn)
 {
     bool fRun = true;
-    while (fRun && !ShutdownRequested()) {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
+    int nProto = 0;
+    map<string, string> mapHeaders;
+    string strRequest, strMethod, strURI;
 
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
+    // Read HTTP request line
+    if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
+        return false;
 
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
+    // Read HTTP message headers and body
+    ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
 
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
+    // HTTP Keep-Alive is false; close connection immediately
+    if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
+        fRun = false;
 
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
+    // Process via JSON-RPC API
+    if (strURI == "/") {
+        if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
+            return false;
 
-            // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
+        // Process via HTTP REST API
+    } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
+        if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
+            return false;
 
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
+    } else {
+        conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+        return false;
     }
+    return fRun;
+}
+
+void ServiceConnection(AcceptedConnection* conn)
+{
+    while (!ShutdownRequested() && ServiceRequest(conn))
+        ;
 }
 
 json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_spirit::Array& params) const
@@ -990,6 +1304,7 @@ json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_s
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    int64_t nStart = GetTimeMicros();
     try {
         // Execute
         Value result;
@@ -1026,9 +1341,14 @@ json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_s
             }
 #endif // !ENABLE_WALLET
         }
+        RecordRPCCall(strMethod, GetTimeMicros() - nStart, false);
         return result;
     } catch (std::exception& e) {
+        RecordRPCCall(strMethod, GetTimeMicros() - nStart, true);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    } catch (...) {
+        RecordRPCCall(strMethod, GetTimeMicros() - nStart, true);
+        throw;
     }
 }
 
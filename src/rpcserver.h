@@ -15,6 +15,8 @@
 #include <stdint.h>
 #include <string>
 
+#include <boost/function.hpp>
+
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_utils.h"
 #include "json/json_spirit_writer_template.h"
@@ -22,6 +24,13 @@
 class CBlockIndex;
 class CNetAddr;
 
+//! Number of threads servicing RPC requests
+static const int DEFAULT_RPC_THREADS = 4;
+//! Requests allowed to wait for a free RPC thread before new ones are refused
+static const int DEFAULT_RPC_WORKQUEUE = 16;
+//! Seconds an idle persistent RPC connection is kept open
+static const int DEFAULT_RPC_SERVER_TIMEOUT = 30;
+
 class AcceptedConnection
 {
 public:
@@ -30,6 +39,13 @@ public:
     virtual std::iostream& stream() = 0;
     virtual std::string peer_address_to_string() const = 0;
     virtual void close() = 0;
+
+    /** SSL connections are serviced by one thread until closed, as the SSL layer buffers input of its own */
+    virtual bool uses_ssl() const = 0;
+    /** Whether part of the next request has already been read from the socket */
+    virtual bool input_buffered() = 0;
+    /** Call handler from the I/O thread once the socket becomes readable */
+    virtual void async_wait_readable(boost::function<void(const boost::system::error_code&)> handler) = 0;
 };
 
 /** Start RPC threads */
@@ -211,6 +227,11 @@ extern json_spirit::Value reservebalance(const json_spirit::Array& params, bool
 extern json_spirit::Value multisend(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value autocombinerewards(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getstakingstatus(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressbalance(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressdeltas(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddresstxids(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressutxos(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getspentinfo(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getrawtransaction(const json_spirit::Array& params, bool fHelp); // in rcprawtransaction.cpp
 extern json_spirit::Value listunspent(const json_spirit::Array& params, bool fHelp);
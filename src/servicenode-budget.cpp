@@ -17,6 +17,7 @@
 #include <boost/lexical_cast.hpp>
 
 CBudgetManager budget;
+CServicenodeCacheLog budgetCacheLog("budget");
 CCriticalSection cs_budget;
 
 std::map<uint256, int64_t> askedForSourceProposalOrBudget;
@@ -237,11 +238,12 @@ CBudgetDB::CBudgetDB()
 {
     pathDB = GetDataDir() / "budget.dat";
     strMagicMessage = "ServicenodeBudget";
+    nLogGeneration = 0;
 }
 
-bool CBudgetDB::Write(const CBudgetManager& objToSave)
+bool CBudgetDB::Write(CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
+    LOCK(budgetCacheLog.csDump);
 
     int64_t nStart = GetTimeMillis();
 
@@ -249,23 +251,15 @@ bool CBudgetDB::Write(const CBudgetManager& objToSave)
     CDataStream ssObj(SER_DISK, CLIENT_VERSION);
     ssObj << strMagicMessage;                   // servicenode cache file specific magic message
     ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
+    int nGeneration = objToSave.Snapshot(ssObj);
+    ssObj << nGeneration;                       // change log following the file
     uint256 hash = Hash(ssObj.begin(), ssObj.end());
     ssObj << hash;
 
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
+    // written without holding the budget
+    if (!WriteServicenodeCacheFile(pathDB, ssObj))
+        return false;
+    budgetCacheLog.Prune(nGeneration);
 
     LogPrintf("Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
 
@@ -339,6 +333,10 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
 
         // de-serialize data into CBudgetManager object
         ssObj >> objToLoad;
+        // files written before the change log have none
+        nLogGeneration = 0;
+        if (!ssObj.empty())
+            ssObj >> nLogGeneration;
     } catch (std::exception& e) {
         objToLoad.Clear();
         error("%s : Deserialize or I/O error - %s", __func__, e.what());
@@ -386,6 +384,7 @@ void DumpBudgets()
 
 bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
 {
+    LOCK(cs);
     std::string strError = "";
     if (!finalizedBudget.IsValid(strError)) return false;
 
@@ -394,6 +393,7 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
     }
 
     mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+    budgetCacheLog.Append("fbs", CFinalizedBudgetBroadcast(finalizedBudget));
     return true;
 }
 
@@ -410,11 +410,108 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
         return false;
     }
 
-    mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+    CBudgetProposal& budgetProposalAdded = mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal)).first->second;
+    IndexProposal(budgetProposalAdded);
+    budgetCacheLog.Append("mprop", CBudgetProposalBroadcast(budgetProposalAdded));
     LogPrintf("CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
     return true;
 }
 
+void CBudgetManager::IndexProposal(CBudgetProposal& budgetProposal)
+{
+    setProposalsByVotes.insert(make_pair(&budgetProposal, budgetProposal.GetYeas() - budgetProposal.GetNays()));
+}
+
+void CBudgetManager::UnindexProposal(CBudgetProposal& budgetProposal)
+{
+    setProposalsByVotes.erase(make_pair(&budgetProposal, budgetProposal.GetYeas() - budgetProposal.GetNays()));
+}
+
+void CBudgetManager::ReindexProposals()
+{
+    setProposalsByVotes.clear();
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
+    while (it != mapProposals.end()) {
+        IndexProposal((*it).second);
+        ++it;
+    }
+
+    // the votes loaded were not checked against the servicenode list
+    nVotesCheckedListChanges = -1;
+}
+
+// Votes only become valid or invalid as their servicenodes enter and leave
+// the servicenode list, so they are checked again when it has changed
+void CBudgetManager::CleanVotes()
+{
+    int64_t nListChanges = mnodeman.GetListChanges();
+    if (nListChanges == nVotesCheckedListChanges) return;
+
+    LogPrint("mnbudget", "CBudgetManager::CleanVotes - mapProposals cleanup - size: %d\n", mapProposals.size());
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
+    while (it != mapProposals.end()) {
+        UnindexProposal((*it).second);
+        (*it).second.CleanAndRemove(false);
+        IndexProposal((*it).second);
+        ++it;
+    }
+
+    LogPrint("mnbudget", "CBudgetManager::CleanVotes - mapFinalizedBudgets cleanup - size: %d\n", mapFinalizedBudgets.size());
+    std::map<uint256, CFinalizedBudget>::iterator it2 = mapFinalizedBudgets.begin();
+    while (it2 != mapFinalizedBudgets.end()) {
+        (*it2).second.CleanAndRemove(false);
+        ++it2;
+    }
+
+    nVotesCheckedListChanges = nListChanges;
+}
+
+// Forget the votes seen long ago that aren't counted anymore, replaced by
+// newer votes of their servicenodes or never accepted. Those that are still
+// counted stay, they are served to the peers we sync
+void CBudgetManager::PruneSeenVotes()
+{
+    int64_t nExpiration = GetAdjustedTime() - BUDGET_SEEN_VOTE_EXPIRATION;
+
+    LogPrint("mnbudget", "CBudgetManager::PruneSeenVotes - mapSeenServicenodeBudgetVotes cleanup - size: %d\n", mapSeenServicenodeBudgetVotes.size());
+    std::map<uint256, CBudgetVote>::iterator it = mapSeenServicenodeBudgetVotes.begin();
+    while (it != mapSeenServicenodeBudgetVotes.end()) {
+        const CBudgetVote& vote = (*it).second;
+        bool fCounted = false;
+        if (vote.nTime < nExpiration) {
+            std::map<uint256, CBudgetProposal>::iterator itProposal = mapProposals.find(vote.nProposalHash);
+            if (itProposal != mapProposals.end()) {
+                std::map<uint256, CBudgetVote>::iterator itVote = (*itProposal).second.mapVotes.find(vote.vin.prevout.GetHash());
+                fCounted = itVote != (*itProposal).second.mapVotes.end() && (*itVote).second.nTime == vote.nTime && (*itVote).second.nVote == vote.nVote;
+            }
+        }
+
+        if (vote.nTime < nExpiration && !fCounted)
+            mapSeenServicenodeBudgetVotes.erase(it++);
+        else
+            ++it;
+    }
+
+    LogPrint("mnbudget", "CBudgetManager::PruneSeenVotes - mapSeenFinalizedBudgetVotes cleanup - size: %d\n", mapSeenFinalizedBudgetVotes.size());
+    std::map<uint256, CFinalizedBudgetVote>::iterator it2 = mapSeenFinalizedBudgetVotes.begin();
+    while (it2 != mapSeenFinalizedBudgetVotes.end()) {
+        const CFinalizedBudgetVote& vote = (*it2).second;
+        bool fCounted = false;
+        if (vote.nTime < nExpiration) {
+            std::map<uint256, CFinalizedBudget>::iterator itBudget = mapFinalizedBudgets.find(vote.nBudgetHash);
+            if (itBudget != mapFinalizedBudgets.end()) {
+                std::map<uint256, CFinalizedBudgetVote>::iterator itVote = (*itBudget).second.mapVotes.find(vote.vin.prevout.GetHash());
+                fCounted = itVote != (*itBudget).second.mapVotes.end() && (*itVote).second.nTime == vote.nTime;
+            }
+        }
+
+        if (vote.nTime < nExpiration && !fCounted)
+            mapSeenFinalizedBudgetVotes.erase(it2++);
+        else
+            ++it2;
+    }
+}
+
 void CBudgetManager::CheckAndRemove()
 {
     LogPrint("mnbudget", "CBudgetManager::CheckAndRemove\n");
@@ -642,10 +739,10 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 
     std::vector<CBudgetProposal*> vBudgetProposalRet;
 
+    CleanVotes();
+
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
-
         CBudgetProposal* pbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pbudgetProposal);
 
@@ -655,35 +752,23 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
     return vBudgetProposalRet;
 }
 
-//
-// Sort by votes, if there's a tie sort by their feeHash TX
-//
-struct sortProposalsByVotes {
-    bool operator()(const std::pair<CBudgetProposal*, int>& left, const std::pair<CBudgetProposal*, int>& right)
-    {
-        if (left.second != right.second)
-            return (left.second > right.second);
+bool sortProposalsByVotes::operator()(const std::pair<CBudgetProposal*, int>& left, const std::pair<CBudgetProposal*, int>& right) const
+{
+    if (left.second != right.second)
+        return (left.second > right.second);
+    if (left.first->nFeeTXHash != right.first->nFeeTXHash)
         return (left.first->nFeeTXHash > right.first->nFeeTXHash);
-    }
-};
+    return left.first < right.first;
+}
 
 //Need to review this function
 std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
 
-    // ------- Sort budgets by Yes Count
+    // ------- Budgets sorted by Yes Count (setProposalsByVotes)
 
-    std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
-
-    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
-    while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
-        vBudgetPorposalsSort.push_back(make_pair(&((*it).second), (*it).second.GetYeas() - (*it).second.GetNays()));
-        ++it;
-    }
-
-    std::sort(vBudgetPorposalsSort.begin(), vBudgetPorposalsSort.end(), sortProposalsByVotes());
+    CleanVotes();
 
     // ------- Grab The Budgets In Order
 
@@ -696,16 +781,19 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
     int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
     int nBlockEnd = nBlockStart + GetBudgetPaymentCycleBlocks() - 1;
     CAmount nTotalBudget = CBudgetManager::GetTotalBudget(nBlockStart);
+    int nMinNetVotes = mnodeman.CountEnabled(ActiveProtocol()) / 10;
 
 
-    std::vector<std::pair<CBudgetProposal*, int> >::iterator it2 = vBudgetPorposalsSort.begin();
-    while (it2 != vBudgetPorposalsSort.end()) {
+    std::set<std::pair<CBudgetProposal*, int>, sortProposalsByVotes>::iterator it2 = setProposalsByVotes.begin();
+    while (it2 != setProposalsByVotes.end()) {
         CBudgetProposal* pbudgetProposal = (*it2).first;
 
+        //the proposals left have even fewer votes
+        if ((*it2).second <= nMinNetVotes) break;
+
         //prop start/end should be inside this period
         if (pbudgetProposal->fValid && pbudgetProposal->nBlockStart <= nBlockStart &&
             pbudgetProposal->nBlockEnd >= nBlockEnd &&
-            pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > mnodeman.CountEnabled(ActiveProtocol()) / 10 &&
             pbudgetProposal->IsEstablished()) {
             if (pbudgetProposal->GetAmount() + nBudgetAllocated <= nTotalBudget) {
                 pbudgetProposal->SetAllotted(pbudgetProposal->GetAmount());
@@ -873,19 +961,8 @@ void CBudgetManager::NewBlock()
         }
     }
 
-    LogPrintf("CBudgetManager::NewBlock - mapProposals cleanup - size: %d\n", mapProposals.size());
-    std::map<uint256, CBudgetProposal>::iterator it2 = mapProposals.begin();
-    while (it2 != mapProposals.end()) {
-        (*it2).second.CleanAndRemove(false);
-        ++it2;
-    }
-
-    LogPrintf("CBudgetManager::NewBlock - mapFinalizedBudgets cleanup - size: %d\n", mapFinalizedBudgets.size());
-    std::map<uint256, CFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
-    while (it3 != mapFinalizedBudgets.end()) {
-        (*it3).second.CleanAndRemove(false);
-        ++it3;
-    }
+    CleanVotes();
+    PruneSeenVotes();
 
     LogPrintf("CBudgetManager::NewBlock - vecImmatureBudgetProposals cleanup - size: %d\n", vecImmatureBudgetProposals.size());
     std::vector<CBudgetProposalBroadcast>::iterator it4 = vecImmatureBudgetProposals.begin();
@@ -948,9 +1025,18 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
     LOCK(cs_budget);
 
-    if (strCommand == "mnvs") { //Servicenode vote sync
-        uint256 nProp;
-        vRecv >> nProp;
+    if (strCommand == "mnvs" || strCommand == "mnvssum") { //Servicenode vote sync, or of those missing from a summary
+        uint256 nProp = 0;
+        CSyncSetSummary summary;
+        if (strCommand == "mnvs") {
+            vRecv >> nProp;
+        } else {
+            vRecv >> summary;
+            if (!summary.IsValid()) {
+                Misbehaving(pfrom->GetId(), 20);
+                return;
+            }
+        }
 
         if (Params().NetworkID() == CBaseChainParams::MAIN) {
             if (nProp == 0) {
@@ -963,7 +1049,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             }
         }
 
-        Sync(pfrom, nProp);
+        Sync(pfrom, nProp, false, strCommand == "mnvssum" ? &summary : NULL);
         LogPrint("mnbudget", "mnvs - Sent Servicenode votes to peer %i\n", pfrom->GetId());
     }
 
@@ -1195,36 +1281,20 @@ void CBudgetManager::MarkSynced()
 }
 
 
-void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
+void CBudgetManager::GetSyncInventory(uint256 nProp, bool fPartial, std::vector<CInv>& vInvProposals, std::vector<CInv>& vInvFinalized)
 {
-    LOCK(cs);
-
-    /*
-        Sync with a client on the network
-
-        --
-
-        This code checks each of the hash maps for all known budget proposals and finalized budget proposals, then checks them against the
-        budget object to see if they're OK. If all checks pass, we'll send it to the peer.
-
-    */
-
-    int nInvCount = 0;
-
     std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenServicenodeBudgetProposals.begin();
     while (it1 != mapSeenServicenodeBudgetProposals.end()) {
         CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
         if (pbudgetProposal && pbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, (*it1).second.GetHash()));
-            nInvCount++;
+            vInvProposals.push_back(CInv(MSG_BUDGET_PROPOSAL, (*it1).second.GetHash()));
 
             //send votes
             std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
             while (it2 != pbudgetProposal->mapVotes.end()) {
                 if ((*it2).second.fValid) {
                     if ((fPartial && !(*it2).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, (*it2).second.GetHash()));
-                        nInvCount++;
+                        vInvProposals.push_back(CInv(MSG_BUDGET_VOTE, (*it2).second.GetHash()));
                     }
                 }
                 ++it2;
@@ -1233,26 +1303,18 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
         ++it1;
     }
 
-    pfrom->PushMessage("ssc", SERVICENODE_SYNC_BUDGET_PROP, nInvCount);
-
-    LogPrint("mnbudget", "CBudgetManager::Sync - sent %d items\n", nInvCount);
-
-    nInvCount = 0;
-
     std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
     while (it3 != mapSeenFinalizedBudgets.end()) {
         CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
         if (pfinalizedBudget && pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, (*it3).second.GetHash()));
-            nInvCount++;
+            vInvFinalized.push_back(CInv(MSG_BUDGET_FINALIZED, (*it3).second.GetHash()));
 
             //send votes
             std::map<uint256, CFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
             while (it4 != pfinalizedBudget->mapVotes.end()) {
                 if ((*it4).second.fValid) {
                     if ((fPartial && !(*it4).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, (*it4).second.GetHash()));
-                        nInvCount++;
+                        vInvFinalized.push_back(CInv(MSG_BUDGET_FINALIZED_VOTE, (*it4).second.GetHash()));
                     }
                 }
                 ++it4;
@@ -1260,11 +1322,80 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
         }
         ++it3;
     }
+}
+
+void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial, const CSyncSetSummary* psummary)
+{
+    LOCK(cs);
+
+    /*
+        Sync with a client on the network
+
+        --
+
+        This code checks each of the hash maps for all known budget proposals and finalized budget proposals, then checks them against the
+        budget object to see if they're OK. If all checks pass, we'll send it to the peer. With the summary of the peer's items, only
+        those of the buckets where they differ are sent.
+
+    */
+
+    std::vector<CInv> vInvProposals, vInvFinalized;
+    GetSyncInventory(nProp, fPartial, vInvProposals, vInvFinalized);
+
+    CSyncSetSummary summaryOurs;
+    if (psummary) {
+        summaryOurs = CSyncSetSummary(psummary->nKey0, psummary->nKey1, psummary->vBuckets.size());
+        BOOST_FOREACH (const CInv& inv, vInvProposals)
+            summaryOurs.Add(inv.hash);
+        BOOST_FOREACH (const CInv& inv, vInvFinalized)
+            summaryOurs.Add(inv.hash);
+    }
+
+    int nInvCount = 0;
+
+    BOOST_FOREACH (const CInv& inv, vInvProposals) {
+        if (psummary && !summaryOurs.Differs(*psummary, inv.hash)) continue;
+        pfrom->PushInventory(inv);
+        nInvCount++;
+    }
+
+    pfrom->PushMessage("ssc", SERVICENODE_SYNC_BUDGET_PROP, nInvCount);
+
+    LogPrint("mnbudget", "CBudgetManager::Sync - sent %d items\n", nInvCount);
+
+    nInvCount = 0;
+
+    BOOST_FOREACH (const CInv& inv, vInvFinalized) {
+        if (psummary && !summaryOurs.Differs(*psummary, inv.hash)) continue;
+        pfrom->PushInventory(inv);
+        nInvCount++;
+    }
 
     pfrom->PushMessage("ssc", SERVICENODE_SYNC_BUDGET_FIN, nInvCount);
     LogPrint("mnbudget", "CBudgetManager::Sync - sent %d items\n", nInvCount);
 }
 
+void CBudgetManager::RequestSync(CNode* pnode)
+{
+    LOCK(cs);
+
+    if (!servicenodeSync.CanReconcile(pnode)) {
+        uint256 n = 0;
+        pnode->PushMessage("mnvs", n);
+        return;
+    }
+
+    std::vector<CInv> vInvProposals, vInvFinalized;
+    GetSyncInventory(0, false, vInvProposals, vInvFinalized);
+
+    CSyncSetSummary summary(vInvProposals.size() + vInvFinalized.size());
+    BOOST_FOREACH (const CInv& inv, vInvProposals)
+        summary.Add(inv.hash);
+    BOOST_FOREACH (const CInv& inv, vInvFinalized)
+        summary.Add(inv.hash);
+    pnode->PushMessage("mnvssum", summary);
+}
+
 bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string& strError)
 {
     LOCK(cs);
@@ -1288,8 +1419,13 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
         return false;
     }
 
-
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    CBudgetProposal& budgetProposal = mapProposals[vote.nProposalHash];
+    UnindexProposal(budgetProposal);
+    bool fUpdated = budgetProposal.AddOrUpdateVote(vote, strError);
+    IndexProposal(budgetProposal);
+    if (fUpdated)
+        budgetCacheLog.Append("mvote", vote);
+    return fUpdated;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1315,7 +1451,53 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
         return false;
     }
 
-    return mapFinalizedBudgets[vote.nBudgetHash].AddOrUpdateVote(vote, strError);
+    if (!mapFinalizedBudgets[vote.nBudgetHash].AddOrUpdateVote(vote, strError))
+        return false;
+    budgetCacheLog.Append("fbvote", vote);
+    return true;
+}
+
+int CBudgetManager::Snapshot(CDataStream& ss)
+{
+    LOCK(cs);
+
+    ss << *this;
+    return budgetCacheLog.Rotate();
+}
+
+void CBudgetManager::ApplyChange(const std::string& strType, CDataStream& ssChange)
+{
+    LOCK(cs);
+    std::string strError;
+
+    // as received, without the checks of the collateral made then
+    if (strType == "mprop") {
+        CBudgetProposalBroadcast budgetProposalBroadcast;
+        ssChange >> budgetProposalBroadcast;
+        mapSeenServicenodeBudgetProposals.insert(make_pair(budgetProposalBroadcast.GetHash(), budgetProposalBroadcast));
+        if (!mapProposals.count(budgetProposalBroadcast.GetHash())) {
+            CBudgetProposal budgetProposal(budgetProposalBroadcast);
+            IndexProposal(mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal)).first->second);
+        }
+    } else if (strType == "fbs") {
+        CFinalizedBudgetBroadcast finalizedBudgetBroadcast;
+        ssChange >> finalizedBudgetBroadcast;
+        mapSeenFinalizedBudgets.insert(make_pair(finalizedBudgetBroadcast.GetHash(), finalizedBudgetBroadcast));
+        if (!mapFinalizedBudgets.count(finalizedBudgetBroadcast.GetHash())) {
+            CFinalizedBudget finalizedBudget(finalizedBudgetBroadcast);
+            mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+        }
+    } else if (strType == "mvote") {
+        CBudgetVote vote;
+        ssChange >> vote;
+        mapSeenServicenodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        UpdateProposal(vote, NULL, strError);
+    } else if (strType == "fbvote") {
+        CFinalizedBudgetVote vote;
+        ssChange >> vote;
+        mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        UpdateFinalizedBudget(vote, NULL, strError);
+    }
 }
 
 CBudgetProposal::CBudgetProposal()
@@ -1326,6 +1508,7 @@ CBudgetProposal::CBudgetProposal()
     nAmount = 0;
     nTime = 0;
     fValid = true;
+    Tally();
 }
 
 CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn)
@@ -1338,6 +1521,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
     fValid = true;
+    Tally();
 }
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
@@ -1351,6 +1535,10 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nTime = other.nTime;
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
+    for (int i = 0; i < 3; i++) {
+        nVoteCount[i] = other.nVoteCount[i];
+        nValidVoteCount[i] = other.nValidVoteCount[i];
+    }
     fValid = true;
 }
 
@@ -1452,7 +1640,11 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         return false;
     }
 
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.find(hash);
+    if (it != mapVotes.end())
+        CountVote((*it).second, -1);
     mapVotes[hash] = vote;
+    CountVote(vote, 1);
     return true;
 }
 
@@ -1462,23 +1654,42 @@ void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        bool fValidVote = (*it).second.SignatureValid(fSignatureCheck);
+        if (fValidVote != (*it).second.fValid) {
+            CountVote((*it).second, -1);
+            (*it).second.fValid = fValidVote;
+            CountVote((*it).second, 1);
+        }
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio()
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nDelta)
 {
-    int yeas = 0;
-    int nays = 0;
+    if (vote.nVote != VOTE_ABSTAIN && vote.nVote != VOTE_YES && vote.nVote != VOTE_NO) return;
 
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    nVoteCount[vote.nVote] += nDelta;
+    if (vote.fValid) nValidVoteCount[vote.nVote] += nDelta;
+}
+
+void CBudgetProposal::Tally()
+{
+    for (int i = 0; i < 3; i++) {
+        nVoteCount[i] = 0;
+        nValidVoteCount[i] = 0;
+    }
 
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
+        CountVote((*it).second, 1);
         ++it;
     }
+}
+
+double CBudgetProposal::GetRatio()
+{
+    int yeas = nVoteCount[VOTE_YES];
+    int nays = nVoteCount[VOTE_NO];
 
     if (yeas + nays == 0) return 0.0f;
 
@@ -1487,41 +1698,17 @@ double CBudgetProposal::GetRatio()
 
 int CBudgetProposal::GetYeas()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nValidVoteCount[VOTE_YES];
 }
 
 int CBudgetProposal::GetNays()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nValidVoteCount[VOTE_NO];
 }
 
 int CBudgetProposal::GetAbstains()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nValidVoteCount[VOTE_ABSTAIN];
 }
 
 int CBudgetProposal::GetBlockStartCycle()
@@ -1617,7 +1804,7 @@ bool CBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1632,10 +1819,15 @@ bool CBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
     return true;
 }
 
+std::string CBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CServicenode* pmn = mnodeman.Find(vin);
 
@@ -2045,7 +2237,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2060,11 +2252,16 @@ bool CFinalizedBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode
     return true;
 }
 
+std::string CFinalizedBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CServicenode* pmn = mnodeman.Find(vin);
 
@@ -10,6 +10,8 @@
 #include "init.h"
 #include "key.h"
 #include "main.h"
+#include "servicenode-cache.h"
+#include "servicenode-sync.h"
 #include "servicenode.h"
 #include "net.h"
 #include "sync.h"
@@ -35,11 +37,14 @@ static const CAmount PROPOSAL_FEE_TX = (50 * COIN);
 static const CAmount BUDGET_FEE_TX = (50 * COIN);
 static const int64_t BUDGET_FEE_CONFIRMATIONS = 6;
 static const int64_t BUDGET_VOTE_UPDATE_MIN = 60 * 60;
+// Age after which the votes seen but not counted anymore are forgotten
+static const int64_t BUDGET_SEEN_VOTE_EXPIRATION = 60 * 60 * 24;
 
 extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
 extern std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
 
 extern CBudgetManager budget;
+extern CServicenodeCacheLog budgetCacheLog;
 void DumpBudgets();
 
 // Define amount of blocks in budget payment cycle
@@ -69,6 +74,8 @@ public:
     bool Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    //! The message vchSig signs with the servicenode key
+    std::string GetStrMessage() const;
 
     std::string GetVoteString()
     {
@@ -121,6 +128,8 @@ public:
     bool Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    //! The message vchSig signs with the servicenode key
+    std::string GetStrMessage() const;
 
     uint256 GetHash()
     {
@@ -150,6 +159,7 @@ class CBudgetDB
 private:
     boost::filesystem::path pathDB;
     std::string strMagicMessage;
+    int nLogGeneration;
 
 public:
     enum ReadResult {
@@ -163,11 +173,20 @@ public:
     };
 
     CBudgetDB();
-    bool Write(const CBudgetManager& objToSave);
+    bool Write(CBudgetManager& objToSave);
     ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
+    //! Generation of the change log following the file read
+    int GetLogGeneration() const { return nLogGeneration; }
 };
 
 
+//
+// Sort by votes, if there's a tie sort by their feeHash TX
+//
+struct sortProposalsByVotes {
+    bool operator()(const std::pair<CBudgetProposal*, int>& left, const std::pair<CBudgetProposal*, int>& right) const;
+};
+
 //
 // Budget Manager : Contains all proposals for the budget
 //
@@ -178,6 +197,18 @@ private:
     // XX42    map<uint256, CTransaction> mapCollateral;
     map<uint256, uint256> mapCollateralTxids;
 
+    // mapProposals with their net yes votes, in the order GetBudget picks them
+    std::set<std::pair<CBudgetProposal*, int>, sortProposalsByVotes> setProposalsByVotes;
+    // servicenode list changes the votes were last checked against, -1 before
+    int64_t nVotesCheckedListChanges;
+
+    void IndexProposal(CBudgetProposal& budgetProposal);
+    void UnindexProposal(CBudgetProposal& budgetProposal);
+    void ReindexProposals();
+    void CleanVotes();
+    void PruneSeenVotes();
+    void GetSyncInventory(uint256 nProp, bool fPartial, std::vector<CInv>& vInvProposals, std::vector<CInv>& vInvFinalized);
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -197,6 +228,7 @@ public:
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
+        nVotesCheckedListChanges = -1;
     }
 
     void ClearSeen()
@@ -212,7 +244,9 @@ public:
 
     void ResetSync();
     void MarkSynced();
-    void Sync(CNode* node, uint256 nProp, bool fPartial = false);
+    void Sync(CNode* node, uint256 nProp, bool fPartial = false, const CSyncSetSummary* psummary = NULL);
+    //! Ask the peer for the budget, only for the items we're missing when it takes a summary of ours
+    void RequestSync(CNode* pnode);
 
     void Calculate();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
@@ -240,6 +274,12 @@ public:
     void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStake);
 
     void CheckOrphanVotes();
+
+    //! Serialize the budget for budget.dat, returns the generation of the change log following it
+    int Snapshot(CDataStream& ss);
+    //! Replay a proposal, finalized budget or vote from budgetCacheLog
+    void ApplyChange(const std::string& strType, CDataStream& ssChange);
+
     void Clear()
     {
         LOCK(cs);
@@ -253,6 +293,8 @@ public:
         mapSeenFinalizedBudgetVotes.clear();
         mapOrphanServicenodeBudgetVotes.clear();
         mapOrphanFinalizedBudgetVotes.clear();
+        setProposalsByVotes.clear();
+        nVotesCheckedListChanges = -1;
     }
     void CheckAndRemove();
     std::string ToString() const;
@@ -272,6 +314,8 @@ public:
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
+        if (ser_action.ForRead())
+            ReindexProposals();
     }
 };
 
@@ -458,6 +502,15 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    void CountVote(const CBudgetVote& vote, int nDelta);
+    void Tally();
+
+protected:
+    // votes of mapVotes by nVote, all of them and the valid ones, kept as
+    // votes are added and CleanAndRemove changes their validity
+    int nVoteCount[3];
+    int nValidVoteCount[3];
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -549,6 +602,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            Tally();
     }
 };
 
@@ -577,6 +632,10 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        for (int i = 0; i < 3; i++) {
+            swap(first.nVoteCount[i], second.nVoteCount[i]);
+            swap(first.nValidVoteCount[i], second.nValidVoteCount[i]);
+        }
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
@@ -0,0 +1,239 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "servicenode-cache.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "servicenode-budget.h"
+#include "servicenode-payments.h"
+#include "servicenode-sync.h"
+#include "servicenodeman.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+#include <boost/filesystem.hpp>
+
+CServicenodeCacheLog::CServicenodeCacheLog(const std::string& strFileNameIn) : strFileName(strFileNameIn), file(NULL), nGeneration(0), nOldestGeneration(0)
+{
+}
+
+CServicenodeCacheLog::~CServicenodeCacheLog()
+{
+    if (file != NULL)
+        fclose(file);
+}
+
+boost::filesystem::path CServicenodeCacheLog::GetPath(int nGenerationIn) const
+{
+    return GetDataDir() / strprintf("%s.%d.log", strFileName, nGenerationIn);
+}
+
+bool CServicenodeCacheLog::Open(int nGenerationIn)
+{
+    if (file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+    nGeneration = nGenerationIn;
+
+    FILE* fileNew = fopen(GetPath(nGeneration).string().c_str(), "wb");
+    if (fileNew == NULL)
+        return error("%s : Failed to open file %s", __func__, GetPath(nGeneration).string());
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << strFileName;
+    ssHeader << FLATDATA(Params().MessageStart());
+    ssHeader << nGeneration;
+    if (fwrite(&ssHeader[0], 1, ssHeader.size(), fileNew) != ssHeader.size() || fflush(fileNew) != 0) {
+        fclose(fileNew);
+        return error("%s : Failed to write file %s", __func__, GetPath(nGeneration).string());
+    }
+    file = fileNew;
+    return true;
+}
+
+bool CServicenodeCacheLog::Read(int nGenerationIn, std::vector<std::pair<std::string, CDataStream> >& vChanges)
+{
+    boost::filesystem::path path = GetPath(nGenerationIn);
+    FILE* fileIn = fopen(path.string().c_str(), "rb");
+    if (fileIn == NULL)
+        return false;
+
+    std::vector<char> vchData;
+    char buf[65536];
+    size_t nRead;
+    while ((nRead = fread(buf, 1, sizeof(buf), fileIn)) > 0)
+        vchData.insert(vchData.end(), buf, buf + nRead);
+    fclose(fileIn);
+
+    CDataStream ssLog(vchData, SER_DISK, CLIENT_VERSION);
+    unsigned char pchMsgTmp[4];
+    std::string strFileNameTmp;
+    int nGenerationTmp;
+    try {
+        ssLog >> strFileNameTmp;
+        ssLog >> FLATDATA(pchMsgTmp);
+        ssLog >> nGenerationTmp;
+    } catch (const std::exception&) {
+        return error("%s : Invalid header in %s", __func__, path.string());
+    }
+    if (strFileNameTmp != strFileName || memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)) || nGenerationTmp != nGenerationIn)
+        return error("%s : Invalid header in %s", __func__, path.string());
+
+    unsigned int nChanges = 0;
+    while (ssLog.size() >= 2 * sizeof(uint32_t)) {
+        uint32_t nSize, nChecksum;
+        ssLog >> nSize >> nChecksum;
+        if (ssLog.size() < nSize)
+            break;
+
+        CDataStream ssRecord(ssLog.begin(), ssLog.begin() + nSize, SER_DISK, CLIENT_VERSION);
+        ssLog.ignore(nSize);
+        uint256 hash = Hash(ssRecord.begin(), ssRecord.end());
+        if (memcmp(hash.begin(), &nChecksum, sizeof(nChecksum)))
+            break;
+
+        std::string strType;
+        try {
+            ssRecord >> strType;
+        } catch (const std::exception&) {
+            break;
+        }
+        vChanges.push_back(std::make_pair(strType, ssRecord));
+        nChanges++;
+    }
+    if (!ssLog.empty())
+        LogPrintf("%s : %s ends with a torn record, %u bytes dropped\n", __func__, path.string(), ssLog.size());
+
+    LogPrintf("Read %u changes from %s\n", nChanges, path.filename().string());
+    return true;
+}
+
+int CServicenodeCacheLog::ReadLogs(int nGenerationIn, std::vector<std::pair<std::string, CDataStream> >& vChanges)
+{
+    int nGenerationNext = nGenerationIn;
+    while (Read(nGenerationNext, vChanges))
+        nGenerationNext++;
+    return nGenerationNext;
+}
+
+void CServicenodeCacheLog::RemoveStaleLogs(int nOldest, int nEnd)
+{
+    std::string strPrefix = strFileName + ".";
+    std::string strSuffix = ".log";
+    std::vector<boost::filesystem::path> vStale;
+    try {
+        boost::filesystem::directory_iterator end_iter;
+        for (boost::filesystem::directory_iterator dir_iter(GetDataDir()); dir_iter != end_iter; ++dir_iter) {
+            std::string strName = dir_iter->path().filename().string();
+            if (strName.size() <= strPrefix.size() + strSuffix.size() || strName.compare(0, strPrefix.size(), strPrefix) != 0 ||
+                strName.compare(strName.size() - strSuffix.size(), strSuffix.size(), strSuffix) != 0)
+                continue;
+            int32_t nGenerationFile;
+            if (!ParseInt32(strName.substr(strPrefix.size(), strName.size() - strPrefix.size() - strSuffix.size()), &nGenerationFile))
+                continue;
+            if (nGenerationFile < nOldest || nGenerationFile >= nEnd)
+                vStale.push_back(dir_iter->path());
+        }
+    } catch (const boost::filesystem::filesystem_error& e) {
+        error("%s : %s", __func__, e.what());
+    }
+
+    for (unsigned int i = 0; i < vStale.size(); i++) {
+        boost::system::error_code ec;
+        if (boost::filesystem::remove(vStale[i], ec))
+            LogPrintf("Removed stale log %s\n", vStale[i].filename().string());
+    }
+}
+
+void CServicenodeCacheLog::Start(int nOldest, int nGenerationIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    // the logs that weren't replayed would be once the generations caught up with them
+    RemoveStaleLogs(nOldest, nGenerationIn);
+    nOldestGeneration = nOldest;
+    Open(nGenerationIn);
+}
+
+void CServicenodeCacheLog::AppendRecord(const CDataStream& ssRecord)
+{
+    uint256 hash = Hash(ssRecord.begin(), ssRecord.end());
+    uint32_t nChecksum;
+    memcpy(&nChecksum, hash.begin(), sizeof(nChecksum));
+
+    CDataStream ssOut(SER_DISK, CLIENT_VERSION);
+    ssOut << (uint32_t)ssRecord.size() << nChecksum;
+    ssOut.write(&(*ssRecord.begin()), ssRecord.size());
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (file == NULL) return; // not loaded yet, or closed after a failed write
+    // flushed so that only what the OS hadn't written when it crashed is lost
+    if (fwrite(&ssOut[0], 1, ssOut.size(), file) != ssOut.size() || fflush(file) != 0) {
+        error("%s : Failed to write file %s", __func__, GetPath(nGeneration).string());
+        fclose(file);
+        file = NULL;
+    }
+}
+
+int CServicenodeCacheLog::Rotate()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (file == NULL)
+        return nGeneration;
+
+    Open(nGeneration + 1);
+    return nGeneration;
+}
+
+void CServicenodeCacheLog::Prune(int nGenerationIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    for (; nOldestGeneration < nGenerationIn; nOldestGeneration++) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(GetPath(nOldestGeneration), ec);
+    }
+}
+
+bool WriteServicenodeCacheFile(const boost::filesystem::path& path, const CDataStream& ssData)
+{
+    boost::filesystem::path pathTmp = path.string() + ".new";
+
+    // open output file, and associate with CAutoFile
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : Failed to open file %s", __func__, pathTmp.string());
+
+    // Write and commit header, data
+    try {
+        fileout << ssData;
+    } catch (std::exception& e) {
+        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, path))
+        return error("%s : Rename-into-place failed for %s", __func__, path.string());
+    return true;
+}
+
+void ThreadDumpServicenodeCaches()
+{
+    RenameThread("blocknetdx-mncache");
+
+    int64_t nLastDump = GetTime();
+    while (true) {
+        MilliSleep(1000);
+
+        if (GetTime() - nLastDump < SERVICENODES_DUMP_SECONDS) continue;
+        if (!servicenodeSync.IsBlockchainSynced()) continue;
+        nLastDump = GetTime();
+
+        DumpServicenodes();
+        DumpBudgets();
+        DumpServicenodePayments();
+    }
+}
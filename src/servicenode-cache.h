@@ -0,0 +1,103 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SERVICENODE_CACHE_H
+#define SERVICENODE_CACHE_H
+
+#include "clientversion.h"
+#include "streams.h"
+#include "sync.h"
+
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Append-only log of the changes made to one of the servicenode caches
+ * (mncache.dat, mnpayments.dat, budget.dat) since it was last written, so
+ * that a node killed between two dumps doesn't have to sync again what it
+ * had received.
+ *
+ * The logs are numbered by generation. A dump serializes the cache and
+ * starts the next generation under the lock of the cache. The file written
+ * records that generation, and the logs before it are removed once the file
+ * is on disk. On startup, the logs from the generation of the file loaded on
+ * are replayed into the cache, and the changes from there go to a new log.
+ * Any other log is left from an earlier run, like those of a file that was
+ * deleted, and is removed before its generation number comes round again.
+ *
+ * A change is a type, followed by the object serialized as it is sent on the
+ * network. Records carry a checksum so that one torn by a crash ends the
+ * replay.
+ */
+class CServicenodeCacheLog
+{
+private:
+    boost::mutex cs;
+    std::string strFileName;
+    FILE* file;
+    //! generation appended to, and the oldest one still on disk
+    int nGeneration;
+    int nOldestGeneration;
+
+    boost::filesystem::path GetPath(int nGenerationIn) const;
+    bool Open(int nGenerationIn);
+    bool Read(int nGenerationIn, std::vector<std::pair<std::string, CDataStream> >& vChanges);
+    void AppendRecord(const CDataStream& ssRecord);
+    //! Read the logs from a generation on, returns the generation after the last one
+    int ReadLogs(int nGenerationIn, std::vector<std::pair<std::string, CDataStream> >& vChanges);
+    //! Remove the logs outside the generations from nOldest to before nEnd
+    void RemoveStaleLogs(int nOldest, int nEnd);
+    //! Log the changes from here on, the logs from nOldest on being on disk
+    void Start(int nOldest, int nGenerationIn);
+
+public:
+    //! Held while a dump is written, so no dump is written over a newer one
+    CCriticalSection csDump;
+
+    CServicenodeCacheLog(const std::string& strFileNameIn);
+    ~CServicenodeCacheLog();
+
+    //! Replay the changes logged after the file of a generation was written into the cache it was loaded in, then log those from there
+    template <typename T>
+    void Load(int nGenerationIn, T& obj)
+    {
+        std::vector<std::pair<std::string, CDataStream> > vChanges;
+        int nGenerationNext = ReadLogs(nGenerationIn, vChanges);
+        for (unsigned int i = 0; i < vChanges.size(); i++) {
+            try {
+                obj.ApplyChange(vChanges[i].first, vChanges[i].second);
+            } catch (const std::exception&) {
+                // checksummed, but written by another version
+            }
+        }
+        Start(nGenerationIn, nGenerationNext);
+    }
+
+    //! Append a change, once the log has been loaded
+    template <typename T>
+    void Append(const std::string& strType, const T& obj)
+    {
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        ssRecord << strType << obj;
+        AppendRecord(ssRecord);
+    }
+
+    //! Start the generation of the changes after a dump being taken, returns it
+    int Rotate();
+    //! Remove the logs before the generation of a dump written
+    void Prune(int nGenerationIn);
+};
+
+//! Write a cache file over the previous one, so that a crash leaves one or the other
+bool WriteServicenodeCacheFile(const boost::filesystem::path& path, const CDataStream& ssData);
+
+//! Dump the servicenode caches every SERVICENODES_DUMP_SECONDS, returns when interrupted
+void ThreadDumpServicenodeCaches();
+
+#endif // SERVICENODE_CACHE_H
@@ -18,6 +18,7 @@
 
 /** Object for who's going to get paid on which blocks */
 CServicenodePayments servicenodePayments;
+CServicenodeCacheLog servicenodePaymentsCacheLog("mnpayments");
 
 CCriticalSection cs_vecPayments;
 CCriticalSection cs_mapServicenodeBlocks;
@@ -31,33 +32,27 @@ CServicenodePaymentDB::CServicenodePaymentDB()
 {
     pathDB = GetDataDir() / "mnpayments.dat";
     strMagicMessage = "ServicenodePayments";
+    nLogGeneration = 0;
 }
 
-bool CServicenodePaymentDB::Write(const CServicenodePayments& objToSave)
+bool CServicenodePaymentDB::Write(CServicenodePayments& objToSave)
 {
+    LOCK(servicenodePaymentsCacheLog.csDump);
+
     int64_t nStart = GetTimeMillis();
 
     // serialize, checksum data up to that point, then append checksum
     CDataStream ssObj(SER_DISK, CLIENT_VERSION);
     ssObj << strMagicMessage;                   // servicenode cache file specific magic message
     ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
+    int nGeneration = objToSave.Snapshot(ssObj);
+    ssObj << nGeneration;                       // change log following the file
     uint256 hash = Hash(ssObj.begin(), ssObj.end());
     ssObj << hash;
 
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
+    if (!WriteServicenodeCacheFile(pathDB, ssObj))
+        return false;
+    servicenodePaymentsCacheLog.Prune(nGeneration);
 
     LogPrintf("Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
 
@@ -128,6 +123,10 @@ CServicenodePaymentDB::ReadResult CServicenodePaymentDB::Read(CServicenodePaymen
 
         // de-serialize data into CServicenodePayments object
         ssObj >> objToLoad;
+        // files written before the change log have none
+        nLogGeneration = 0;
+        if (!ssObj.empty())
+            ssObj >> nLogGeneration;
     } catch (std::exception& e) {
         objToLoad.Clear();
         error("%s : Deserialize or I/O error - %s", __func__, e.what());
@@ -421,9 +420,7 @@ bool CServicenodePaymentWinner::Sign(CKey& keyServicenode, CPubKey& pubKeyServic
     std::string errorMessage;
     std::string strServiceNodeSignMessage;
 
-    std::string strMessage = vinServicenode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CServicenodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -501,10 +498,28 @@ bool CServicenodePayments::AddWinningServicenode(CServicenodePaymentWinner& winn
     }
 
     mapServicenodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    servicenodePaymentsCacheLog.Append("mnw", winnerIn);
 
     return true;
 }
 
+int CServicenodePayments::Snapshot(CDataStream& ss)
+{
+    LOCK2(cs_mapServicenodePayeeVotes, cs_mapServicenodeBlocks);
+
+    ss << *this;
+    return servicenodePaymentsCacheLog.Rotate();
+}
+
+void CServicenodePayments::ApplyChange(const std::string& strType, CDataStream& ssChange)
+{
+    if (strType == "mnw") {
+        CServicenodePaymentWinner winner;
+        ssChange >> winner;
+        AddWinningServicenode(winner);
+    }
+}
+
 bool CServicenodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -740,14 +755,19 @@ void CServicenodePaymentWinner::Relay()
     RelayInv(inv);
 }
 
+std::string CServicenodePaymentWinner::GetStrMessage() const
+{
+    return vinServicenode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CServicenodePaymentWinner::SignatureValid()
 {
     CServicenode* pmn = mnodeman.Find(vinServicenode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinServicenode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetStrMessage();
 
         std::string errorMessage = "";
         if (!obfuScationSigner.VerifyMessage(pmn->pubKeyServicenode, vchSig, strMessage, errorMessage)) {
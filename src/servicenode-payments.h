@@ -9,6 +9,7 @@
 #include "key.h"
 #include "main.h"
 #include "servicenode.h"
+#include "servicenode-cache.h"
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -22,6 +23,7 @@ class CServicenodePaymentWinner;
 class CServicenodeBlockPayees;
 
 extern CServicenodePayments servicenodePayments;
+extern CServicenodeCacheLog servicenodePaymentsCacheLog;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
@@ -41,6 +43,7 @@ class CServicenodePaymentDB
 private:
     boost::filesystem::path pathDB;
     std::string strMagicMessage;
+    int nLogGeneration;
 
 public:
     enum ReadResult {
@@ -54,8 +57,9 @@ public:
     };
 
     CServicenodePaymentDB();
-    bool Write(const CServicenodePayments& objToSave);
+    bool Write(CServicenodePayments& objToSave);
     ReadResult Read(CServicenodePayments& objToLoad, bool fDryRun = false);
+    int GetLogGeneration() const { return nLogGeneration; }
 };
 
 class CServicenodePayee
@@ -196,6 +200,8 @@ public:
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
     void Relay();
+    //! The message vchSig signs with the servicenode key
+    std::string GetStrMessage() const;
 
     void AddPayee(CScript payeeIn)
     {
@@ -257,6 +263,11 @@ public:
     bool AddWinningServicenode(CServicenodePaymentWinner& winner);
     bool ProcessBlock(int nBlockHeight);
 
+    // serialize the votes for mnpayments.dat, returns the generation of the change log following them
+    int Snapshot(CDataStream& ss);
+    // replay a vote from servicenodePaymentsCacheLog
+    void ApplyChange(const std::string& strType, CDataStream& ssChange);
+
     void Sync(CNode* node, int nCountNeeded);
     void CleanPaymentList();
     int LastPayment(CServicenode& mn);
@@ -0,0 +1,139 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "servicenode-sigcheck.h"
+
+#include "hash.h"
+#include "obfuscation.h"
+#include "servicenode-budget.h"
+#include "servicenode-payments.h"
+#include "servicenodeman.h"
+#include "swifttx.h"
+#include "util.h"
+
+CServicenodeSigCheckQueue servicenodeSigCheckQueue;
+
+// VerifyMessage only compares key ids, so a signature is valid for all the keys of an id
+uint256 CServicenodeSigCheckQueue::GetSignatureKey(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << pubkey.GetID() << vchSig << strMessage;
+    return ss.GetHash();
+}
+
+void CServicenodeSigCheckQueue::Thread()
+{
+    RenameThread("blocknetdx-mnsigcheck");
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers++;
+    }
+    try {
+        while (true) {
+            CJob job;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (queue.empty())
+                    cond.wait(lock);
+                job = queue.front();
+                queue.pop_front();
+            }
+            try {
+                Check(job);
+            } catch (const std::exception&) {
+                // ProcessMessage reports malformed messages
+            }
+        }
+    } catch (boost::thread_interrupted) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers--;
+        throw;
+    }
+}
+
+bool CServicenodeSigCheckQueue::Push(const std::string& strCommand, const CDataStream& vRecv)
+{
+    if (strCommand != "mnb" && strCommand != "mnp" && strCommand != "mnw" && strCommand != "mvote" && strCommand != "fbvote" &&
+        strCommand != "txlvote")
+        return false;
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (nWorkers == 0 || queue.size() >= MAX_SIGCHECK_QUEUE_SIZE)
+            return false;
+        CJob job;
+        job.strCommand = strCommand;
+        job.pmsg.reset(new CDataStream(vRecv));
+        queue.push_back(job);
+    }
+    cond.notify_one();
+    return true;
+}
+
+bool CServicenodeSigCheckQueue::IsVerified(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage)
+{
+    uint256 key = GetSignatureKey(pubkey, vchSig, strMessage);
+    bool fValid = false;
+    boost::unique_lock<boost::mutex> lock(cs);
+    return verified.get(key, fValid) && fValid;
+}
+
+void CServicenodeSigCheckQueue::SetVerified(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage)
+{
+    uint256 key = GetSignatureKey(pubkey, vchSig, strMessage);
+    boost::unique_lock<boost::mutex> lock(cs);
+    verified.insert(key, true);
+}
+
+void CServicenodeSigCheckQueue::ClearVerified()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    verified.clear();
+}
+
+void CServicenodeSigCheckQueue::Check(const CJob& job)
+{
+    CDataStream& vRecv = *job.pmsg;
+    CPubKey pubKeyServicenode;
+
+    if (job.strCommand == "mnb") {
+        CServicenodeBroadcast mnb;
+        vRecv >> mnb;
+        Verify(mnb.pubKeyCollateralAddress, mnb.sig, mnb.GetStrMessage());
+        Verify(mnb.pubKeyServicenode, mnb.lastPing.vchSig, mnb.lastPing.GetStrMessage());
+    } else if (job.strCommand == "mnp") {
+        CServicenodePing mnp;
+        vRecv >> mnp;
+        if (mnodeman.GetPubKeyServicenode(mnp.vin, pubKeyServicenode))
+            Verify(pubKeyServicenode, mnp.vchSig, mnp.GetStrMessage());
+    } else if (job.strCommand == "mnw") {
+        CServicenodePaymentWinner winner;
+        vRecv >> winner;
+        if (mnodeman.GetPubKeyServicenode(winner.vinServicenode, pubKeyServicenode))
+            Verify(pubKeyServicenode, winner.vchSig, winner.GetStrMessage());
+    } else if (job.strCommand == "mvote") {
+        CBudgetVote vote;
+        vRecv >> vote;
+        if (mnodeman.GetPubKeyServicenode(vote.vin, pubKeyServicenode))
+            Verify(pubKeyServicenode, vote.vchSig, vote.GetStrMessage());
+    } else if (job.strCommand == "fbvote") {
+        CFinalizedBudgetVote vote;
+        vRecv >> vote;
+        if (mnodeman.GetPubKeyServicenode(vote.vin, pubKeyServicenode))
+            Verify(pubKeyServicenode, vote.vchSig, vote.GetStrMessage());
+    } else if (job.strCommand == "txlvote") {
+        CConsensusVote vote;
+        vRecv >> vote;
+        if (mnodeman.GetPubKeyServicenode(vote.vinServicenode, pubKeyServicenode))
+            Verify(pubKeyServicenode, vote.vchServiceNodeSignature, vote.GetStrMessage());
+    }
+}
+
+void CServicenodeSigCheckQueue::Verify(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage)
+{
+    // VerifyMessage remembers the signature when it is valid
+    std::vector<unsigned char> vchSigCopy(vchSig);
+    std::string errorMessage;
+    obfuScationSigner.VerifyMessage(pubkey, vchSigCopy, strMessage, errorMessage);
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SERVICENODE_SIGCHECK_H
+#define SERVICENODE_SIGCHECK_H
+
+#include "lrucache.h"
+#include "pubkey.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+//! Messages waiting for their signatures to be checked above which no more are queued
+static const unsigned int MAX_SIGCHECK_QUEUE_SIZE = 10000;
+//! Number of valid message signatures remembered
+static const unsigned int SIGCHECK_CACHE_SIZE = 100000;
+
+/**
+ * Checks the signatures of servicenode broadcasts and pings, payment winner
+ * votes, budget votes and SwiftTX lock votes on worker threads, while the
+ * messages wait behind the others of their peer. Messages are still processed
+ * one by one in the order they arrived, and CObfuScationSigner::VerifyMessage looks up the
+ * signatures found valid here before doing the recovery itself. Signatures
+ * made with a servicenode key can only be checked ahead once the servicenode
+ * is known, the others are left to the message thread.
+ *
+ * The verified signatures are kept by a cache shared by all callers of
+ * VerifyMessage, so messages relayed by several peers or checked again later
+ * aren't verified twice either.
+ */
+class CServicenodeSigCheckQueue
+{
+private:
+    //! A message to check, and its command
+    struct CJob {
+        std::string strCommand;
+        boost::shared_ptr<CDataStream> pmsg;
+    };
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<CJob> queue;
+    int nWorkers;
+    //! signatures found valid, by GetSignatureKey
+    lrucache<uint256, bool> verified;
+
+    static uint256 GetSignatureKey(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage);
+    void Check(const CJob& job);
+    void Verify(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage);
+
+public:
+    CServicenodeSigCheckQueue() : nWorkers(0), verified(SIGCHECK_CACHE_SIZE) {}
+
+    //! Worker thread loop, returns when interrupted
+    void Thread();
+
+    //! Queue a message whose signatures can be checked ahead, returns false when it is not going to be checked
+    bool Push(const std::string& strCommand, const CDataStream& vRecv);
+
+    //! Whether the signature of the message was found valid for the key
+    bool IsVerified(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage);
+    //! Remember a valid signature
+    void SetVerified(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage);
+    //! Forget all valid signatures
+    void ClearVerified();
+};
+
+extern CServicenodeSigCheckQueue servicenodeSigCheckQueue;
+
+#endif // SERVICENODE_SIGCHECK_H
@@ -14,11 +14,33 @@
 #include "spork.h"
 #include "util.h"
 #include "addrman.h"
+#include "hash.h"
+#include "random.h"
 // clang-format on
 
 class CServicenodeSync;
 CServicenodeSync servicenodeSync;
 
+CSyncSetSummary::CSyncSetSummary(size_t nItems)
+{
+    GetRandBytes((unsigned char*)&nKey0, sizeof(nKey0));
+    GetRandBytes((unsigned char*)&nKey1, sizeof(nKey1));
+    size_t nBuckets = nItems / SYNC_SUMMARY_BUCKET_ITEMS + 1;
+    vBuckets.assign(std::min(nBuckets, (size_t)SYNC_SUMMARY_MAX_BUCKETS), 0);
+}
+
+void CSyncSetSummary::Add(const uint256& hash)
+{
+    uint64_t nItemHash = SipHashUint256(nKey0, nKey1, hash);
+    vBuckets[GetBucket(nItemHash)] ^= nItemHash;
+}
+
+bool CSyncSetSummary::Differs(const CSyncSetSummary& other, const uint256& hash) const
+{
+    unsigned int nBucket = GetBucket(SipHashUint256(nKey0, nKey1, hash));
+    return vBuckets[nBucket] != other.vBuckets[nBucket];
+}
+
 CServicenodeSync::CServicenodeSync()
 {
     Reset();
@@ -180,7 +202,12 @@ std::string CServicenodeSync::GetSyncStatus()
     return "";
 }
 
-void CServicenodeSync::ProcessMessage(CNode* /*pfrom*/, std::string& strCommand, CDataStream& vRecv)
+bool CServicenodeSync::CanReconcile(const CNode* pnode)
+{
+    return pnode->nVersion >= SYNC_RECONCILE_VERSION;
+}
+
+void CServicenodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (strCommand == "ssc") { //Sync status count
         int nItemID;
@@ -195,6 +222,8 @@ void CServicenodeSync::ProcessMessage(CNode* /*pfrom*/, std::string& strCommand,
             if (nItemID != RequestedServicenodeAssets) return;
             sumServicenodeList += nCount;
             countServicenodeList++;
+            // the count ends a reconciled list, which may have had nothing we're missing
+            if (CanReconcile(pfrom)) lastServicenodeList = GetTime();
             break;
         case (SERVICENODE_SYNC_MNW):
             if (nItemID != RequestedServicenodeAssets) return;
@@ -205,11 +234,13 @@ void CServicenodeSync::ProcessMessage(CNode* /*pfrom*/, std::string& strCommand,
             if (RequestedServicenodeAssets != SERVICENODE_SYNC_BUDGET) return;
             sumBudgetItemProp += nCount;
             countBudgetItemProp++;
+            if (CanReconcile(pfrom)) lastBudgetItem = GetTime();
             break;
         case (SERVICENODE_SYNC_BUDGET_FIN):
             if (RequestedServicenodeAssets != SERVICENODE_SYNC_BUDGET) return;
             sumBudgetItemFin += nCount;
             countBudgetItemFin++;
+            if (CanReconcile(pfrom)) lastBudgetItem = GetTime();
             break;
         }
 
@@ -273,8 +304,7 @@ void CServicenodeSync::Process()
             } else if (RequestedServicenodeAttempt < 6) {
                 int nMnCount = mnodeman.CountEnabled();
                 pnode->PushMessage("mnget", nMnCount); //sync payees
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync servicenode votes
+                budget.RequestSync(pnode); //sync servicenode votes
             } else {
                 RequestedServicenodeAssets = SERVICENODE_SYNC_FINISHED;
             }
@@ -398,8 +428,7 @@ void CServicenodeSync::Process()
 
                 if (RequestedServicenodeAttempt >= SERVICENODE_SYNC_THRESHOLD * 3) return;
 
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync servicenode votes
+                budget.RequestSync(pnode); //sync servicenode votes
                 RequestedServicenodeAttempt++;
 
                 return;
@@ -6,6 +6,14 @@
 #ifndef SERVICENODE_SYNC_H
 #define SERVICENODE_SYNC_H
 
+#include "serialize.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
 #define SERVICENODE_SYNC_INITIAL 0
 #define SERVICENODE_SYNC_SPORKS 1
 #define SERVICENODE_SYNC_LIST 2
@@ -19,9 +27,55 @@
 #define SERVICENODE_SYNC_TIMEOUT 5
 #define SERVICENODE_SYNC_THRESHOLD 2
 
+//! Items of a set summary per bucket
+static const unsigned int SYNC_SUMMARY_BUCKET_ITEMS = 8;
+//! Maximum number of buckets of a set summary
+static const unsigned int SYNC_SUMMARY_MAX_BUCKETS = 65536;
+
+class CNode;
 class CServicenodeSync;
 extern CServicenodeSync servicenodeSync;
 
+/**
+ * Summary of a set of items sent along a sync request ('dsegsum', 'mnvssum'),
+ * so the peer only announces the items of the buckets where its own set
+ * differs rather than all of them. The item hashes are spread over buckets
+ * under a random key, each bucket summarized by the xor of the keyed hashes
+ * of its items, about a byte per item. A node restarting with most of the
+ * items gets the few buckets with the others, a new node everything.
+ */
+class CSyncSetSummary
+{
+public:
+    uint64_t nKey0;
+    uint64_t nKey1;
+    std::vector<uint64_t> vBuckets;
+
+    CSyncSetSummary() : nKey0(0), nKey1(0) {}
+    //! An empty summary under a random key, sized for nItems items
+    explicit CSyncSetSummary(size_t nItems);
+    //! An empty summary under the key and with the buckets of a peer's
+    CSyncSetSummary(uint64_t nKey0In, uint64_t nKey1In, size_t nBuckets) : nKey0(nKey0In), nKey1(nKey1In), vBuckets(nBuckets, 0) {}
+
+    bool IsValid() const { return !vBuckets.empty() && vBuckets.size() <= SYNC_SUMMARY_MAX_BUCKETS; }
+    void Add(const uint256& hash);
+    //! Whether the bucket of the item differs in a summary under the same key
+    bool Differs(const CSyncSetSummary& other, const uint256& hash) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nKey0);
+        READWRITE(nKey1);
+        READWRITE(vBuckets);
+    }
+
+private:
+    unsigned int GetBucket(uint64_t nItemHash) const { return (nItemHash >> 32) % vBuckets.size(); }
+};
+
 //
 // CServicenodeSync : Sync servicenode assets in stages
 //
@@ -65,6 +119,8 @@ public:
     void GetNextAsset();
     std::string GetSyncStatus();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+    //! Whether the peer is asked for the summarized items it has that we're missing
+    static bool CanReconcile(const CNode* pnode);
     bool IsBudgetFinEmpty();
     bool IsBudgetPropEmpty();
 
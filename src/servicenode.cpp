@@ -5,6 +5,7 @@
 
 #include "servicenode.h"
 #include "addrman.h"
+#include "blockhashcache.h"
 #include "servicenodeman.h"
 #include "obfuscation.h"
 #include "sync.h"
@@ -15,48 +16,21 @@
 
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenServicenodeScanningErrors;
-// cache block hashes as we calculate them
-std::map<int64_t, uint256> mapCacheBlockHashes;
 
-//Get the last hash that matches the modulus given. Processed in reverse order
+//Get the hash of the block before nBlockHeight, of the tip's parent for 0 and of the tip for negative heights
 bool GetBlockHash(uint256& hash, int nBlockHeight)
 {
-    if (chainActive.Tip() == NULL) return false;
+    int nTipHeight = blockHashCache.Height();
+    if (nTipHeight <= 0 || nTipHeight + 1 < nBlockHeight) return false;
 
     if (nBlockHeight == 0)
-        nBlockHeight = chainActive.Tip()->nHeight;
-
-    if (mapCacheBlockHashes.count(nBlockHeight)) {
-        hash = mapCacheBlockHashes[nBlockHeight];
-        return true;
-    }
-
-    const CBlockIndex* BlockLastSolved = chainActive.Tip();
-    const CBlockIndex* BlockReading = chainActive.Tip();
+        nBlockHeight = nTipHeight;
 
-    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || chainActive.Tip()->nHeight + 1 < nBlockHeight) return false;
+    int nHeight = nBlockHeight > 0 ? nBlockHeight - 1 : nTipHeight;
+    // the genesis block doesn't count
+    if (nHeight <= 0) return false;
 
-    int nBlocksAgo = 0;
-    if (nBlockHeight > 0) nBlocksAgo = (chainActive.Tip()->nHeight + 1) - nBlockHeight;
-    assert(nBlocksAgo >= 0);
-
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if (n >= nBlocksAgo) {
-            hash = BlockReading->GetBlockHash();
-            mapCacheBlockHashes[nBlockHeight] = hash;
-            return true;
-        }
-        n++;
-
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
-    }
-
-    return false;
+    return blockHashCache.GetHash(nHeight, hash);
 }
 
 CServicenode::CServicenode()
@@ -83,6 +57,8 @@ CServicenode::CServicenode()
     lastTimeChecked               = 0;
     nLastDsee                     = 0; // temporary, do not save. Remove after migration to v12
     nLastDseep                    = 0; // temporary, do not save. Remove after migration to v12
+    fCollateralChecked            = false;
+    fCollateralSpent              = false;
 }
 
 CServicenode::CServicenode(const CServicenode& other)
@@ -110,6 +86,8 @@ CServicenode::CServicenode(const CServicenode& other)
     nLastDsee                     = other.nLastDsee;  // temporary, do not save. Remove after migration to v12
     nLastDseep                    = other.nLastDseep; // temporary, do not save. Remove after migration to v12
     connectedWallets              = other.connectedWallets;
+    fCollateralChecked            = other.fCollateralChecked;
+    fCollateralSpent              = other.fCollateralSpent;
 }
 
 CServicenode::CServicenode(const CServicenodeBroadcast& mnb)
@@ -137,6 +115,8 @@ CServicenode::CServicenode(const CServicenodeBroadcast& mnb)
     nLastDsee                     = 0; // temporary, do not save. Remove after migration to v12
     nLastDseep                    = 0; // temporary, do not save. Remove after migration to v12
     connectedWallets              = mnb.connectedWallets;
+    fCollateralChecked            = false;
+    fCollateralSpent              = false;
 }
 
 //
@@ -172,7 +152,7 @@ bool CServicenode::UpdateFromNewBroadcast(CServicenodeBroadcast& mnb)
 //
 uint256 CServicenode::CalculateScore(int /*mod*/, int64_t nBlockHeight)
 {
-    if (chainActive.Tip() == NULL) return 0;
+    if (blockHashCache.Height() < 0) return 0;
 
     uint256 hash = 0;
     uint256 aux = vin.prevout.hash + vin.prevout.n;
@@ -196,6 +176,19 @@ uint256 CServicenode::CalculateScore(int /*mod*/, int64_t nBlockHeight)
     return r;
 }
 
+// Whether the output is unspent in the UTXO set and the memory pool
+static bool IsCollateralUnspent(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_main);
+
+    CCoins coins;
+    if (!pcoinsTip->GetCoins(outpoint.hash, coins) || !coins.IsAvailable(outpoint.n))
+        return false;
+
+    LOCK(mempool.cs);
+    return !mempool.mapNextTx.count(outpoint);
+}
+
 void CServicenode::Check(bool forceCheck)
 {
     if (ShutdownRequested()) return;
@@ -219,20 +212,19 @@ void CServicenode::Check(bool forceCheck)
     }
 
     if (!unitTest) {
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut(SERVICENODE_ACCEPTABLE_INPUTS_CHECK_AMOUNT * COIN, obfuScationPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-
-        {
+        // the collateral is looked up once, later spends are notified to the
+        // servicenode manager (CServicenodeMan::SyncTransaction)
+        if (!fCollateralChecked) {
             TRY_LOCK(cs_main, lockMain);
             if (!lockMain) return;
 
-            if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
-                activeState = SERVICENODE_VIN_SPENT;
-                return;
-            }
+            fCollateralSpent = !IsCollateralUnspent(vin.prevout);
+            fCollateralChecked = true;
+        }
+
+        if (fCollateralSpent) {
+            activeState = SERVICENODE_VIN_SPENT;
+            return;
         }
     }
 
@@ -512,9 +504,7 @@ bool CServicenodeBroadcast::CheckAndUpdate(int& nDos)
         return false;
     }
 
-    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
-    std::string vchPubKey2(pubKeyServicenode.begin(), pubKeyServicenode.end());
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetStrMessage();
 
     if (protocolVersion < servicenodePayments.GetMinServicenodePaymentsProto()) {
         LogPrintf("mnb - ignoring outdated Servicenode %s protocol version %d\n", vin.prevout.hash.ToString(), protocolVersion);
@@ -578,7 +568,7 @@ bool CServicenodeBroadcast::CheckAndUpdate(int& nDos)
     if (pmn->pubKeyCollateralAddress == pubKeyCollateralAddress && !pmn->IsBroadcastedWithin(SERVICENODE_MIN_MNB_SECONDS)) {
         //take the newest entry
         LogPrint("servicenode", "mnb - Got updated entry for %s\n", vin.prevout.hash.ToString());
-        if (pmn->UpdateFromNewBroadcast((*this))) {
+        if (mnodeman.UpdateFromNewBroadcast(*pmn, *this)) {
             pmn->Check();
             if (pmn->IsEnabled()) Relay();
         }
@@ -671,6 +661,13 @@ bool CServicenodeBroadcast::CheckInputsAndAdd(int& nDoS)
     return true;
 }
 
+std::string CServicenodeBroadcast::GetStrMessage() const
+{
+    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
+    std::string vchPubKey2(pubKeyServicenode.begin(), pubKeyServicenode.end());
+    return addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+}
+
 void CServicenodeBroadcast::Relay()
 {
     CInv inv(MSG_SERVICENODE_ANNOUNCE, GetHash());
@@ -681,12 +678,9 @@ bool CServicenodeBroadcast::Sign(const CKey & keyCollateralAddress)
 {
     std::string errorMessage;
 
-    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
-    std::string vchPubKey2(pubKeyServicenode.begin(), pubKeyServicenode.end());
-
     sigTime = GetAdjustedTime();
 
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, sig, keyCollateralAddress)) {
         LogPrintf("CServicenodeBroadcast::Sign() - Error: %s\n", errorMessage);
@@ -708,7 +702,8 @@ CServicenodePing::CServicenodePing() : sigTime(0)
 CServicenodePing::CServicenodePing(const CTxIn & newVin)
 {
     vin = newVin;
-    blockHash = chainActive[chainActive.Height() - 12]->GetBlockHash();
+    blockHash = 0;
+    blockHashCache.GetHash(blockHashCache.Height() - 12, blockHash);
     sigTime = GetAdjustedTime();
     vchSig = std::vector<unsigned char>();
 }
@@ -720,7 +715,7 @@ bool CServicenodePing::Sign(const CKey& keyServicenode, const CPubKey & pubKeySe
     // std::string strServiceNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CServicenodePing::Sign() - Error: %s\n", errorMessage);
@@ -760,7 +755,7 @@ bool CServicenodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
         // update only if there is no known ping for this servicenode or
         // last ping was more then SERVICENODE_MIN_MNP_SECONDS-60 ago comparing to this one
         if (!pmn->IsPingedWithin(SERVICENODE_MIN_MNP_SECONDS - 60, sigTime)) {
-            std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+            std::string strMessage = GetStrMessage();
 
             std::string errorMessage = "";
             if (!obfuScationSigner.VerifyMessage(pmn->pubKeyServicenode, vchSig, strMessage, errorMessage)) {
@@ -794,6 +789,7 @@ bool CServicenodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
             if (mnodeman.mapSeenServicenodeBroadcast.count(hash)) {
                 mnodeman.mapSeenServicenodeBroadcast[hash].lastPing = *this;
             }
+            mnodeman.LogUpdate(*pmn);
 
             pmn->Check(true);
             if (!pmn->IsEnabled()) return false;
@@ -812,6 +808,11 @@ bool CServicenodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
     return false;
 }
 
+std::string CServicenodePing::GetStrMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 void CServicenodePing::Relay()
 {
     CInv inv(MSG_SERVICENODE_PING, GetHash());
@@ -27,7 +27,6 @@ using namespace std;
 class CServicenode;
 class CServicenodeBroadcast;
 class CServicenodePing;
-extern map<int64_t, uint256> mapCacheBlockHashes;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
@@ -62,6 +61,8 @@ public:
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true);
     bool Sign(const CKey & keyServicenode, const CPubKey & pubKeyServicenode);
     void Relay();
+    /// The message vchSig signs with the servicenode key
+    std::string GetStrMessage() const;
 
     uint256 GetHash()
     {
@@ -149,6 +150,12 @@ public:
     int64_t nLastDsee;  // temporary, do not save. Remove after migration to v12
     int64_t nLastDseep; // temporary, do not save. Remove after migration to v12
 
+    // whether the collateral was looked up in the UTXO set and the memory pool since this
+    // entry entered the list, and found spent there or by a transaction of a later
+    // notification. Not saved, the lookup is done again after a restart.
+    bool fCollateralChecked;
+    bool fCollateralSpent;
+
     CServicenode();
     CServicenode(const CServicenode& other);
     CServicenode(const CServicenodeBroadcast& mnb);
@@ -178,6 +185,8 @@ public:
         swap(first.nScanningErrorCount, second.nScanningErrorCount);
         swap(first.nLastScanningErrorBlockHeight, second.nLastScanningErrorBlockHeight);
         swap(first.connectedWallets, second.connectedWallets);
+        swap(first.fCollateralChecked, second.fCollateralChecked);
+        swap(first.fCollateralSpent, second.fCollateralSpent);
     }
 
     CServicenode& operator=(CServicenode from)
@@ -309,6 +318,8 @@ public:
     bool CheckInputsAndAdd(int& nDos);
     bool Sign(const CKey & keyCollateralAddress);
     void Relay();
+    /// The message sig signs with the collateral key
+    std::string GetStrMessage() const;
 
     ADD_SERIALIZE_METHODS;
 
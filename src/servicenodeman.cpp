@@ -10,11 +10,14 @@
 #include "obfuscation.h"
 #include "spork.h"
 #include "util.h"
+#include "hash.h"
+#include "random.h"
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
 /** Servicenode manager */
 CServicenodeMan mnodeman;
+CServicenodeCacheLog servicenodeCacheLog("mncache");
 
 struct CompareLastPaid {
     bool operator()(const pair<int64_t, CTxIn>& t1,
@@ -32,6 +35,14 @@ struct CompareScoreTxIn {
     }
 };
 
+struct CompareScoreTxInHigher {
+    bool operator()(const pair<int64_t, CTxIn>& t1,
+        const pair<int64_t, CTxIn>& t2) const
+    {
+        return t1.first > t2.first;
+    }
+};
+
 struct CompareScoreMN {
     bool operator()(const pair<int64_t, CServicenode>& t1,
         const pair<int64_t, CServicenode>& t2) const
@@ -40,6 +51,36 @@ struct CompareScoreMN {
     }
 };
 
+//
+// CServicenodeIndexHasher
+//
+
+CServicenodeIndexHasher::CServicenodeIndexHasher()
+{
+    GetRandBytes((unsigned char*)&k0, sizeof(k0));
+    GetRandBytes((unsigned char*)&k1, sizeof(k1));
+}
+
+size_t CServicenodeIndexHasher::operator()(const COutPoint& outpoint) const
+{
+    return SipHashUint256(k0, k1 ^ outpoint.n, outpoint.hash);
+}
+
+size_t CServicenodeIndexHasher::operator()(const CKeyID& keyID) const
+{
+    uint256 val;
+    memcpy(val.begin(), keyID.begin(), keyID.size());
+    return SipHashUint256(k0, k1, val);
+}
+
+size_t CServicenodeIndexHasher::operator()(const CService& addr) const
+{
+    std::vector<unsigned char> vchKey = addr.GetKey();
+    uint256 val;
+    memcpy(val.begin(), &vchKey[0], std::min(vchKey.size(), (size_t)val.size()));
+    return SipHashUint256(k0, k1, val);
+}
+
 //
 // CServicenodeDB
 //
@@ -48,34 +89,28 @@ CServicenodeDB::CServicenodeDB()
 {
     pathMN = GetDataDir() / "mncache.dat";
     strMagicMessage = "ServicenodeCache";
+    nLogGeneration = 0;
 }
 
-bool CServicenodeDB::Write(const CServicenodeMan& mnodemanToSave)
+bool CServicenodeDB::Write(CServicenodeMan& mnodemanToSave)
 {
+    LOCK(servicenodeCacheLog.csDump);
+
     int64_t nStart = GetTimeMillis();
 
     // serialize, checksum data up to that point, then append checksum
     CDataStream ssServicenodes(SER_DISK, CLIENT_VERSION);
     ssServicenodes << strMagicMessage;                   // servicenode cache file specific magic message
     ssServicenodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssServicenodes << mnodemanToSave;
+    int nGeneration = mnodemanToSave.Snapshot(ssServicenodes);
+    ssServicenodes << nGeneration;                       // change log following the file
     uint256 hash = Hash(ssServicenodes.begin(), ssServicenodes.end());
     ssServicenodes << hash;
 
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssServicenodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
+    // written without holding the list
+    if (!WriteServicenodeCacheFile(pathMN, ssServicenodes))
+        return false;
+    servicenodeCacheLog.Prune(nGeneration);
 
     LogPrintf("Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrintf("  %s\n", mnodemanToSave.ToString());
@@ -146,6 +181,10 @@ CServicenodeDB::ReadResult CServicenodeDB::Read(CServicenodeMan& mnodemanToLoad,
         }
         // de-serialize data into CServicenodeMan object
         ssServicenodes >> mnodemanToLoad;
+        // files written before the change log have none
+        nLogGeneration = 0;
+        if (!ssServicenodes.empty())
+            ssServicenodes >> nLogGeneration;
     } catch (std::exception& e) {
         mnodemanToLoad.Clear();
         error("%s : Deserialize or I/O error - %s", __func__, e.what());
@@ -194,6 +233,7 @@ void DumpServicenodes()
 CServicenodeMan::CServicenodeMan()
 {
     nDsqCount = 0;
+    nListChanges = 0;
 }
 
 bool CServicenodeMan::Add(CServicenode& mn)
@@ -206,13 +246,54 @@ bool CServicenodeMan::Add(CServicenode& mn)
     CServicenode* pmn = Find(mn.vin);
     if (pmn == NULL) {
         LogPrint("servicenode", "CServicenodeMan: Adding new Servicenode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
-        vServicenodes.push_back(mn);
+        CServicenode& mnAdded = mapServicenodes.insert(std::make_pair(mn.vin.prevout, mn)).first->second;
+        // spends are only notified for entries of the list, so the
+        // collateral is looked up again once it's in
+        mnAdded.fCollateralChecked = false;
+        AddToIndexes(mnAdded);
+        nListChanges++;
+        servicenodeCacheLog.Append("mnb", CServicenodeBroadcast(mnAdded));
         return true;
     }
 
     return false;
 }
 
+void CServicenodeMan::AddToIndexes(const CServicenode& mn)
+{
+    mapServicenodesByPubKey.insert(std::make_pair(mn.pubKeyServicenode.GetID(), mn.vin.prevout));
+    mapServicenodesByPayee.insert(std::make_pair(mn.pubKeyCollateralAddress.GetID(), mn.vin.prevout));
+    mapServicenodesByAddr.insert(std::make_pair(mn.addr, mn.vin.prevout));
+}
+
+template <typename Key>
+static void EraseIndexEntry(boost::unordered_multimap<Key, COutPoint, CServicenodeIndexHasher>& mapIndex, const Key& key, const COutPoint& outpoint)
+{
+    typedef typename boost::unordered_multimap<Key, COutPoint, CServicenodeIndexHasher>::iterator index_iterator;
+    std::pair<index_iterator, index_iterator> range = mapIndex.equal_range(key);
+    for (index_iterator it = range.first; it != range.second; ++it) {
+        if (it->second == outpoint) {
+            mapIndex.erase(it);
+            return;
+        }
+    }
+}
+
+void CServicenodeMan::RemoveFromIndexes(const CServicenode& mn)
+{
+    EraseIndexEntry(mapServicenodesByPubKey, mn.pubKeyServicenode.GetID(), mn.vin.prevout);
+    EraseIndexEntry(mapServicenodesByPayee, mn.pubKeyCollateralAddress.GetID(), mn.vin.prevout);
+    EraseIndexEntry(mapServicenodesByAddr, mn.addr, mn.vin.prevout);
+}
+
+void CServicenodeMan::EraseServicenode(boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher>::iterator it)
+{
+    servicenodeCacheLog.Append("mnrm", it->second.vin);
+    RemoveFromIndexes(it->second);
+    mapServicenodes.erase(it);
+    nListChanges++;
+}
+
 void CServicenodeMan::AskForMN(CNode* pnode, CTxIn& vin)
 {
     std::map<COutPoint, int64_t>::iterator i = mWeAskedForServicenodeListEntry.find(vin.prevout);
@@ -233,7 +314,8 @@ void CServicenodeMan::Check()
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
         mn.Check();
     }
 }
@@ -245,20 +327,20 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
-    vector<CServicenode>::iterator it = vServicenodes.begin();
-    while (it != vServicenodes.end()) {
-        if ((*it).activeState == CServicenode::SERVICENODE_REMOVE ||
-            (*it).activeState == CServicenode::SERVICENODE_VIN_SPENT ||
-            (forceExpiredRemoval && (*it).activeState == CServicenode::SERVICENODE_EXPIRED) ||
-            (*it).protocolVersion < servicenodePayments.GetMinServicenodePaymentsProto()) {
-            LogPrint("servicenode", "CServicenodeMan: Removing inactive Servicenode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+    boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher>::iterator itMN = mapServicenodes.begin();
+    while (itMN != mapServicenodes.end()) {
+        if ((*itMN).second.activeState == CServicenode::SERVICENODE_REMOVE ||
+            (*itMN).second.activeState == CServicenode::SERVICENODE_VIN_SPENT ||
+            (forceExpiredRemoval && (*itMN).second.activeState == CServicenode::SERVICENODE_EXPIRED) ||
+            (*itMN).second.protocolVersion < servicenodePayments.GetMinServicenodePaymentsProto()) {
+            LogPrint("servicenode", "CServicenodeMan: Removing inactive Servicenode %s - %i now\n", (*itMN).second.vin.prevout.hash.ToString(), size() - 1);
 
             //erase all of the broadcasts we've seen from this vin
             // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
             //    sending a brand new mnb
             map<uint256, CServicenodeBroadcast>::iterator it3 = mapSeenServicenodeBroadcast.begin();
             while (it3 != mapSeenServicenodeBroadcast.end()) {
-                if ((*it3).second.vin == (*it).vin) {
+                if ((*it3).second.vin == (*itMN).second.vin) {
                     servicenodeSync.mapSeenSyncMNB.erase((*it3).first);
                     mapSeenServicenodeBroadcast.erase(it3++);
                 } else {
@@ -269,16 +351,16 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
             // allow us to ask for this servicenode again if we see another ping
             map<COutPoint, int64_t>::iterator it2 = mWeAskedForServicenodeListEntry.begin();
             while (it2 != mWeAskedForServicenodeListEntry.end()) {
-                if ((*it2).first == (*it).vin.prevout) {
+                if ((*it2).first == (*itMN).second.vin.prevout) {
                     mWeAskedForServicenodeListEntry.erase(it2++);
                 } else {
                     ++it2;
                 }
             }
 
-            it = vServicenodes.erase(it);
+            EraseServicenode(itMN++);
         } else {
-            ++it;
+            ++itMN;
         }
     }
 
@@ -337,7 +419,7 @@ void CServicenodeMan::CheckAndRemove(bool forceExpiredRemoval)
 void CServicenodeMan::Clear()
 {
     LOCK(cs);
-    vServicenodes.clear();
+    ClearServicenodes();
     mAskedUsForServicenodeList.clear();
     mWeAskedForServicenodeList.clear();
     mWeAskedForServicenodeListEntry.clear();
@@ -346,12 +428,39 @@ void CServicenodeMan::Clear()
     nDsqCount = 0;
 }
 
+void CServicenodeMan::ClearServicenodes()
+{
+    LOCK(cs);
+    mapServicenodes.clear();
+    mapServicenodesByPubKey.clear();
+    mapServicenodesByPayee.clear();
+    mapServicenodesByAddr.clear();
+    nListChanges++;
+}
+
+std::vector<CServicenode> CServicenodeMan::GetServicenodeVector() const
+{
+    LOCK(cs);
+    std::vector<CServicenode> vServicenodes;
+    vServicenodes.reserve(mapServicenodes.size());
+    BOOST_FOREACH (const PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes)
+        vServicenodes.push_back(entry.second);
+    return vServicenodes;
+}
+
+int64_t CServicenodeMan::GetListChanges()
+{
+    LOCK(cs);
+    return nListChanges;
+}
+
 int CServicenodeMan::CountEnabled(int protocolVersion)
 {
     int i = 0;
     protocolVersion = protocolVersion == -1 ? servicenodePayments.GetMinServicenodePaymentsProto() : protocolVersion;
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
         mn.Check();
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         i++;
@@ -376,47 +485,103 @@ void CServicenodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dseg", CTxIn());
+    if (servicenodeSync.CanReconcile(pnode)) {
+        std::vector<uint256> vHashes;
+        GetSyncBroadcasts(vHashes);
+        CSyncSetSummary summary(vHashes.size());
+        BOOST_FOREACH (const uint256& hash, vHashes)
+            summary.Add(hash);
+        pnode->PushMessage("dsegsum", summary);
+    } else
+        pnode->PushMessage("dseg", CTxIn());
     int64_t askAgain = GetTime() + SERVICENODES_DSEG_SECONDS;
     mWeAskedForServicenodeList[pnode->addr] = askAgain;
 }
 
+void CServicenodeMan::GetSyncBroadcasts(std::vector<uint256>& vHashes)
+{
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
+        if (mn.addr.IsRFC1918()) continue; //local network
+
+        if (mn.IsEnabled()) {
+            CServicenodeBroadcast mnb = CServicenodeBroadcast(mn);
+            uint256 hash = mnb.GetHash();
+            vHashes.push_back(hash);
+
+            if (!mapSeenServicenodeBroadcast.count(hash)) mapSeenServicenodeBroadcast.insert(make_pair(hash, mnb));
+        }
+    }
+}
+
+CServicenode* CServicenodeMan::FindByIndex(const boost::unordered_multimap<CKeyID, COutPoint, CServicenodeIndexHasher>& mapIndex, const CKeyID& keyID)
+{
+    boost::unordered_multimap<CKeyID, COutPoint, CServicenodeIndexHasher>::const_iterator it = mapIndex.find(keyID);
+    if (it == mapIndex.end())
+        return NULL;
+    return &mapServicenodes.find(it->second)->second;
+}
+
 CServicenode* CServicenodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    // payees are pay-to-pubkey-hash scripts of the collateral key
+    CTxDestination dest;
+    if (!ExtractDestination(payee, dest) || !boost::get<CKeyID>(&dest))
+        return NULL;
+    CKeyID keyID = boost::get<CKeyID>(dest);
+    if (GetScriptForDestination(keyID) != payee)
+        return NULL;
+    return FindByIndex(mapServicenodesByPayee, keyID);
 }
 
 CServicenode* CServicenodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher>::iterator it = mapServicenodes.find(vin.prevout);
+    if (it == mapServicenodes.end())
+        return NULL;
+    return &it->second;
 }
 
-
 CServicenode* CServicenodeMan::Find(const CPubKey& pubKeyServicenode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    // keys with the same id are the same key, compressed or not
+    typedef boost::unordered_multimap<CKeyID, COutPoint, CServicenodeIndexHasher>::iterator index_iterator;
+    std::pair<index_iterator, index_iterator> range = mapServicenodesByPubKey.equal_range(pubKeyServicenode.GetID());
+    for (index_iterator it = range.first; it != range.second; ++it) {
+        CServicenode& mn = mapServicenodes.find(it->second)->second;
         if (mn.pubKeyServicenode == pubKeyServicenode)
             return &mn;
     }
     return NULL;
 }
 
+CServicenode* CServicenodeMan::Find(const CService& addr)
+{
+    LOCK(cs);
+
+    boost::unordered_multimap<CService, COutPoint, CServicenodeIndexHasher>::iterator it = mapServicenodesByAddr.find(addr);
+    if (it == mapServicenodesByAddr.end())
+        return NULL;
+    return &mapServicenodes.find(it->second)->second;
+}
+
+bool CServicenodeMan::GetPubKeyServicenode(const CTxIn& vin, CPubKey& pubKeyServicenode)
+{
+    LOCK(cs);
+
+    CServicenode* pmn = Find(vin);
+    if (pmn == NULL)
+        return false;
+    pubKeyServicenode = pmn->pubKeyServicenode;
+    return true;
+}
+
 //
 // Deterministically select the oldest/best servicenode to pay on the network
 //
@@ -432,7 +597,8 @@ CServicenode* CServicenodeMan::GetNextServicenodeInQueueForPayment(int nBlockHei
     */
 
     int nMnCount = CountEnabled();
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
         mn.Check();
         if (!mn.IsEnabled()) continue;
 
@@ -495,7 +661,8 @@ CServicenode* CServicenodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclu
     LogPrint("servicenode", "CServicenodeMan::FindRandomNotInVec - rand %d\n", rand);
     bool found;
 
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         found = false;
         BOOST_FOREACH (CTxIn& usedVin, vecToExclude) {
@@ -519,7 +686,8 @@ CServicenode* CServicenodeMan::GetCurrentServiceNode(int mod, int64_t nBlockHeig
     CServicenode* winner = NULL;
 
     // scan for winner
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
         mn.Check();
         if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
 
@@ -546,7 +714,8 @@ int CServicenodeMan::GetServicenodeRank(const CTxIn& vin, int64_t nBlockHeight,
     if (!GetBlockHash(hash, nBlockHeight)) return -1;
 
     // scan for winner
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
         if (mn.protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
             mn.Check();
@@ -571,6 +740,37 @@ int CServicenodeMan::GetServicenodeRank(const CTxIn& vin, int64_t nBlockHeight,
     return -1;
 }
 
+bool CServicenodeMan::GetServicenodeQuorum(int64_t nBlockHeight, int minProtocol, unsigned int nSize, std::vector<CTxIn>& vecQuorum)
+{
+    LOCK(cs);
+
+    std::vector<pair<int64_t, CTxIn> > vecServicenodeScores;
+    vecQuorum.clear();
+
+    //make sure we know about this block
+    uint256 hash = 0;
+    if (!GetBlockHash(hash, nBlockHeight)) return false;
+
+    // scored as GetServicenodeRank scores them, only the first are sorted
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
+        if (mn.protocolVersion < minProtocol) continue;
+        mn.Check();
+        if (!mn.IsEnabled()) continue;
+        uint256 n = mn.CalculateScore(1, nBlockHeight);
+        int64_t n2 = n.GetCompact(false);
+
+        vecServicenodeScores.push_back(make_pair(n2, mn.vin));
+    }
+
+    nSize = std::min(nSize, (unsigned int)vecServicenodeScores.size());
+    partial_sort(vecServicenodeScores.begin(), vecServicenodeScores.begin() + nSize, vecServicenodeScores.end(), CompareScoreTxInHigher());
+
+    for (unsigned int i = 0; i < nSize; i++)
+        vecQuorum.push_back(vecServicenodeScores[i].second);
+    return true;
+}
+
 std::vector<pair<int, CServicenode> > CServicenodeMan::GetServicenodeRanks(int64_t nBlockHeight, int minProtocol)
 {
     std::vector<pair<int64_t, CServicenode> > vecServicenodeScores;
@@ -581,7 +781,8 @@ std::vector<pair<int, CServicenode> > CServicenodeMan::GetServicenodeRanks(int64
     if (!GetBlockHash(hash, nBlockHeight)) return vecServicenodeRanks;
 
     // scan for winner
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
@@ -613,7 +814,8 @@ CServicenode* CServicenodeMan::GetServicenodeByRank(int nRank, int64_t nBlockHei
     std::vector<pair<int64_t, CTxIn> > vecServicenodeScores;
 
     // scan for winner
-    BOOST_FOREACH (CServicenode& mn, vServicenodes) {
+    BOOST_FOREACH (PAIRTYPE(const COutPoint, CServicenode) & entry, mapServicenodes) {
+        CServicenode& mn = entry.second;
         if (mn.protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
             mn.Check();
@@ -729,10 +931,19 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         // we might have to ask for a servicenode entry once
         AskForMN(pfrom, mnp.vin);
 
-    } else if (strCommand == "dseg") { //Get Servicenode list or specific entry
+    } else if (strCommand == "dseg" || strCommand == "dsegsum") { //Get Servicenode list or specific entry, or those missing from a summary
 
         CTxIn vin;
-        vRecv >> vin;
+        CSyncSetSummary summary;
+        if (strCommand == "dseg") {
+            vRecv >> vin;
+        } else {
+            vRecv >> summary;
+            if (!summary.IsValid()) {
+                Misbehaving(pfrom->GetId(), 20);
+                return;
+            }
+        }
 
         if (vin == CTxIn()) { //only should ask for this once
             //local network
@@ -756,31 +967,41 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
 
         int nInvCount = 0;
 
-        BOOST_FOREACH (CServicenode& mn, vServicenodes) {
-            if (mn.addr.IsRFC1918()) continue; //local network
+        // a specific node is looked up rather than searched for
+        if (vin != CTxIn()) {
+            CServicenode* pmn = Find(vin);
+            if (pmn != NULL && pmn->vin == vin && !pmn->addr.IsRFC1918() && pmn->IsEnabled()) {
+                CServicenodeBroadcast mnb = CServicenodeBroadcast(*pmn);
+                uint256 hash = mnb.GetHash();
+                pfrom->PushInventory(CInv(MSG_SERVICENODE_ANNOUNCE, hash));
 
-            if (mn.IsEnabled()) {
-                LogPrint("servicenode", "dseg - Sending Servicenode entry - %s \n", mn.vin.prevout.hash.ToString());
-                if (vin == CTxIn() || vin == mn.vin) {
-                    CServicenodeBroadcast mnb = CServicenodeBroadcast(mn);
-                    uint256 hash = mnb.GetHash();
-                    pfrom->PushInventory(CInv(MSG_SERVICENODE_ANNOUNCE, hash));
-                    nInvCount++;
+                if (!mapSeenServicenodeBroadcast.count(hash)) mapSeenServicenodeBroadcast.insert(make_pair(hash, mnb));
 
-                    if (!mapSeenServicenodeBroadcast.count(hash)) mapSeenServicenodeBroadcast.insert(make_pair(hash, mnb));
-
-                    if (vin == mn.vin) {
-                        LogPrint("servicenode", "dseg - Sent 1 Servicenode entry to peer %i\n", pfrom->GetId());
-                        return;
-                    }
-                }
+                LogPrint("servicenode", "dseg - Sent 1 Servicenode entry to peer %i\n", pfrom->GetId());
             }
+            return;
         }
 
-        if (vin == CTxIn()) {
-            pfrom->PushMessage("ssc", SERVICENODE_SYNC_LIST, nInvCount);
-            LogPrint("servicenode", "dseg - Sent %d Servicenode entries to peer %i\n", nInvCount, pfrom->GetId());
+        std::vector<uint256> vHashes;
+        GetSyncBroadcasts(vHashes);
+
+        // only the entries of the buckets that differ from the peer's summary
+        CSyncSetSummary summaryOurs(summary.nKey0, summary.nKey1, summary.vBuckets.size());
+        if (strCommand == "dsegsum") {
+            BOOST_FOREACH (const uint256& hash, vHashes)
+                summaryOurs.Add(hash);
         }
+
+        BOOST_FOREACH (const uint256& hash, vHashes) {
+            if (strCommand == "dsegsum" && !summaryOurs.Differs(summary, hash)) continue;
+
+            LogPrint("servicenode", "dseg - Sending Servicenode entry - %s \n", hash.ToString());
+            pfrom->PushInventory(CInv(MSG_SERVICENODE_ANNOUNCE, hash));
+            nInvCount++;
+        }
+
+        pfrom->PushMessage("ssc", SERVICENODE_SYNC_LIST, nInvCount);
+        LogPrint("servicenode", "dseg - Sent %d Servicenode entries to peer %i\n", nInvCount, pfrom->GetId());
     }
     /*
      * IT'S SAFE TO REMOVE THIS IN FURTHER VERSIONS
@@ -874,6 +1095,7 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
                 if (pmn->nLastDsee < sigTime) { //take the newest entry
                     LogPrint("servicenode", "dsee - Got updated entry for %s\n", vin.prevout.hash.ToString());
                     if (pmn->protocolVersion < GETHEADERS_VERSION) {
+                        RemoveFromIndexes(*pmn);
                         pmn->pubKeyServicenode = pubkey2;
                         pmn->sigTime = sigTime;
                         pmn->sig = vchSig;
@@ -881,6 +1103,7 @@ void CServicenodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
                         pmn->addr = addr;
                         //fake ping
                         pmn->lastPing = CServicenodePing(vin);
+                        AddToIndexes(*pmn);
                     }
                     pmn->nLastDsee = sigTime;
                     pmn->Check();
@@ -1068,14 +1291,10 @@ void CServicenodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
 
-    vector<CServicenode>::iterator it = vServicenodes.begin();
-    while (it != vServicenodes.end()) {
-        if ((*it).vin == vin) {
-            LogPrint("servicenode", "CServicenodeMan: Removing Servicenode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vServicenodes.erase(it);
-            break;
-        }
-        ++it;
+    boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher>::iterator it = mapServicenodes.find(vin.prevout);
+    if (it != mapServicenodes.end() && (*it).second.vin == vin) {
+        LogPrint("servicenode", "CServicenodeMan: Removing Servicenode %s - %i now\n", (*it).second.vin.prevout.hash.ToString(), size() - 1);
+        EraseServicenode(it);
     }
 }
 
@@ -1093,16 +1312,97 @@ void CServicenodeMan::UpdateServicenodeList(CServicenodeBroadcast mnb)
         if (Add(mn)) {
             servicenodeSync.AddedServicenodeList(mnb.GetHash());
         }
-    } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+    } else if (UpdateFromNewBroadcast(*pmn, mnb)) {
         servicenodeSync.AddedServicenodeList(mnb.GetHash());
     }
 }
 
+bool CServicenodeMan::UpdateFromNewBroadcast(CServicenode& mn, CServicenodeBroadcast& mnb)
+{
+    LOCK(cs);
+
+    RemoveFromIndexes(mn);
+    bool fUpdated = mn.UpdateFromNewBroadcast(mnb);
+    AddToIndexes(mn);
+    if (fUpdated)
+        servicenodeCacheLog.Append("mnb", CServicenodeBroadcast(mn));
+    return fUpdated;
+}
+
+int CServicenodeMan::Snapshot(CDataStream& ss)
+{
+    LOCK(cs);
+
+    ss << *this;
+    return servicenodeCacheLog.Rotate();
+}
+
+void CServicenodeMan::ApplyChange(const std::string& strType, CDataStream& ssChange)
+{
+    LOCK(cs);
+
+    if (strType == "mnb") {
+        CServicenodeBroadcast mnb;
+        ssChange >> mnb;
+
+        mapSeenServicenodeBroadcast[mnb.GetHash()] = mnb;
+        if (mnb.lastPing != CServicenodePing())
+            mapSeenServicenodePing.insert(std::make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
+
+        // the entry as it was logged replaces the older one
+        boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher>::iterator it = mapServicenodes.find(mnb.vin.prevout);
+        if (it != mapServicenodes.end())
+            EraseServicenode(it);
+        CServicenode& mnAdded = mapServicenodes.insert(std::make_pair(mnb.vin.prevout, CServicenode(mnb))).first->second;
+        AddToIndexes(mnAdded);
+        nListChanges++;
+    } else if (strType == "mnrm") {
+        CTxIn vin;
+        ssChange >> vin;
+
+        boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher>::iterator it = mapServicenodes.find(vin.prevout);
+        if (it != mapServicenodes.end())
+            EraseServicenode(it);
+    }
+}
+
+void CServicenodeMan::LogUpdate(const CServicenode& mn)
+{
+    LOCK(cs);
+    servicenodeCacheLog.Append("mnb", CServicenodeBroadcast(mn));
+}
+
+void CServicenodeMan::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    if (tx.IsCoinBase())
+        return;
+
+    // without a block, the transaction either entered the memory pool or
+    // left it, as conflicted or disconnected, and spends nothing then
+    if (!pblock && !mempool.exists(tx.GetHash()))
+        return;
+
+    LOCK(cs);
+
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher>::iterator it = mapServicenodes.find(txin.prevout);
+        if (it == mapServicenodes.end())
+            continue;
+
+        CServicenode& mn = it->second;
+        if (!mn.fCollateralSpent)
+            LogPrint("servicenode", "CServicenodeMan::SyncTransaction - Collateral of Servicenode %s spent by %s\n", txin.prevout.ToStringShort(), tx.GetHash().ToString());
+        mn.fCollateralChecked = true;
+        mn.fCollateralSpent = true;
+        mn.activeState = CServicenode::SERVICENODE_VIN_SPENT;
+    }
+}
+
 std::string CServicenodeMan::ToString() const
 {
     std::ostringstream info;
 
-    info << "Servicenodes: " << (int)vServicenodes.size() << ", peers who asked us for Servicenode list: " << (int)mAskedUsForServicenodeList.size() << ", peers we asked for Servicenode list: " << (int)mWeAskedForServicenodeList.size() << ", entries in Servicenode list we asked for: " << (int)mWeAskedForServicenodeListEntry.size() << ", nDsqCount: " << (int)nDsqCount;
+    info << "Servicenodes: " << (int)mapServicenodes.size() << ", peers who asked us for Servicenode list: " << (int)mAskedUsForServicenodeList.size() << ", peers we asked for Servicenode list: " << (int)mWeAskedForServicenodeList.size() << ", entries in Servicenode list we asked for: " << (int)mWeAskedForServicenodeListEntry.size() << ", nDsqCount: " << (int)nDsqCount;
 
     return info.str();
 }
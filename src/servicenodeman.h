@@ -10,9 +10,13 @@
 #include "key.h"
 #include "main.h"
 #include "servicenode.h"
+#include "servicenode-cache.h"
 #include "net.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
+
+#include <boost/unordered_map.hpp>
 
 #define SERVICENODES_DUMP_SECONDS (15 * 60)
 #define SERVICENODES_DSEG_SECONDS (3 * 60 * 60)
@@ -22,6 +26,7 @@ using namespace std;
 class CServicenodeMan;
 
 extern CServicenodeMan mnodeman;
+extern CServicenodeCacheLog servicenodeCacheLog;
 void DumpServicenodes();
 
 /** Access to the MN database (mncache.dat)
@@ -31,6 +36,7 @@ class CServicenodeDB
 private:
     boost::filesystem::path pathMN;
     std::string strMagicMessage;
+    int nLogGeneration;
 
 public:
     enum ReadResult {
@@ -44,11 +50,26 @@ public:
     };
 
     CServicenodeDB();
-    bool Write(const CServicenodeMan& mnodemanToSave);
+    bool Write(CServicenodeMan& mnodemanToSave);
     ReadResult Read(CServicenodeMan& mnodemanToLoad, bool fDryRun = false);
+    /// Generation of the change log following the file read
+    int GetLogGeneration() const { return nLogGeneration; }
+};
+
+/** Hashes of the keys servicenodes are indexed by, salted so that peers can't pick keys that collide */
+class CServicenodeIndexHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CServicenodeIndexHasher();
+    size_t operator()(const COutPoint& outpoint) const;
+    size_t operator()(const CKeyID& keyID) const;
+    size_t operator()(const CService& addr) const;
 };
 
-class CServicenodeMan
+class CServicenodeMan : public CValidationInterface
 {
 private:
     // critical section to protect the inner data structures
@@ -57,10 +78,24 @@ private:
     // critical section to protect the inner data structures specifically on messaging
     mutable CCriticalSection cs_process_message;
 
-    // map to hold all MNs
-    std::vector<CServicenode> vServicenodes;
+    // map to hold all MNs, by collateral outpoint. The entries stay in place
+    // until removed, so pointers to them remain valid while others come and go.
+    boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher> mapServicenodes;
+    // collateral outpoints of the MNs by servicenode key, payee (collateral key) and address
+    boost::unordered_multimap<CKeyID, COutPoint, CServicenodeIndexHasher> mapServicenodesByPubKey;
+    boost::unordered_multimap<CKeyID, COutPoint, CServicenodeIndexHasher> mapServicenodesByPayee;
+    boost::unordered_multimap<CService, COutPoint, CServicenodeIndexHasher> mapServicenodesByAddr;
     // who's asked for the Servicenode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForServicenodeList;
+
+    void AddToIndexes(const CServicenode& mn);
+    void RemoveFromIndexes(const CServicenode& mn);
+    void EraseServicenode(boost::unordered_map<COutPoint, CServicenode, CServicenodeIndexHasher>::iterator it);
+    CServicenode* FindByIndex(const boost::unordered_multimap<CKeyID, COutPoint, CServicenodeIndexHasher>& mapIndex, const CKeyID& keyID);
+    // entries added to or removed from mapServicenodes so far
+    int64_t nListChanges;
+    // broadcasts of the entries sent to peers syncing the list, remembered to be served
+    void GetSyncBroadcasts(std::vector<uint256>& vHashes);
     // who we asked for the Servicenode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForServicenodeList;
     // which Servicenodes we've asked for
@@ -81,7 +116,17 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
+        // written as a list, as before the indexes
+        std::vector<CServicenode> vServicenodes;
+        if (!ser_action.ForRead())
+            vServicenodes = GetServicenodeVector();
         READWRITE(vServicenodes);
+        if (ser_action.ForRead()) {
+            ClearServicenodes();
+            BOOST_FOREACH (const CServicenode& mn, vServicenodes)
+                if (mapServicenodes.insert(std::make_pair(mn.vin.prevout, mn)).second)
+                    AddToIndexes(mn);
+        }
         READWRITE(mAskedUsForServicenodeList);
         READWRITE(mWeAskedForServicenodeList);
         READWRITE(mWeAskedForServicenodeListEntry);
@@ -97,6 +142,13 @@ public:
     /// Add an entry
     bool Add(CServicenode& mn);
 
+    /// Serialize the list for mncache.dat, returns the generation of the change log following it
+    int Snapshot(CDataStream& ss);
+    /// Replay a change of the list from servicenodeCacheLog
+    void ApplyChange(const std::string& strType, CDataStream& ssChange);
+    /// Log an entry updated in place, by a ping
+    void LogUpdate(const CServicenode& mn);
+
     /// Ask (source) node for mnb
     void AskForMN(CNode* pnode, CTxIn& vin);
 
@@ -108,15 +160,23 @@ public:
 
     /// Clear Servicenode vector
     void Clear();
+    /// Remove all entries and their indexes
+    void ClearServicenodes();
 
     int CountEnabled(int protocolVersion = -1);
 
+    /// Number of times an entry was added or removed, for callers that cache what depends on which servicenodes are known
+    int64_t GetListChanges();
+
     void DsegUpdate(CNode* pnode);
 
-    /// Find an entry
+    /// Find an entry. The pointer remains valid until the entry is removed.
     CServicenode* Find(const CScript& payee);
     CServicenode* Find(const CTxIn& vin);
     CServicenode* Find(const CPubKey& pubKeyServicenode);
+    CServicenode* Find(const CService& addr);
+    /// Copy the servicenode key of an entry, for threads that keep no pointer into the list
+    bool GetPubKeyServicenode(const CTxIn& vin, CPubKey& pubKeyServicenode);
 
     /// Find an entry in the servicenode list that is next to be paid
     CServicenode* GetNextServicenodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
@@ -130,11 +190,17 @@ public:
     std::vector<CServicenode> GetFullServicenodeVector()
     {
         Check();
-        return vServicenodes;
+        LOCK(cs);
+        return GetServicenodeVector();
     }
 
+    /// Copies of all entries, unchecked
+    std::vector<CServicenode> GetServicenodeVector() const;
+
     std::vector<pair<int, CServicenode> > GetServicenodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetServicenodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
+    /// The nSize servicenodes ranked first for a block, best first, returns false when the block is unknown
+    bool GetServicenodeQuorum(int64_t nBlockHeight, int minProtocol, unsigned int nSize, std::vector<CTxIn>& vecQuorum);
     CServicenode* GetServicenodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
     void ProcessServicenodeConnections();
@@ -142,14 +208,22 @@ public:
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     /// Return the number of (unique) Servicenodes
-    int size() { return vServicenodes.size(); }
+    int size() { return mapServicenodes.size(); }
 
     std::string ToString() const;
 
     void Remove(CTxIn vin);
 
+    /// Update an entry from a newer broadcast. The keys and address the entries
+    /// are indexed by only change through here.
+    bool UpdateFromNewBroadcast(CServicenode& mn, CServicenodeBroadcast& mnb);
+
     /// Update servicenode list and maps using provided CServicenodeBroadcast
     void UpdateServicenodeList(CServicenodeBroadcast mnb);
+
+protected:
+    /// Mark the servicenodes whose collateral the transaction spends, in a block or the memory pool
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
 };
 
 #endif
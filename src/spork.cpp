@@ -10,6 +10,7 @@
 #include "protocol.h"
 #include "sync.h"
 #include "util.h"
+#include <atomic>
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -23,6 +24,42 @@ CSporkManager sporkManager;
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
 
+static const int SPORK_COUNT = SPORK_END - SPORK_START + 1;
+
+// The values of the sporks in mapSporksActive, indexed by ID from SPORK_START.
+// mapSporksActive is only used by the thread handling messages, while the
+// sporks are checked from validation, the RPC and the GUI, so the values are
+// published here to be read without a lock
+static std::atomic<bool> vSporkReceived[SPORK_COUNT];
+static std::atomic<int64_t> vSporkValue[SPORK_COUNT];
+
+static void PublishSpork(const CSporkMessage& spork)
+{
+    if (spork.nSporkID < SPORK_START || spork.nSporkID > SPORK_END) return;
+
+    int i = spork.nSporkID - SPORK_START;
+    vSporkValue[i].store(spork.nValue, std::memory_order_relaxed);
+    vSporkReceived[i].store(true, std::memory_order_release);
+}
+
+static int64_t GetSporkDefault(int nSporkID)
+{
+    if (nSporkID == SPORK_2_SWIFTTX) return SPORK_2_SWIFTTX_DEFAULT;
+    if (nSporkID == SPORK_3_SWIFTTX_BLOCK_FILTERING) return SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
+    if (nSporkID == SPORK_5_MAX_VALUE) return SPORK_5_MAX_VALUE_DEFAULT;
+    if (nSporkID == SPORK_7_SERVICENODE_SCANNING) return SPORK_7_SERVICENODE_SCANNING_DEFAULT;
+    if (nSporkID == SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT) return SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT_DEFAULT;
+    if (nSporkID == SPORK_9_SERVICENODE_BUDGET_ENFORCEMENT) return SPORK_9_SERVICENODE_BUDGET_ENFORCEMENT_DEFAULT;
+    if (nSporkID == SPORK_10_SERVICENODE_PAY_UPDATED_NODES) return SPORK_10_SERVICENODE_PAY_UPDATED_NODES_DEFAULT;
+    if (nSporkID == SPORK_11_RESET_BUDGET) return SPORK_11_RESET_BUDGET_DEFAULT;
+    if (nSporkID == SPORK_12_RECONSIDER_BLOCKS) return SPORK_12_RECONSIDER_BLOCKS_DEFAULT;
+    if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) return SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
+    if (nSporkID == SPORK_14_NEW_PROTOCOL_ENFORCEMENT) return SPORK_14_NEW_PROTOCOL_ENFORCEMENT_DEFAULT;
+    if (nSporkID == SPORK_17_EXPL_FIX) return SPORK_17_EXPL_FIX_DEFAULT;
+
+    return -1;
+}
+
 
 void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
@@ -56,6 +93,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 
         mapSporks[hash] = spork;
         mapSporksActive[spork.nSporkID] = spork;
+        PublishSpork(spork);
         sporkManager.Relay(spork);
 
         //does a task if needed
@@ -74,26 +112,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 // grab the spork, otherwise say it's off
 bool IsSporkActive(int nSporkID)
 {
-    int64_t r = -1;
-
-    if (mapSporksActive.count(nSporkID)) {
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
-        if (nSporkID == SPORK_2_SWIFTTX) r = SPORK_2_SWIFTTX_DEFAULT;
-        if (nSporkID == SPORK_3_SWIFTTX_BLOCK_FILTERING) r = SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
-        if (nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
-        if (nSporkID == SPORK_7_SERVICENODE_SCANNING) r = SPORK_7_SERVICENODE_SCANNING_DEFAULT;
-        if (nSporkID == SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT) r = SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_9_SERVICENODE_BUDGET_ENFORCEMENT) r = SPORK_9_SERVICENODE_BUDGET_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_10_SERVICENODE_PAY_UPDATED_NODES) r = SPORK_10_SERVICENODE_PAY_UPDATED_NODES_DEFAULT;
-        if (nSporkID == SPORK_11_RESET_BUDGET) r = SPORK_11_RESET_BUDGET_DEFAULT;
-        if (nSporkID == SPORK_12_RECONSIDER_BLOCKS) r = SPORK_12_RECONSIDER_BLOCKS_DEFAULT;
-        if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
-        if (nSporkID == SPORK_14_NEW_PROTOCOL_ENFORCEMENT) r = SPORK_14_NEW_PROTOCOL_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_17_EXPL_FIX) r = SPORK_17_EXPL_FIX_DEFAULT;
-
-        if (r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
-    }
+    int64_t r = GetSporkValue(nSporkID);
     if (r == -1) r = 4070908800; //return 2099-1-1 by default
 
     return r < GetTime();
@@ -102,30 +121,23 @@ bool IsSporkActive(int nSporkID)
 // grab the value of the spork on the network, or the default
 int64_t GetSporkValue(int nSporkID)
 {
-    int64_t r = -1;
-
-    if (mapSporksActive.count(nSporkID)) {
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
-        if (nSporkID == SPORK_2_SWIFTTX) r = SPORK_2_SWIFTTX_DEFAULT;
-        if (nSporkID == SPORK_3_SWIFTTX_BLOCK_FILTERING) r = SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
-        if (nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
-        if (nSporkID == SPORK_7_SERVICENODE_SCANNING) r = SPORK_7_SERVICENODE_SCANNING_DEFAULT;
-        if (nSporkID == SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT) r = SPORK_8_SERVICENODE_PAYMENT_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_9_SERVICENODE_BUDGET_ENFORCEMENT) r = SPORK_9_SERVICENODE_BUDGET_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_10_SERVICENODE_PAY_UPDATED_NODES) r = SPORK_10_SERVICENODE_PAY_UPDATED_NODES_DEFAULT;
-        if (nSporkID == SPORK_11_RESET_BUDGET) r = SPORK_11_RESET_BUDGET_DEFAULT;
-        if (nSporkID == SPORK_12_RECONSIDER_BLOCKS) r = SPORK_12_RECONSIDER_BLOCKS_DEFAULT;
-        if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
-        if (nSporkID == SPORK_14_NEW_PROTOCOL_ENFORCEMENT) r = SPORK_14_NEW_PROTOCOL_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_17_EXPL_FIX) r = SPORK_17_EXPL_FIX_DEFAULT;
-
-        if (r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
+    if (nSporkID >= SPORK_START && nSporkID <= SPORK_END) {
+        int i = nSporkID - SPORK_START;
+        if (vSporkReceived[i].load(std::memory_order_acquire))
+            return vSporkValue[i].load(std::memory_order_relaxed);
     }
 
+    int64_t r = GetSporkDefault(nSporkID);
+    if (r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
+
     return r;
 }
 
+bool IsSporkActiveAtHeight(int nSporkID, int nHeight)
+{
+    return IsSporkActive(nSporkID) && nHeight >= GetSporkValue(nSporkID);
+}
+
 void ExecuteSpork(int nSporkID, int nValue)
 {
     if (nSporkID == SPORK_11_RESET_BUDGET && nValue == 1) {
@@ -223,6 +235,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
         Relay(msg);
         mapSporks[msg.GetHash()] = msg;
         mapSporksActive[nSporkID] = msg;
+        PublishSpork(msg);
         return true;
     }
 
@@ -63,6 +63,8 @@ extern CSporkManager sporkManager;
 void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 int64_t GetSporkValue(int nSporkID);
 bool IsSporkActive(int nSporkID);
+//! Whether a spork is active and its value, the height of a change it enables, has been reached at nHeight
+bool IsSporkActiveAtHeight(int nSporkID, int nHeight);
 void ExecuteSpork(int nSporkID, int nValue);
 void ReprocessBlocks(int nBlocks);
 
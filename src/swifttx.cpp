@@ -7,6 +7,7 @@
 #include "key.h"
 #include "servicenodeman.h"
 #include "net.h"
+#include "lrucache.h"
 #include "obfuscation.h"
 #include "protocol.h"
 #include "spork.h"
@@ -25,6 +26,40 @@ std::map<COutPoint, uint256> mapLockedInputs;
 std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
 int nCompleteTXLocks;
 
+// locks by when they expire, so only the expired ones are visited
+static std::set<std::pair<int, uint256> > setTxLockExpirations;
+// sum of the times in mapUnknownVotes
+static int64_t nUnknownVoteTimes = 0;
+
+// the servicenodes ranked first for a height, and what they were ranked on
+struct CSwiftTXQuorum {
+    uint256 hashBlock;
+    int64_t nListChanges;
+    int64_t nTime;
+    std::vector<CTxIn> vecServicenodes;
+};
+static CCriticalSection cs_swifttxquorum;
+static lrucache<int, CSwiftTXQuorum> swifttxQuorums(SWIFTTX_QUORUM_CACHE_SIZE);
+
+// expire a lock now, it is removed on the next clean up
+static void ExpireTransactionLock(const uint256& txHash)
+{
+    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(txHash);
+    if (it == mapTxLocks.end()) return;
+
+    setTxLockExpirations.erase(make_pair(it->second.nExpiration, txHash));
+    it->second.nExpiration = GetTime();
+    setTxLockExpirations.insert(make_pair(it->second.nExpiration, txHash));
+}
+
+// set the time of an unknown vote, keeping the sum GetAverageVoteTime divides
+static void SetUnknownVoteTime(const uint256& hash, int64_t nTime)
+{
+    int64_t& nVoteTime = mapUnknownVotes[hash];
+    nUnknownVoteTimes += nTime - nVoteTime;
+    nVoteTime = nTime;
+}
+
 //txlock - Locks transaction
 //
 //step 1.) Broadcast intention to lock transaction inputs, "txlreg", CTransaction
@@ -142,7 +177,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             */
             if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
                 if (!mapUnknownVotes.count(ctx.vinServicenode.prevout.hash)) {
-                    mapUnknownVotes[ctx.vinServicenode.prevout.hash] = GetTime() + (60 * 10);
+                    SetUnknownVoteTime(ctx.vinServicenode.prevout.hash, GetTime() + (60 * 10));
                 }
 
                 if (mapUnknownVotes[ctx.vinServicenode.prevout.hash] > GetTime() &&
@@ -152,7 +187,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                         ctx.txHash.ToString().c_str());
                     return;
                 } else {
-                    mapUnknownVotes[ctx.vinServicenode.prevout.hash] = GetTime() + (60 * 10);
+                    SetUnknownVoteTime(ctx.vinServicenode.prevout.hash, GetTime() + (60 * 10));
                 }
             }
             RelayInv(inv);
@@ -228,19 +263,12 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (chainActive.Tip()->nHeight - nTxAge) + 4;
 
-    if (!mapTxLocks.count(tx.GetHash())) {
+    if (!mapTxLocks.count(tx.GetHash()))
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
-    } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
+    else
         LogPrint("swifttx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
-    }
+
+    GetTransactionLock(tx.GetHash()).nBlockHeight = nBlockHeight;
 
 
     return nBlockHeight;
@@ -251,7 +279,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if (!fServiceNode) return;
 
-    int n = mnodeman.GetServicenodeRank(activeServicenode.vin, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetSwiftTXRank(activeServicenode.vin, nBlockHeight);
 
     if (n == -1) {
         LogPrint("swifttx", "SwiftTX::DoConsensusVote - Unknown Servicenode\n");
@@ -290,7 +318,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 //received a consensus vote
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetServicenodeRank(ctx.vinServicenode, ctx.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetSwiftTXRank(ctx.vinServicenode, ctx.nBlockHeight);
 
     CServicenode* pmn = mnodeman.Find(ctx.vinServicenode);
     if (pmn != NULL)
@@ -317,13 +345,7 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 
     if (!mapTxLocks.count(ctx.txHash)) {
         LogPrintf("SwiftTX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
+        GetTransactionLock(ctx.txHash);
     } else
         LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
 
@@ -392,8 +414,8 @@ bool CheckForConflictingLocks(CTransaction& tx)
         if (mapLockedInputs.count(in.prevout)) {
             if (mapLockedInputs[in.prevout] != tx.GetHash()) {
                 LogPrintf("SwiftTX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
+                ExpireTransactionLock(tx.GetHash());
+                ExpireTransactionLock(mapLockedInputs[in.prevout]);
                 return true;
             }
         }
@@ -404,47 +426,87 @@ bool CheckForConflictingLocks(CTransaction& tx)
 
 int64_t GetAverageVoteTime()
 {
-    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
-    int64_t total = 0;
-    int64_t count = 0;
-
-    while (it != mapUnknownVotes.end()) {
-        total += it->second;
-        count++;
-        it++;
-    }
+    if (mapUnknownVotes.empty()) return 0;
 
-    return total / count;
+    return nUnknownVoteTimes / (int64_t)mapUnknownVotes.size();
 }
 
 void CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    while (!setTxLockExpirations.empty() && GetTime() > setTxLockExpirations.begin()->first) { //keep them for an hour
+        uint256 txHash = setTxLockExpirations.begin()->second;
+        setTxLockExpirations.erase(setTxLockExpirations.begin());
 
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+        std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(txHash);
+        if (it == mapTxLocks.end()) continue;
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+        LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
 
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+        if (mapTxLockReq.count(it->second.txHash)) {
+            CTransaction& tx = mapTxLockReq[it->second.txHash];
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
+            BOOST_FOREACH (const CTxIn& in, tx.vin)
+                mapLockedInputs.erase(in.prevout);
 
-                BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
+            mapTxLockReq.erase(it->second.txHash);
+        }
+        mapTxLockReqRejected.erase(it->second.txHash);
 
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
+        // votes for transactions never seen go with their lock too
+        BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
+            mapTxLockVote.erase(v.GetHash());
+
+        mapTxLocks.erase(it);
+    }
+}
+
+CTransactionLock& GetTransactionLock(const uint256& txHash)
+{
+    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(txHash);
+    if (it != mapTxLocks.end())
+        return it->second;
+
+    CTransactionLock newLock;
+    newLock.nBlockHeight = 0;
+    newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
+    newLock.nTimeout = GetTime() + (60 * 5);
+    newLock.txHash = txHash;
+    setTxLockExpirations.insert(make_pair(newLock.nExpiration, txHash));
+    return mapTxLocks.insert(make_pair(txHash, newLock)).first->second;
+}
+
+int GetSwiftTXRank(const CTxIn& vin, int nBlockHeight)
+{
+    uint256 hashBlock = 0;
+    if (!GetBlockHash(hashBlock, nBlockHeight)) return -1;
+    int64_t nListChanges = mnodeman.GetListChanges();
+
+    {
+        LOCK(cs_swifttxquorum);
+
+        CSwiftTXQuorum quorum;
+        if (!swifttxQuorums.get(nBlockHeight, quorum) || quorum.hashBlock != hashBlock ||
+            quorum.nListChanges != nListChanges || GetTime() - quorum.nTime > SWIFTTX_QUORUM_CACHE_SECONDS) {
+            quorum.hashBlock = hashBlock;
+            quorum.nListChanges = nListChanges;
+            quorum.nTime = GetTime();
+            if (!mnodeman.GetServicenodeQuorum(nBlockHeight, MIN_SWIFTTX_PROTO_VERSION, SWIFTTX_SIGNATURES_TOTAL, quorum.vecServicenodes))
+                return -1;
+            swifttxQuorums.insert(nBlockHeight, quorum);
         }
+
+        for (unsigned int i = 0; i < quorum.vecServicenodes.size(); i++)
+            if (quorum.vecServicenodes[i].prevout == vin.prevout)
+                return i + 1;
     }
+
+    // not in the top ones, ranked if it would be ranked at all
+    CServicenode* pmn = mnodeman.Find(vin);
+    if (pmn == NULL || pmn->protocolVersion < MIN_SWIFTTX_PROTO_VERSION || !pmn->IsEnabled())
+        return -1;
+    return SWIFTTX_SIGNATURES_TOTAL + 1;
 }
 
 uint256 CConsensusVote::GetHash() const
@@ -452,11 +514,16 @@ uint256 CConsensusVote::GetHash() const
     return vinServicenode.prevout.hash + vinServicenode.prevout.n + txHash;
 }
 
+std::string CConsensusVote::GetStrMessage() const
+{
+    return txHash.ToString() + boost::lexical_cast<std::string>(nBlockHeight);
+}
+
 
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
     CServicenode* pmn = mnodeman.Find(vinServicenode);
@@ -480,7 +547,7 @@ bool CConsensusVote::Sign()
 
     CKey key2;
     CPubKey pubkey2;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("signing strMessage %s \n", strMessage.c_str());
     //LogPrintf("signing privkey %s \n", strServiceNodePrivKey.c_str());
 
@@ -506,7 +573,7 @@ bool CConsensusVote::Sign()
 bool CTransactionLock::SignaturesValid()
 {
     BOOST_FOREACH (CConsensusVote vote, vecConsensusVotes) {
-        int n = mnodeman.GetServicenodeRank(vote.vinServicenode, vote.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+        int n = GetSwiftTXRank(vote.vinServicenode, vote.nBlockHeight);
 
         if (n == -1) {
             LogPrintf("CTransactionLock::SignaturesValid() - Unknown Servicenode\n");
@@ -514,7 +581,7 @@ bool CTransactionLock::SignaturesValid()
         }
 
         if (n > SWIFTTX_SIGNATURES_TOTAL) {
-            LogPrintf("CTransactionLock::SignaturesValid() - Servicenode not in the top %s\n", SWIFTTX_SIGNATURES_TOTAL);
+            LogPrintf("CTransactionLock::SignaturesValid() - Servicenode not in the top %d\n", SWIFTTX_SIGNATURES_TOTAL);
             return false;
         }
 
@@ -34,6 +34,10 @@ class CTransaction;
 class CTransactionLock;
 
 static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
+//! Block heights whose top servicenodes are kept for checking lock votes
+static const unsigned int SWIFTTX_QUORUM_CACHE_SIZE = 100;
+//! Seconds the top servicenodes of a height are reused before the list is ranked again
+static const int64_t SWIFTTX_QUORUM_CACHE_SECONDS = 60;
 
 extern map<uint256, CTransaction> mapTxLockReq;
 extern map<uint256, CTransaction> mapTxLockReqRejected;
@@ -58,6 +62,14 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
 //process consensus vote message
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
 
+// rank of a servicenode voting on locks of the height, as GetServicenodeRank ranks it,
+// past SWIFTTX_SIGNATURES_TOTAL for those not in the top ones. The top servicenodes of a
+// height are ranked once and reused until the list or the block of that height changes.
+int GetSwiftTXRank(const CTxIn& vin, int nBlockHeight);
+
+// lock of the transaction, a new one expiring in an hour if there is none
+CTransactionLock& GetTransactionLock(const uint256& txHash);
+
 // keep transaction locks in memory for an hour
 void CleanTransactionLocksList();
 
@@ -72,6 +84,7 @@ public:
     std::vector<unsigned char> vchServiceNodeSignature;
 
     uint256 GetHash() const;
+    std::string GetStrMessage() const;
 
     bool SignatureValid();
     bool Sign();
@@ -26,6 +26,16 @@ GetResults(CWalletDB& walletdb, std::map<CAmount, CAccountingEntry>& results)
     {
         results[ae.nOrderPos] = ae;
     }
+
+    // the wallet's activity log must follow the new order
+    int64_t nLastPos = -1;
+    BOOST_FOREACH(const CWallet::TxItems::value_type& item, pwalletMain->wtxOrdered)
+    {
+        const CWallet::TxPair& pair = item.second;
+        BOOST_CHECK(item.first == (pair.first ? pair.first->nOrderPos : pair.second->nOrderPos));
+        BOOST_CHECK(item.first > nLastPos);
+        nLastPos = item.first;
+    }
 }
 
 BOOST_AUTO_TEST_CASE(acc_orderupgrade)
@@ -0,0 +1,121 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "main.h"
+#include "streams.h"
+#include "txmempool.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+// A block with a coinbase and three transactions paying to OP_TRUE
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(4);
+    block.vtx[0] = tx;
+    block.nVersion = 42;
+    block.hashPrevBlock = GetRandHash();
+    block.nBits = 0x207fffff;
+
+    for (int i = 1; i < 4; i++) {
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vin[0].prevout.n = i;
+        block.vtx[i] = tx;
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    BOOST_CHECK_EQUAL(stream.size(), cmpctblock.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION));
+    CBlockHeaderAndShortTxIDs cmpctblockRead;
+    stream >> cmpctblockRead;
+    BOOST_CHECK(stream.empty());
+    return cmpctblockRead;
+}
+
+BOOST_AUTO_TEST_CASE(reconstruct_from_mempool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlockTestCase();
+    pool.addUnchecked(block.vtx[1].GetHash(), CTxMemPoolEntry(block.vtx[1], 0, 0, 0, 0));
+    pool.addUnchecked(block.vtx[3].GetHash(), CTxMemPoolEntry(block.vtx[3], 0, 0, 0, 0));
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK_EQUAL(cmpctblock.prefilledtxn.size(), 1);
+    BOOST_CHECK_EQUAL(cmpctblock.shorttxids.size(), 3);
+
+    CPartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK_EQUAL(partialBlock.InitData(cmpctblock, pool), READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(2));
+    BOOST_CHECK(partialBlock.IsTxAvailable(3));
+    std::vector<uint32_t> vMissing = partialBlock.GetMissing();
+    BOOST_CHECK_EQUAL(vMissing.size(), 1);
+    BOOST_CHECK_EQUAL(vMissing[0], 2);
+
+    // the peer has to send exactly what is missing
+    CBlock blockRebuilt;
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRebuilt, std::vector<CTransaction>()), READ_STATUS_INVALID);
+    std::vector<CTransaction> vtxMissing(2, block.vtx[2]);
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRebuilt, vtxMissing), READ_STATUS_INVALID);
+
+    // a wrong transaction fails like a short id collision, by the merkle root
+    vtxMissing.assign(1, block.vtx[1]);
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRebuilt, vtxMissing), READ_STATUS_FAILED);
+
+    vtxMissing.assign(1, block.vtx[2]);
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRebuilt, vtxMissing), READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(blockRebuilt.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(blockRebuilt.vtx.size(), block.vtx.size());
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(blockRebuilt.vtx[i].GetHash() == block.vtx[i].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(reconstruct_all_known)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlockTestCase();
+    for (unsigned int i = 1; i < block.vtx.size(); i++)
+        pool.addUnchecked(block.vtx[i].GetHash(), CTxMemPoolEntry(block.vtx[i], 0, 0, 0, 0));
+
+    CPartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK_EQUAL(partialBlock.InitData(RoundTrip(CBlockHeaderAndShortTxIDs(block)), pool), READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.GetMissing().empty());
+
+    CBlock blockRebuilt;
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(blockRebuilt, std::vector<CTransaction>()), READ_STATUS_OK);
+    BOOST_CHECK(blockRebuilt.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_prefilled)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlockTestCase();
+
+    CBlockHeaderAndShortTxIDs cmpctblock(block);
+    cmpctblock.prefilledtxn[0].index = block.vtx.size();
+    CPartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK_EQUAL(partialBlock.InitData(RoundTrip(cmpctblock), pool), READ_STATUS_INVALID);
+
+    cmpctblock.prefilledtxn.clear();
+    cmpctblock.shorttxids.clear();
+    BOOST_CHECK_EQUAL(partialBlock.InitData(RoundTrip(cmpctblock), pool), READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,113 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockhashcache.h"
+#include "main.h"
+#include "servicenode.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockhashcache_tests)
+
+// A chain of nLength blocks after pindexFork, or from genesis without one
+struct TestChain {
+    std::vector<uint256> vHash;
+    std::vector<CBlockIndex> vBlocks;
+
+    TestChain(CBlockIndex* pindexFork, int nLength, uint256 salt) : vHash(nLength), vBlocks(nLength)
+    {
+        int nStart = pindexFork ? pindexFork->nHeight + 1 : 0;
+        for (int i = 0; i < nLength; i++) {
+            vHash[i] = Hash(salt.begin(), salt.end(), (unsigned char*)&i, (unsigned char*)&i + sizeof(i));
+            vBlocks[i].nHeight = nStart + i;
+            vBlocks[i].pprev = i ? &vBlocks[i - 1] : pindexFork;
+            vBlocks[i].phashBlock = &vHash[i];
+            vBlocks[i].BuildSkip();
+        }
+    }
+
+    CBlockIndex* Tip() { return &vBlocks.back(); }
+};
+
+static void CheckChain(CBlockIndex* pindexTip)
+{
+    uint256 hash;
+    BOOST_CHECK_EQUAL(blockHashCache.Height(), pindexTip->nHeight);
+    for (CBlockIndex* pindex = pindexTip; pindex != NULL; pindex = pindex->pprev) {
+        BOOST_CHECK(blockHashCache.GetHash(pindex->nHeight, hash));
+        BOOST_CHECK(hash == pindex->GetBlockHash());
+    }
+    BOOST_CHECK(!blockHashCache.GetHash(pindexTip->nHeight + 1, hash));
+    BOOST_CHECK(!blockHashCache.GetHash(-1, hash));
+}
+
+BOOST_AUTO_TEST_CASE(follows_tip)
+{
+    TestChain main(NULL, 3000, 1);
+    for (int i = 0; i < 3000; i++)
+        blockHashCache.SetTip(&main.vBlocks[i]);
+    CheckChain(main.Tip());
+
+    // a branch forking deeper than the cache, then one inside it
+    TestChain side(&main.vBlocks[1000], 1500, 2);
+    blockHashCache.SetTip(side.Tip());
+    CheckChain(side.Tip());
+
+    TestChain side2(&side.vBlocks[1400], 50, 3);
+    blockHashCache.SetTip(side2.Tip());
+    CheckChain(side2.Tip());
+
+    // disconnecting blocks one by one
+    for (int i = 0; i < 50; i++)
+        blockHashCache.SetTip(side2.vBlocks[49 - i].pprev);
+    CheckChain(&side.vBlocks[1400]);
+
+    blockHashCache.SetTip(NULL);
+    uint256 hash;
+    BOOST_CHECK_EQUAL(blockHashCache.Height(), -1);
+    BOOST_CHECK(!blockHashCache.GetHash(0, hash));
+
+    blockHashCache.SetTip(chainActive.Tip());
+}
+
+BOOST_AUTO_TEST_CASE(scores_after_reorg)
+{
+    CServicenode mn;
+    mn.vin = CTxIn(GetRandHash(), 0);
+
+    TestChain main(NULL, 200, 4);
+    blockHashCache.SetTip(main.Tip());
+    uint256 hash;
+    BOOST_CHECK(GetBlockHash(hash, 150));
+    BOOST_CHECK(hash == main.vBlocks[149].GetBlockHash());
+    uint256 nScoreMain = mn.CalculateScore(1, 150);
+
+    // the scores of the heights a reorganization replaced follow the new chain
+    TestChain side(&main.vBlocks[120], 100, 5);
+    blockHashCache.SetTip(side.Tip());
+    BOOST_CHECK(GetBlockHash(hash, 150));
+    BOOST_CHECK(hash == side.vBlocks[28].GetBlockHash());
+    uint256 nScoreSide = mn.CalculateScore(1, 150);
+    BOOST_CHECK(nScoreSide != nScoreMain);
+
+    // and match those computed on that chain alone
+    blockHashCache.SetTip(NULL);
+    BOOST_CHECK(mn.CalculateScore(1, 150) == 0);
+    blockHashCache.SetTip(side.Tip());
+    BOOST_CHECK(mn.CalculateScore(1, 150) == nScoreSide);
+
+    // back to the first chain
+    blockHashCache.SetTip(main.Tip());
+    BOOST_CHECK(mn.CalculateScore(1, 150) == nScoreMain);
+
+    // heights at and below the fork keep their scores
+    BOOST_CHECK(GetBlockHash(hash, 121));
+    BOOST_CHECK(hash == main.vBlocks[120].GetBlockHash());
+
+    blockHashCache.SetTip(chainActive.Tip());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,58 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrucache.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(lrucache_tests)
+
+BOOST_AUTO_TEST_CASE(lrucache_evicts_least_recently_used)
+{
+    lrucache<int, int> cache(3);
+    int v;
+
+    cache.insert(1, 10);
+    cache.insert(2, 20);
+    cache.insert(3, 30);
+    BOOST_CHECK(cache.size() == 3);
+
+    // a lookup counts as a use, so 2 is now the oldest
+    BOOST_CHECK(cache.get(1, v) && v == 10);
+    cache.insert(4, 40);
+    BOOST_CHECK(cache.size() == 3);
+    BOOST_CHECK(!cache.contains(2));
+    BOOST_CHECK(cache.contains(1) && cache.contains(3) && cache.contains(4));
+
+    // replacing a value counts as a use as well
+    cache.insert(3, 31);
+    cache.insert(5, 50);
+    BOOST_CHECK(!cache.contains(1));
+    BOOST_CHECK(cache.get(3, v) && v == 31);
+
+    cache.erase(3);
+    BOOST_CHECK(!cache.get(3, v));
+    BOOST_CHECK(cache.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(lrucache_resize)
+{
+    lrucache<int, int> cache(10);
+    for (int i = 0; i < 10; i++)
+        cache.insert(i, i);
+
+    cache.max_size(4);
+    BOOST_CHECK(cache.size() == 4);
+    for (int i = 0; i < 6; i++)
+        BOOST_CHECK(!cache.contains(i));
+    for (int i = 6; i < 10; i++)
+        BOOST_CHECK(cache.contains(i));
+
+    // a cache without room keeps nothing
+    cache.max_size(0);
+    cache.insert(1, 1);
+    BOOST_CHECK(cache.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
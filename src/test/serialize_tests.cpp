@@ -161,4 +161,25 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(buffer_reader)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << 1234567 << string("mapped") << (unsigned char)7;
+    std::vector<char> vch(ss.begin(), ss.end());
+
+    // reads in place what the data stream wrote
+    CBufferReader reader(&vch[0], &vch[0] + vch.size(), SER_DISK, 0);
+    int n;
+    string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 1234567);
+    BOOST_CHECK_EQUAL(str, "mapped");
+    BOOST_CHECK_EQUAL(reader.size(), 1);
+
+    // never reads past the end
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+    reader.ignore(1);
+    BOOST_CHECK(reader.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
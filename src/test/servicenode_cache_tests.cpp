@@ -0,0 +1,137 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "servicenode-cache.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(servicenode_cache_tests)
+
+// A cache the changes are replayed into
+struct CTestCache {
+    std::vector<int> vChanges;
+
+    void ApplyChange(const std::string& strType, CDataStream& ssChange)
+    {
+        if (strType != "n") return;
+        int n;
+        ssChange >> n;
+        vChanges.push_back(n);
+    }
+};
+
+// The changes replayed on a restart loading the file of a generation
+static std::vector<int> Replay(const std::string& strFileName, int nGeneration)
+{
+    CServicenodeCacheLog log(strFileName);
+    CTestCache cache;
+    log.Load(nGeneration, cache);
+    return cache.vChanges;
+}
+
+BOOST_AUTO_TEST_CASE(log_replay)
+{
+    CServicenodeCacheLog log("testcache");
+    CTestCache cache;
+    log.Append("n", 0); // before loading, not logged
+    log.Load(0, cache);
+    BOOST_CHECK(cache.vChanges.empty());
+
+    log.Append("n", 1);
+    log.Append("n", 2);
+    log.Append("x", 3); // unknown to the cache
+    BOOST_CHECK_EQUAL(Replay("testcache", 0).size(), 2);
+
+    // a dump taken, the changes from there go to the next generation
+    BOOST_CHECK_EQUAL(log.Rotate(), 1);
+    log.Append("n", 4);
+
+    // loading an older file replays from it, a newer one from its generation
+    std::vector<int> vChanges = Replay("testcache", 0);
+    BOOST_CHECK_EQUAL(vChanges.size(), 3);
+    BOOST_CHECK_EQUAL(vChanges[0], 1);
+    BOOST_CHECK_EQUAL(vChanges[2], 4);
+    vChanges = Replay("testcache", 1);
+    BOOST_CHECK_EQUAL(vChanges.size(), 1);
+    BOOST_CHECK_EQUAL(vChanges[0], 4);
+
+    // once the dump is written the logs before it are removed
+    log.Prune(1);
+    BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / "testcache.0.log"));
+    BOOST_CHECK_EQUAL(Replay("testcache", 0).size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(log_torn_record)
+{
+    {
+        CServicenodeCacheLog log("torncache");
+        CTestCache cache;
+        log.Load(0, cache);
+        log.Append("n", 1);
+        log.Append("n", 2);
+    }
+
+    // a crash in the middle of the last record
+    boost::filesystem::path path = GetDataDir() / "torncache.0.log";
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 1);
+    std::vector<int> vChanges = Replay("torncache", 0);
+    BOOST_CHECK_EQUAL(vChanges.size(), 1);
+    BOOST_CHECK_EQUAL(vChanges[0], 1);
+
+    // a record corrupted on disk ends the replay of its log too, the
+    // changes after each restart going to a new generation
+    {
+        CServicenodeCacheLog log("torncache");
+        CTestCache cache;
+        log.Load(0, cache);
+        log.Append("n", 3);
+        log.Append("n", 4);
+    }
+    path = GetDataDir() / "torncache.2.log";
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_CHECK(file != NULL);
+    fseek(file, -1, SEEK_END);
+    fputc(0xff, file);
+    fclose(file);
+    vChanges = Replay("torncache", 0);
+    BOOST_CHECK_EQUAL(vChanges.size(), 2);
+    BOOST_CHECK_EQUAL(vChanges[1], 3);
+}
+
+BOOST_AUTO_TEST_CASE(log_stale)
+{
+    {
+        CServicenodeCacheLog log("stalecache");
+        CTestCache cache;
+        log.Load(0, cache);
+        log.Append("n", 1);
+        log.Rotate();
+        log.Append("n", 2);
+        log.Rotate();
+        log.Append("n", 3);
+        log.Prune(2);
+    }
+    BOOST_CHECK(boost::filesystem::exists(GetDataDir() / "stalecache.2.log"));
+
+    // the file was deleted, the logs of the earlier run go with it
+    CServicenodeCacheLog log("stalecache");
+    CTestCache cache;
+    log.Load(0, cache);
+    BOOST_CHECK(cache.vChanges.empty());
+    BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / "stalecache.2.log"));
+
+    // so a restart from a later generation doesn't replay them
+    log.Rotate();
+    log.Append("n", 4);
+    std::vector<int> vChanges = Replay("stalecache", 1);
+    BOOST_CHECK_EQUAL(vChanges.size(), 1);
+    BOOST_CHECK_EQUAL(vChanges[0], 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
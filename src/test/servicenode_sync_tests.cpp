@@ -0,0 +1,82 @@
+// Copyright (c) 2015-2017 The BlocknetDX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "random.h"
+#include "servicenode-sync.h"
+#include "streams.h"
+#include "version.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(servicenode_sync_tests)
+
+// The items of a peer's set announced for a summary of ours
+static std::vector<uint256> GetDiffering(const std::vector<uint256>& vOurs, const std::vector<uint256>& vPeers)
+{
+    CSyncSetSummary summary(vOurs.size());
+    for (size_t i = 0; i < vOurs.size(); i++)
+        summary.Add(vOurs[i]);
+
+    // sent over, as with 'dsegsum'
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << summary;
+    CSyncSetSummary summaryReceived;
+    ss >> summaryReceived;
+    BOOST_CHECK(summaryReceived.IsValid());
+
+    CSyncSetSummary summaryPeer(summaryReceived.nKey0, summaryReceived.nKey1, summaryReceived.vBuckets.size());
+    for (size_t i = 0; i < vPeers.size(); i++)
+        summaryPeer.Add(vPeers[i]);
+
+    std::vector<uint256> vDiffering;
+    for (size_t i = 0; i < vPeers.size(); i++)
+        if (summaryPeer.Differs(summaryReceived, vPeers[i]))
+            vDiffering.push_back(vPeers[i]);
+    return vDiffering;
+}
+
+BOOST_AUTO_TEST_CASE(summary_reconciles)
+{
+    std::vector<uint256> vPeers;
+    for (int i = 0; i < 5000; i++)
+        vPeers.push_back(GetRandHash());
+
+    // same items in another order
+    std::vector<uint256> vOurs(vPeers.rbegin(), vPeers.rend());
+    BOOST_CHECK(GetDiffering(vOurs, vPeers).empty());
+
+    // missing some, the peer announces them and those sharing their buckets
+    std::vector<uint256> vMissing;
+    for (int i = 0; i < 50; i++) {
+        vMissing.push_back(vOurs.back());
+        vOurs.pop_back();
+    }
+    std::vector<uint256> vDiffering = GetDiffering(vOurs, vPeers);
+    for (size_t i = 0; i < vMissing.size(); i++)
+        BOOST_CHECK(std::find(vDiffering.begin(), vDiffering.end(), vMissing[i]) != vDiffering.end());
+    BOOST_CHECK(vDiffering.size() < vMissing.size() * SYNC_SUMMARY_BUCKET_ITEMS * 2);
+
+    // having items the peer doesn't have doesn't make it miss its own
+    vOurs.push_back(GetRandHash());
+    vDiffering = GetDiffering(vOurs, vPeers);
+    for (size_t i = 0; i < vMissing.size(); i++)
+        BOOST_CHECK(std::find(vDiffering.begin(), vDiffering.end(), vMissing[i]) != vDiffering.end());
+
+    // with nothing, everything
+    BOOST_CHECK(GetDiffering(std::vector<uint256>(), vPeers).size() == vPeers.size());
+}
+
+BOOST_AUTO_TEST_CASE(summary_size)
+{
+    BOOST_CHECK(!CSyncSetSummary().IsValid());
+    BOOST_CHECK(CSyncSetSummary(0).IsValid());
+    BOOST_CHECK_EQUAL(CSyncSetSummary(80000).vBuckets.size(), 80000 / SYNC_SUMMARY_BUCKET_ITEMS + 1);
+    BOOST_CHECK_EQUAL(CSyncSetSummary(1000000000).vBuckets.size(), SYNC_SUMMARY_MAX_BUCKETS);
+    BOOST_CHECK(!CSyncSetSummary(0, 0, SYNC_SUMMARY_MAX_BUCKETS + 1).IsValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "obfuscation.h"
 #include "wallet.h"
 
 #include <set>
@@ -305,4 +306,83 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+// Pay a wallet outputs of a transaction confirmed in the genesis block,
+// spending the first output of another of its transactions if given
+static uint256 add_mixing_tx(CWallet& wallet, const CScript& script, const vector<CAmount>& vValues, const uint256& hashPrev = uint256())
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(hashPrev == uint256() ? GetRandHash() : hashPrev, 0));
+    BOOST_FOREACH (const CAmount& nValue, vValues)
+        tx.vout.push_back(CTxOut(nValue, script));
+
+    CWalletTx wtx(&wallet, tx);
+    wtx.hashBlock = chainActive.Tip()->GetBlockHash();
+    wtx.nIndex = 0;
+    wtx.fMerkleVerified = true;
+    BOOST_CHECK(wallet.AddToWallet(wtx, true));
+    return wtx.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(obfuscation_plan_tests)
+{
+    if (obfuScationDenominations.empty()) {
+        obfuScationDenominations.push_back((10000 * COIN) + 10000000);
+        obfuScationDenominations.push_back((1000 * COIN) + 1000000);
+        obfuScationDenominations.push_back((100 * COIN) + 100000);
+        obfuScationDenominations.push_back((10 * COIN) + 10000);
+        obfuScationDenominations.push_back((1 * COIN) + 1000);
+        obfuScationDenominations.push_back((.1 * COIN) + 100);
+    }
+    const CAmount nDenom100 = obfuScationDenominations[2], nDenom10 = obfuScationDenominations[3], nDenom1 = obfuScationDenominations[4], nDenomDot1 = obfuScationDenominations[5];
+
+    CWallet wallet;
+    LOCK2(cs_main, wallet.cs_wallet);
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // denominations of 0 rounds, of which one is mixed into 10s of 1 round,
+    // and a 100 with change
+    vector<CAmount> vValues;
+    vValues.push_back(nDenomDot1);
+    vValues.push_back(nDenom1);
+    vValues.push_back(nDenom1);
+    uint256 hash = add_mixing_tx(wallet, script, vValues);
+    vValues.assign(2, nDenom10);
+    add_mixing_tx(wallet, script, vValues, hash);
+    vValues.assign(1, nDenom100);
+    vValues.push_back(7 * COIN);
+    uint256 hashChange = add_mixing_tx(wallet, script, vValues);
+
+    BOOST_CHECK_EQUAL(wallet.GetObfuscationDenominations(0, 2), (1 << 2) | (1 << 3) | (1 << 4));
+    BOOST_CHECK_EQUAL(wallet.GetObfuscationDenominations(0, 1), (1 << 2) | (1 << 4));
+    BOOST_CHECK_EQUAL(wallet.GetObfuscationDenominations(1, 2), 1 << 3);
+
+    // only the denominations and rounds asked for are selected
+    vector<CTxIn> vCoins;
+    vector<COutput> vCoins2;
+    CAmount nValueRet;
+    BOOST_CHECK(wallet.SelectCoinsByDenominations(1 << 3, 0, OBFUSCATION_POOL_MAX, vCoins, vCoins2, nValueRet, 0, 2));
+    BOOST_CHECK(!vCoins2.empty());
+    BOOST_FOREACH (const COutput& out, vCoins2)
+        BOOST_CHECK_EQUAL(out.Value(), nDenom10);
+    BOOST_CHECK(!wallet.SelectCoinsByDenominations(1 << 3, 0, OBFUSCATION_POOL_MAX, vCoins, vCoins2, nValueRet, 0, 1));
+    BOOST_CHECK(!wallet.SelectCoinsByDenominations(1 << 5, 0, OBFUSCATION_POOL_MAX, vCoins, vCoins2, nValueRet, 0, 2));
+
+    // the change is what there is to denominate, until it's locked
+    BOOST_CHECK(wallet.SelectCoinsDark(CENT, OBFUSCATION_POOL_MAX, vCoins, nValueRet, -2, 0));
+    BOOST_CHECK_EQUAL(nValueRet, 7 * COIN);
+    COutPoint outpoint(hashChange, 1);
+    wallet.LockCoin(outpoint);
+    BOOST_CHECK(!wallet.SelectCoinsDark(CENT, OBFUSCATION_POOL_MAX, vCoins, nValueRet, -2, 0));
+    wallet.UnlockCoin(outpoint);
+    BOOST_CHECK(wallet.SelectCoinsDark(CENT, OBFUSCATION_POOL_MAX, vCoins, nValueRet, -2, 0));
+
+    // a new transaction is planned with
+    vValues.assign(1, nDenomDot1);
+    add_mixing_tx(wallet, script, vValues);
+    BOOST_CHECK(wallet.SelectCoinsByDenominations(1 << 5, 0, OBFUSCATION_POOL_MAX, vCoins, vCoins2, nValueRet, 0, 2));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
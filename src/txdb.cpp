@@ -11,6 +11,7 @@
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -181,6 +182,113 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(make_pair('p', key), value);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressUnspentKey key;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != addressHash)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vect.push_back(make_pair(key, value));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::UpdateBlockIndexes(const std::vector<std::pair<uint256, CDiskTxPos> >& vTxPos,
+    const std::vector<std::pair<CAddressIndexKey, CAmount> >& vAddressIndex, bool fEraseAddressIndex,
+    const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vAddressUnspent,
+    const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vSpent)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vTxPos.begin(); it != vTxPos.end(); it++)
+        batch.Write(make_pair('t', it->first), it->second);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vAddressIndex.begin(); it != vAddressIndex.end(); it++) {
+        if (fEraseAddressIndex)
+            batch.Erase(make_pair('a', it->first));
+        else
+            batch.Write(make_pair('a', it->first), it->second);
+    }
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vAddressUnspent.begin(); it != vAddressUnspent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = vSpent.begin(); it != vSpent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int start, int end)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (start > 0 && end > 0)
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash, start));
+    else
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressIndexKey key;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != addressHash)
+                break;
+            if (end > 0 && key.blockHeight > end)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vect.push_back(make_pair(key, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -195,7 +303,23 @@ bool CBlockTreeDB::ReadFlag(const std::string& name, bool& fValue)
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+/** Rehash the headers of vIndex[nBegin, nEnd) and check them against the hashes they are stored under */
+static void CheckBlockIndexHashes(const std::vector<CBlockIndex*>* pvIndex, CCriticalSection* pcs, CBlockIndex** ppFailed, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CBlockIndex* pindex = (*pvIndex)[i];
+        bool fValid = pindex->GetBlockHeader().GetHash() == pindex->GetBlockHash();
+        if (fValid && pindex->nHeight <= Params().LAST_POW_BLOCK())
+            fValid = CheckProofOfWork(pindex->GetBlockHash(), pindex->nBits);
+        if (!fValid) {
+            LOCK(*pcs);
+            *ppFailed = pindex;
+            return;
+        }
+    }
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(bool fCheckHashes)
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
@@ -203,7 +327,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     ssKeySet << make_pair('b', uint256());
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
+    // Load mapBlockIndex. Entries are stored under their block hash, so the
+    // headers only need to be hashed again when checking the database.
+    std::vector<CBlockIndex*> vLoaded;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -212,13 +338,15 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
             char chType;
             ssKey >> chType;
             if (chType == 'b') {
+                uint256 hash;
+                ssKey >> hash;
                 leveldb::Slice slValue = pcursor->value();
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
                 CDiskBlockIndex diskindex;
                 ssValue >> diskindex;
 
                 // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
+                CBlockIndex* pindexNew = InsertBlockIndex(hash);
                 pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
                 pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
                 pindexNew->nHeight = diskindex.nHeight;
@@ -242,14 +370,12 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nStakeTime = diskindex.nStakeTime;
                 pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
 
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
                 // ppcoin: build setStakeSeen
                 if (pindexNew->IsProofOfStake())
                     setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
 
+                if (fCheckHashes)
+                    vLoaded.push_back(pindexNew);
                 pcursor->Next();
             } else {
                 break; // if shutdown requested or finished loading block index
@@ -259,5 +385,13 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
         }
     }
 
+    if (fCheckHashes) {
+        CCriticalSection cs;
+        CBlockIndex* pindexFailed = NULL;
+        ParallelForRange(vLoaded.size(), boost::bind(&CheckBlockIndexHashes, &vLoaded, &cs, &pindexFailed, _1, _2));
+        if (pindexFailed)
+            return error("LoadBlockIndex() : block header hash or proof of work check failed: %s", pindexFailed->ToString());
+    }
+
     return true;
 }
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "leveldbwrapper.h"
 #include "main.h"
 
@@ -60,9 +61,17 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+    bool ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int start = 0, int end = 0);
+    //! Write the transaction, address and spent index changes of a block in one batch, erasing the address entries for a disconnect
+    bool UpdateBlockIndexes(const std::vector<std::pair<uint256, CDiskTxPos> >& vTxPos,
+        const std::vector<std::pair<CAddressIndexKey, CAmount> >& vAddressIndex, bool fEraseAddressIndex,
+        const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vAddressUnspent,
+        const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vSpent);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
-    bool LoadBlockIndexGuts();
+    bool LoadBlockIndexGuts(bool fCheckHashes = false);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -80,6 +80,7 @@
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/foreach.hpp>
@@ -764,6 +765,23 @@ void RenameThread(const char* name)
 #endif
 }
 
+void ParallelForRange(size_t nSize, const boost::function<void(size_t, size_t)>& func, size_t nMinPerThread)
+{
+    size_t nThreads = std::max(1u, boost::thread::hardware_concurrency());
+    nThreads = std::min(nThreads, std::max((size_t)1, nSize / std::max((size_t)1, nMinPerThread)));
+    if (nThreads <= 1) {
+        func(0, nSize);
+        return;
+    }
+
+    boost::thread_group threads;
+    size_t nSlice = (nSize + nThreads - 1) / nThreads;
+    for (size_t nBegin = nSlice; nBegin < nSize; nBegin += nSlice)
+        threads.create_thread(boost::bind(func, nBegin, std::min(nSize, nBegin + nSlice)));
+    func(0, nSlice);
+    threads.join_all();
+}
+
 void SetupEnvironment()
 {
 // On most POSIX systems (e.g. Linux, but not BSD) the environment's locale
@@ -27,6 +27,7 @@
 #include <vector>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
 #include <boost/thread/exceptions.hpp>
 
 //BlocknetDX only features
@@ -201,6 +202,13 @@ std::string HelpMessageOpt(const std::string& option, const std::string& message
 void SetThreadPriority(int nPriority);
 void RenameThread(const char* name);
 
+/**
+ * Split [0, nSize) into one contiguous slice per core, call func(begin, end)
+ * on each slice from its own thread and wait for all of them.
+ * Ranges below nMinPerThread items run on the calling thread.
+ */
+void ParallelForRange(size_t nSize, const boost::function<void(size_t, size_t)>& func, size_t nMinPerThread = 1000);
+
 /**
  * Standard wrapper for do-something-forever thread functions.
  * "Forever" really means until the thread is interrupted.
@@ -11,7 +11,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70711;
+static const int PROTOCOL_VERSION = 70713;
 
 static const int SERVICENODE_WITH_XBRIDGE_INFO_PROTO_VERSION = 70711;
 
@@ -21,6 +21,12 @@ static const int INIT_PROTO_VERSION = 209;
 //! In this version, 'getheaders' was introduced.
 static const int GETHEADERS_VERSION = 70077;
 
+//! 'getheaders' is answered with 'headers', and peers are synced headers-first, starting with this version
+static const int HEADERS_FIRST_VERSION = 70712;
+
+//! The servicenode list and budget are synced with 'dsegsum' and 'mnvssum', answered with the items a summary of ours lacks, starting with this version
+static const int SYNC_RECONCILE_VERSION = 70713;
+
 //! disconnect from peers older than this proto version
 static const int MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT = 70701;
 static const int MIN_PEER_PROTO_VERSION_AFTER_ENFORCEMENT = 70710;
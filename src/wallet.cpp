@@ -591,27 +591,21 @@ int64_t CWallet::IncOrderPosNext(CWalletDB* pwalletdb)
     return nRet;
 }
 
-CWallet::TxItems CWallet::OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount)
+void CWallet::LoadAccountingEntry(const CAccountingEntry& acentry)
 {
-    AssertLockHeld(cs_wallet); // mapWallet
-    CWalletDB walletdb(strWalletFile);
-
-    // First: get all CWalletTx and CAccountingEntry into a sorted-by-order multimap.
-    TxItems txOrdered;
+    laccentries.push_back(acentry);
+    CAccountingEntry& entry = laccentries.back();
+    wtxOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
+}
 
-    // Note: maintaining indices in the database of (account,time) --> txid and (account, time) --> acentry
-    // would make this much faster for applications that do this a lot.
-    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-        CWalletTx* wtx = &((*it).second);
-        txOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
-    }
-    acentries.clear();
-    walletdb.ListAccountCreditDebit(strAccount, acentries);
-    BOOST_FOREACH (CAccountingEntry& entry, acentries) {
-        txOrdered.insert(make_pair(entry.nOrderPos, TxPair((CWalletTx*)0, &entry)));
-    }
+bool CWallet::AddAccountingEntry(CAccountingEntry& acentry, CWalletDB& walletdb)
+{
+    AssertLockHeld(cs_wallet); // wtxOrdered
+    if (!walletdb.WriteAccountingEntry(acentry))
+        return false;
 
-    return txOrdered;
+    LoadAccountingEntry(acentry);
+    return true;
 }
 
 void CWallet::MarkDirty()
@@ -620,6 +614,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
             item.second.MarkDirty();
+        obfuscationPlan.fValid = false;
     }
 }
 
@@ -629,8 +624,11 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
     if (fFromLoadWallet) {
         mapWallet[hash] = wtxIn;
-        mapWallet[hash].BindWallet(this);
+        CWalletTx& wtx = mapWallet[hash];
+        wtx.BindWallet(this);
+        wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        obfuscationPlan.fValid = false;
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -641,6 +639,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         if (fInsertedNew) {
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
+            wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
 
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (wtxIn.hashBlock != 0) {
@@ -650,9 +649,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
                     {
                         // Tolerate times up to the last timestamp in the wallet not more than 5 minutes into the future
                         int64_t latestTolerated = latestNow + 300;
-                        std::list<CAccountingEntry> acentries;
-                        TxItems txOrdered = OrderedTxItems(acentries);
-                        for (TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
+                        for (TxItems::reverse_iterator it = wtxOrdered.rbegin(); it != wtxOrdered.rend(); ++it) {
                             CWalletTx* const pwtx = (*it).second.first;
                             if (pwtx == &wtx)
                                 continue;
@@ -681,6 +678,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
                         wtxIn.hashBlock.ToString());
             }
             AddToSpends(hash);
+            if (!fLiteMode)
+                UpdateObfuscationRounds(wtx);
         }
 
         bool fUpdated = false;
@@ -711,6 +710,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        obfuscationPlan.fValid = false;
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -769,8 +769,20 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            std::pair<TxItems::iterator, TxItems::iterator> range = wtxOrdered.equal_range(mi->second.nOrderPos);
+            for (TxItems::iterator it = range.first; it != range.second; ++it) {
+                if (it->second.first == &mi->second) {
+                    wtxOrdered.erase(it);
+                    break;
+                }
+            }
+            mapWallet.erase(mi);
+            obfuscationPlan.fValid = false;
             CWalletDB(strWalletFile).EraseTx(hash);
+            EraseObfuscationRounds(hash);
+        }
     }
     return;
 }
@@ -808,8 +820,6 @@ CAmount CWallet::GetDebit(const CTxIn& txin, const isminefilter& filter) const
 // Recursively determine the rounds of a given input (How deep is the Obfuscation chain for a given input)
 int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
-
     if (rounds >= 16) return 15; // 16 rounds max
 
     uint256 hash = in.prevout.hash;
@@ -817,17 +827,10 @@ int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
 
     const CWalletTx* wtx = GetWalletTx(hash);
     if (wtx != NULL) {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        // not known yet, let's add it
-        if (mdwi == mDenomWtxes.end()) {
-            LogPrint("obfuscation", "GetInputObfuscationRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx);
-        }
-        // found and it's not an initial value, just return it
-        else if (mDenomWtxes[hash].vout[nout].nRounds != -10) {
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
-
+        // already indexed, just return it
+        std::map<COutPoint, int>::const_iterator mi = mapObfuscationRounds.find(in.prevout);
+        if (mi != mapObfuscationRounds.end())
+            return mi->second;
 
         // bounds check
         if (nout >= wtx->vout.size()) {
@@ -836,35 +839,25 @@ int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
             return -4;
         }
 
-        if (pwalletMain->IsCollateralAmount(wtx->vout[nout].nValue)) {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+        if (IsCollateralAmount(wtx->vout[nout].nValue))
+            return SetObfuscationRounds(in.prevout, -3, false);
 
         //make sure the final output is non-denominate
         if (/*rounds == 0 && */ !IsDenominatedAmount(wtx->vout[nout].nValue)) //NOT DENOM
-        {
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+            return SetObfuscationRounds(in.prevout, -2, false);
 
         bool fAllDenoms = true;
-        BOOST_FOREACH (CTxOut out, wtx->vout) {
+        BOOST_FOREACH (const CTxOut& out, wtx->vout) {
             fAllDenoms = fAllDenoms && IsDenominatedAmount(out.nValue);
         }
         // this one is denominated but there is another non-denominated output found in the same tx
-        if (!fAllDenoms) {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+        if (!fAllDenoms)
+            return SetObfuscationRounds(in.prevout, 0, false);
 
         int nShortest = -10; // an initial value, should be no way to get this by calculations
         bool fDenomFound = false;
         // only denoms here so let's look up
-        BOOST_FOREACH (CTxIn in2, wtx->vin) {
+        BOOST_FOREACH (const CTxIn& in2, wtx->vin) {
             if (IsMine(in2)) {
                 int n = GetRealInputObfuscationRounds(in2, rounds + 1);
                 // denom found, find the shortest chain or initially assign nShortest with the first found value
@@ -874,21 +867,104 @@ int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
                 }
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound ? (nShortest >= 15 ? 16 : nShortest + 1) // good, we a +1 to the shortest one but only 16 rounds max allowed
-                                                             :
-                                                             0; // too bad, we are the fist one in that chain
-        LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+        return SetObfuscationRounds(in.prevout, fDenomFound ? (nShortest >= 15 ? 16 : nShortest + 1) // good, we a +1 to the shortest one but only 16 rounds max allowed
+                                                            :
+                                                            0, // too bad, we are the fist one in that chain
+            true);
     }
 
     return rounds - 1;
 }
 
+// Record rounds for an outpoint. Only values derived from the ancestry are worth
+// persisting, the others are cheap to recompute from the output itself.
+int CWallet::SetObfuscationRounds(const COutPoint& outpoint, int nRounds, bool fPersist) const
+{
+    AssertLockHeld(cs_wallet);
+    mapObfuscationRounds[outpoint] = nRounds;
+    if (fPersist)
+        setObfuscationRoundsDirty.insert(outpoint);
+    LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", outpoint.hash.ToString(), outpoint.n, nRounds);
+    return nRounds;
+}
+
+void CWallet::LoadObfuscationRounds(const COutPoint& outpoint, int nRounds)
+{
+    mapObfuscationRounds[outpoint] = nRounds;
+}
+
+void CWallet::FlushObfuscationRounds() const
+{
+    AssertLockHeld(cs_wallet);
+    if (setObfuscationRoundsDirty.empty())
+        return;
+
+    if (fFileBacked) {
+        CWalletDB walletdb(strWalletFile);
+        BOOST_FOREACH (const COutPoint& outpoint, setObfuscationRoundsDirty) {
+            std::map<COutPoint, int>::const_iterator mi = mapObfuscationRounds.find(outpoint);
+            if (mi != mapObfuscationRounds.end())
+                walletdb.WriteObfuscationRounds(outpoint, mi->second);
+        }
+    }
+    setObfuscationRoundsDirty.clear();
+}
+
+// Drop the rounds of all outputs of a transaction, from memory and disk
+void CWallet::EraseObfuscationRounds(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    std::map<COutPoint, int>::iterator it = mapObfuscationRounds.lower_bound(COutPoint(hash, 0));
+    while (it != mapObfuscationRounds.end() && it->first.hash == hash) {
+        setObfuscationRoundsDirty.erase(it->first);
+        if (fFileBacked)
+            CWalletDB(strWalletFile).EraseObfuscationRounds(it->first);
+        mapObfuscationRounds.erase(it++);
+    }
+}
+
+// Index the rounds of a newly added transaction's outputs. Wallet transactions that
+// already spend it (it arrived after its children) were indexed without it, so their
+// rounds are dropped and recomputed as well.
+void CWallet::UpdateObfuscationRounds(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+
+    std::vector<uint256> vStale;
+    std::set<uint256> setStale;
+    vStale.push_back(wtx.GetHash());
+    for (unsigned int i = 0; i < vStale.size(); i++) {
+        const uint256& hash = vStale[i];
+        EraseObfuscationRounds(hash);
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end())
+            continue;
+        for (unsigned int n = 0; n < mi->second.vout.size(); n++) {
+            std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(hash, n));
+            for (TxSpends::const_iterator it = range.first; it != range.second; ++it)
+                if (setStale.insert(it->second).second)
+                    vStale.push_back(it->second);
+        }
+    }
+
+    BOOST_FOREACH (const uint256& hash, vStale) {
+        const CWalletTx* pwtx = GetWalletTx(hash);
+        if (pwtx == NULL)
+            continue;
+        for (unsigned int n = 0; n < pwtx->vout.size(); n++)
+            if (IsMine(pwtx->vout[n]) != ISMINE_NO)
+                GetRealInputObfuscationRounds(CTxIn(hash, n), 0);
+    }
+
+    FlushObfuscationRounds();
+}
+
 // respect current settings
 int CWallet::GetInputObfuscationRounds(CTxIn in) const
 {
     LOCK(cs_wallet);
     int realObfuscationRounds = GetRealInputObfuscationRounds(in, 0);
+    FlushObfuscationRounds();
     return realObfuscationRounds > nObfuscationRounds ? nObfuscationRounds : realObfuscationRounds;
 }
 
@@ -1239,36 +1315,16 @@ CAmount CWallet::GetAnonymizableBalance() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAnonymizableCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetObfuscationPlan().nAnonymizableBalance;
 }
 
 CAmount CWallet::GetAnonymizedBalance() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAnonymizedCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetObfuscationPlan().nAnonymizedBalance;
 }
 
 // Note: calculated including unconfirmed,
@@ -1338,17 +1394,9 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            nTotal += pcoin->GetDenominatedCredit(unconfirmed);
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    const CObfuscationPlan& plan = GetObfuscationPlan();
+    return unconfirmed ? plan.nDenominatedUnconfirmedBalance : plan.nDenominatedBalance;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
@@ -1770,14 +1818,120 @@ struct CompareByPriority {
     }
 };
 
+int CObfuscationPlan::GetDenominations(int nRoundsMin, int nRoundsMax) const
+{
+    int nDenom = 0;
+    for (unsigned int d = 0; d < vDenominatedBuckets.size(); d++) {
+        for (int r = std::max(nRoundsMin, 0); r < nRoundsMax && r < (int)vDenominatedBuckets[d].size(); r++) {
+            if (!vDenominatedBuckets[d][r].empty()) {
+                nDenom |= 1 << d;
+                break;
+            }
+        }
+    }
+    return nDenom;
+}
+
+// The obfuscation plan, built again with a pass over the wallet if the
+// outputs of the wallet, the chain tip or the rounds to reach changed since
+const CObfuscationPlan& CWallet::GetObfuscationPlan() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+    CObfuscationPlan& plan = obfuscationPlan;
+    if (plan.fValid && plan.hashTip == hashTip && plan.nRoundsTarget == nObfuscationRounds)
+        return plan;
+
+    plan.SetNull();
+    plan.hashTip = hashTip;
+    plan.nRoundsTarget = nObfuscationRounds;
+
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        const CWalletTx* pcoin = &(*it).second;
+
+        if (pcoin->IsTrusted()) {
+            plan.nAnonymizedBalance += pcoin->GetAnonymizedCredit();
+            plan.nAnonymizableBalance += pcoin->GetAnonymizableCredit();
+        }
+        plan.nDenominatedBalance += pcoin->GetDenominatedCredit(false);
+        plan.nDenominatedUnconfirmedBalance += pcoin->GetDenominatedCredit(true);
+    }
+
+    vector<COutput> vCoins, vNonDenominated, vDenominated;
+    AvailableCoins(vCoins);
+    BOOST_FOREACH (const COutput& out, vCoins) {
+        CAmount nValue = out.tx->vout[out.i].nValue;
+        if (IsCollateralAmount(nValue)) {
+            plan.fCollateralInputs = true;
+            continue;
+        }
+        if (!out.fSpendable) continue;
+        //do not allow inputs less than 1 CENT
+        if (nValue < CENT) continue;
+        if (fServiceNode && nValue == SERVICENODE_REQUIRED_AMOUNT * COIN) continue; //servicenode input
+
+        if (IsDenominatedAmount(nValue))
+            vDenominated.push_back(out);
+        else
+            vNonDenominated.push_back(out);
+    }
+
+    plan.fCollateralInputsUnconfirmed = plan.fCollateralInputs;
+    if (!plan.fCollateralInputs) {
+        AvailableCoins(vCoins, false);
+        BOOST_FOREACH (const COutput& out, vCoins)
+            if (IsCollateralAmount(out.tx->vout[out.i].nValue)) plan.fCollateralInputsUnconfirmed = true;
+    }
+
+    //order the array so largest nondenom are first, then denominations, then very small inputs.
+    sort(vNonDenominated.rbegin(), vNonDenominated.rend(), CompareByPriority());
+    sort(vDenominated.rbegin(), vDenominated.rend(), CompareByPriority());
+
+    BOOST_FOREACH (const COutput& out, vNonDenominated) {
+        CObfuscationPlan::CCoin coin = {out.tx, (unsigned int)out.i, out.nDepth, std::min(GetRealInputObfuscationRounds(CTxIn(out.tx->GetHash(), out.i), 0), nObfuscationRounds)};
+        plan.vNonDenominated.push_back(coin);
+    }
+
+    // rounds are at most 16, whatever the number of rounds to reach
+    plan.vDenominatedBuckets.resize(obfuScationDenominations.size(), std::vector<std::vector<unsigned int> >(std::min(nObfuscationRounds, 16) + 1));
+    BOOST_FOREACH (const COutput& out, vDenominated) {
+        CObfuscationPlan::CCoin coin = {out.tx, (unsigned int)out.i, out.nDepth, std::min(GetRealInputObfuscationRounds(CTxIn(out.tx->GetHash(), out.i), 0), nObfuscationRounds)};
+        if (coin.nRounds >= 0) {
+            unsigned int d = std::find(obfuScationDenominations.begin(), obfuScationDenominations.end(), out.tx->vout[out.i].nValue) - obfuScationDenominations.begin();
+            plan.vDenominatedBuckets[d][coin.nRounds].push_back(plan.vDenominated.size());
+        }
+        plan.vDenominated.push_back(coin);
+    }
+    FlushObfuscationRounds();
+
+    plan.fValid = true;
+    LogPrint("obfuscation", "CWallet::GetObfuscationPlan - %u non-denominated, %u denominated outputs\n", plan.vNonDenominated.size(), plan.vDenominated.size());
+    return plan;
+}
+
 bool CWallet::SelectCoinsByDenominations(int nDenom, int64_t nValueMin, int64_t nValueMax, std::vector<CTxIn>& vCoinsRet, std::vector<COutput>& vCoinsRet2, int64_t& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax)
 {
     vCoinsRet.clear();
     nValueRet = 0;
 
     vCoinsRet2.clear();
+
+    LOCK2(cs_main, cs_wallet);
+    const CObfuscationPlan& plan = GetObfuscationPlan();
+
+    // the outputs of the denominations and rounds asked for, from their buckets
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, ONLY_DENOMINATED);
+    for (unsigned int d = 0; d < plan.vDenominatedBuckets.size(); d++) {
+        if (!(nDenom & (1 << d))) continue;
+        for (int r = std::max(nObfuscationRoundsMin, 0); r < nObfuscationRoundsMax && r < (int)plan.vDenominatedBuckets[d].size(); r++) {
+            BOOST_FOREACH (unsigned int n, plan.vDenominatedBuckets[d][r]) {
+                const CObfuscationPlan::CCoin& coin = plan.vDenominated[n];
+                vCoins.push_back(COutput(coin.tx, coin.i, coin.nDepth, true));
+            }
+        }
+    }
 
     std::random_shuffle(vCoins.rbegin(), vCoins.rend());
 
@@ -1814,10 +1968,6 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, int64_t nValueMin, int64_t
 
             CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
 
-            int rounds = GetInputObfuscationRounds(vin);
-            if (rounds >= nObfuscationRoundsMax) continue;
-            if (rounds < nObfuscationRoundsMin) continue;
-
             if (fFound10000 && fFound1000 && fFound100 && fFound10 && fFound1 && fFoundDot1) { //if fulfilled
                 //we can return this for submission
                 if (nValueRet >= nValueMin) {
@@ -1877,37 +2027,26 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, int64_t nValueMin, int64_t
 
 bool CWallet::SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax) const
 {
-    CCoinControl* coinControl = NULL;
-
     setCoinsRet.clear();
     nValueRet = 0;
 
-    vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, coinControl, nObfuscationRoundsMin < 0 ? ONLY_NONDENOMINATED_NOT_SERVICENODE_REQUIRED_AMOUNT_IFMN : ONLY_DENOMINATED);
-
-    set<pair<const CWalletTx*, unsigned int> > setCoinsRet2;
-
-    //order the array so largest nondenom are first, then denominations, then very small inputs.
-    sort(vCoins.rbegin(), vCoins.rend(), CompareByPriority());
-
-    BOOST_FOREACH (const COutput& out, vCoins) {
-        //do not allow inputs less than 1 CENT
-        if (out.tx->vout[out.i].nValue < CENT) continue;
-        //do not allow collaterals to be selected
-        if (IsCollateralAmount(out.tx->vout[out.i].nValue)) continue;
-        if (fServiceNode && out.tx->vout[out.i].nValue == SERVICENODE_REQUIRED_AMOUNT * COIN) continue; //servicenode input
+    LOCK2(cs_main, cs_wallet);
+    const CObfuscationPlan& plan = GetObfuscationPlan();
 
-        if (nValueRet + out.tx->vout[out.i].nValue <= nValueMax) {
-            CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
+    // ordered so that largest nondenom are first, then denominations, then very small inputs,
+    // without collaterals, servicenode inputs or inputs less than 1 CENT
+    const std::vector<CObfuscationPlan::CCoin>& vCoins = nObfuscationRoundsMin < 0 ? plan.vNonDenominated : plan.vDenominated;
 
-            int rounds = GetInputObfuscationRounds(vin);
-            if (rounds >= nObfuscationRoundsMax) continue;
-            if (rounds < nObfuscationRoundsMin) continue;
+    BOOST_FOREACH (const CObfuscationPlan::CCoin& coin, vCoins) {
+        const CTxOut& out = coin.tx->vout[coin.i];
+        if (nValueRet + out.nValue <= nValueMax) {
+            if (coin.nRounds >= nObfuscationRoundsMax) continue;
+            if (coin.nRounds < nObfuscationRoundsMin) continue;
 
-            vin.prevPubKey = out.tx->vout[out.i].scriptPubKey; // the inputs PubKey
-            nValueRet += out.tx->vout[out.i].nValue;
+            CTxIn vin = CTxIn(coin.tx->GetHash(), coin.i);
+            vin.prevPubKey = out.scriptPubKey; // the inputs PubKey
+            nValueRet += out.nValue;
             setCoinsRet.push_back(vin);
-            setCoinsRet2.insert(make_pair(out.tx, out.i));
         }
     }
 
@@ -1973,14 +2112,15 @@ int CWallet::CountInputsWithAmount(int64_t nInputAmount)
 
 bool CWallet::HasCollateralInputs(bool fOnlyConfirmed) const
 {
-    vector<COutput> vCoins;
-    AvailableCoins(vCoins, fOnlyConfirmed);
-
-    int nFound = 0;
-    BOOST_FOREACH (const COutput& out, vCoins)
-        if (IsCollateralAmount(out.tx->vout[out.i].nValue)) nFound++;
+    LOCK2(cs_main, cs_wallet);
+    const CObfuscationPlan& plan = GetObfuscationPlan();
+    return fOnlyConfirmed ? plan.fCollateralInputs : plan.fCollateralInputsUnconfirmed;
+}
 
-    return nFound > 0;
+int CWallet::GetObfuscationDenominations(int nObfuscationRoundsMin, int nObfuscationRoundsMax) const
+{
+    LOCK2(cs_main, cs_wallet);
+    return GetObfuscationPlan().GetDenominations(nObfuscationRoundsMin, nObfuscationRoundsMax);
 }
 
 bool CWallet::IsCollateralAmount(int64_t nInputAmount) const
@@ -3156,18 +3296,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    obfuscationPlan.fValid = false;
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    obfuscationPlan.fValid = false;
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    obfuscationPlan.fValid = false;
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -24,6 +24,7 @@
 #include "walletdb.h"
 
 #include <algorithm>
+#include <list>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -90,6 +91,67 @@ struct CompactTallyItem {
     }
 };
 
+/**
+ * Outputs of the wallet obfuscation mixes, bucketed by denomination and
+ * rounds, and the balances a mixing attempt decides on. It is built with a
+ * single pass over the wallet and reused by the attempts that follow, until
+ * the outputs of the wallet or the chain tip change.
+ */
+class CObfuscationPlan
+{
+public:
+    //! An output that can be mixed, and its rounds as of nObfuscationRounds
+    struct CCoin {
+        const CWalletTx* tx;
+        unsigned int i;
+        int nDepth;
+        int nRounds;
+    };
+
+    //! Cleared when the outputs of the wallet change
+    bool fValid;
+    //! Tip and rounds setting it was built for
+    uint256 hashTip;
+    int nRoundsTarget;
+
+    //! Non-denominated outputs to denominate and denominated ones to mix, in the order SelectCoinsDark takes them
+    std::vector<CCoin> vNonDenominated;
+    std::vector<CCoin> vDenominated;
+    //! Positions in vDenominated by denomination (as in obfuScationDenominations), then by rounds
+    std::vector<std::vector<std::vector<unsigned int> > > vDenominatedBuckets;
+
+    CAmount nAnonymizedBalance;
+    CAmount nAnonymizableBalance;
+    CAmount nDenominatedBalance;
+    CAmount nDenominatedUnconfirmedBalance;
+    bool fCollateralInputs;
+    bool fCollateralInputsUnconfirmed;
+
+    CObfuscationPlan()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        fValid = false;
+        hashTip = 0;
+        nRoundsTarget = 0;
+        vNonDenominated.clear();
+        vDenominated.clear();
+        vDenominatedBuckets.clear();
+        nAnonymizedBalance = 0;
+        nAnonymizableBalance = 0;
+        nDenominatedBalance = 0;
+        nDenominatedUnconfirmedBalance = 0;
+        fCollateralInputs = false;
+        fCollateralInputsUnconfirmed = false;
+    }
+
+    //! Session denominations (bits as CObfuscationPool::GetDenominations) with outputs of rounds in [nRoundsMin, nRoundsMax)
+    int GetDenominations(int nRoundsMin, int nRoundsMax) const;
+};
+
 /** A key pool entry */
 class CKeyPool
 {
@@ -161,6 +223,23 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Obfuscation rounds of wallet outputs, indexed by outpoint.
+     * Rounds derived from the input ancestry are persisted in the wallet
+     * database and filled in as transactions arrive, so lookups don't have
+     * to walk the ancestry again (or after a restart).
+     */
+    mutable std::map<COutPoint, int> mapObfuscationRounds;
+    //! rounds computed since the last write to the wallet database
+    mutable std::set<COutPoint> setObfuscationRoundsDirty;
+    int SetObfuscationRounds(const COutPoint& outpoint, int nRounds, bool fPersist) const;
+    void UpdateObfuscationRounds(const CWalletTx& wtx);
+    void EraseObfuscationRounds(const uint256& hash);
+
+    //! Mixable outputs and balances, reused by the mixing attempts while the wallet doesn't change
+    mutable CObfuscationPlan obfuscationPlan;
+    const CObfuscationPlan& GetObfuscationPlan() const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, int64_t nTargetAmount) const;
@@ -168,6 +247,8 @@ public:
     bool SelectCoinsByDenominations(int nDenom, int64_t nValueMin, int64_t nValueMax, std::vector<CTxIn>& vCoinsRet, std::vector<COutput>& vCoinsRet2, int64_t& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax);
     bool SelectCoinsDarkDenominated(int64_t nTargetValue, std::vector<CTxIn>& setCoinsRet, int64_t& nValueRet) const;
     bool HasCollateralInputs(bool fOnlyConfirmed = true) const;
+    //! Session denominations the wallet has outputs to mix of, to match several queued sessions against at once
+    int GetObfuscationDenominations(int nObfuscationRoundsMin, int nObfuscationRoundsMax) const;
     bool IsCollateralAmount(int64_t nInputAmount) const;
     int CountInputsWithAmount(int64_t nInputAmount);
 
@@ -371,11 +452,16 @@ public:
     typedef std::multimap<int64_t, TxPair> TxItems;
 
     /**
-     * Get the wallet's activity log
-     * @return multimap of ordered transactions and accounting entries
-     * @warning Returned pointers are *only* valid within the scope of passed acentries
+     * The wallet's activity log: transactions and accounting entries ordered by
+     * nOrderPos. Kept current as entries are added, so history can be paged
+     * from either end without sorting the whole wallet.
      */
-    TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
+    TxItems wtxOrdered;
+    //! accounting entries referenced by wtxOrdered
+    std::list<CAccountingEntry> laccentries;
+
+    void LoadAccountingEntry(const CAccountingEntry& acentry);
+    bool AddAccountingEntry(CAccountingEntry& acentry, CWalletDB& walletdb);
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
@@ -439,6 +525,10 @@ public:
     int GetRealInputObfuscationRounds(CTxIn in, int rounds) const;
     // respect current settings
     int GetInputObfuscationRounds(CTxIn in) const;
+    //! Adds a rounds entry to the index without writing it (used by LoadWallet)
+    void LoadObfuscationRounds(const COutPoint& outpoint, int nRounds);
+    //! Writes rounds computed since the last flush to the wallet database
+    void FlushObfuscationRounds() const;
 
     bool IsDenominated(const CTxIn& txin) const;
     bool IsDenominated(const CTransaction& tx) const;
@@ -68,6 +68,18 @@ bool CWalletDB::EraseTx(uint256 hash)
     return Erase(std::make_pair(std::string("tx"), hash));
 }
 
+bool CWalletDB::WriteObfuscationRounds(const COutPoint& outpoint, int nRounds)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("obfrounds"), outpoint), nRounds);
+}
+
+bool CWalletDB::EraseObfuscationRounds(const COutPoint& outpoint)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("obfrounds"), outpoint));
+}
+
 bool CWalletDB::WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta)
 {
     nWalletDBUpdated++;
@@ -263,9 +275,10 @@ bool CWalletDB::WriteAccountingEntry(const uint64_t nAccEntryNum, const CAccount
     return Write(std::make_pair(std::string("acentry"), std::make_pair(acentry.strAccount, nAccEntryNum)), acentry);
 }
 
-bool CWalletDB::WriteAccountingEntry(const CAccountingEntry& acentry)
+bool CWalletDB::WriteAccountingEntry(CAccountingEntry& acentry)
 {
-    return WriteAccountingEntry(++nAccountingEntryNumber, acentry);
+    acentry.nEntryNo = ++nAccountingEntryNumber;
+    return WriteAccountingEntry(acentry.nEntryNo, acentry);
 }
 
 CAmount CWalletDB::GetAccountCreditDebit(const string& strAccount)
@@ -337,7 +350,7 @@ DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
         txByTime.insert(make_pair(wtx->nTimeReceived, TxPair(wtx, (CAccountingEntry*)0)));
     }
     list<CAccountingEntry> acentries;
-    ListAccountCreditDebit("", acentries);
+    ListAccountCreditDebit("*", acentries);
     BOOST_FOREACH (CAccountingEntry& entry, acentries) {
         txByTime.insert(make_pair(entry.nTime, TxPair((CWalletTx*)0, &entry)));
     }
@@ -381,6 +394,15 @@ DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
     }
     WriteOrderPosNext(nOrderPosNext);
 
+    // Rebuild the wallet's activity log with the new positions, taking over
+    // the entries read above so the pointers in txByTime stay valid
+    pwallet->laccentries.swap(acentries);
+    pwallet->wtxOrdered.clear();
+    for (TxItems::iterator it = txByTime.begin(); it != txByTime.end(); ++it) {
+        const TxPair& item = (*it).second;
+        pwallet->wtxOrdered.insert(make_pair(item.first ? item.first->nOrderPos : item.second->nOrderPos, item));
+    }
+
     return DB_LOAD_OK;
 }
 
@@ -448,6 +470,12 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                 wss.fAnyUnordered = true;
 
             pwallet->AddToWallet(wtx, true);
+        } else if (strType == "obfrounds") {
+            COutPoint outpoint;
+            ssKey >> outpoint;
+            int nRounds;
+            ssValue >> nRounds;
+            pwallet->LoadObfuscationRounds(outpoint, nRounds);
         } else if (strType == "acentry") {
             string strAccount;
             ssKey >> strAccount;
@@ -456,12 +484,13 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
             if (nNumber > nAccountingEntryNumber)
                 nAccountingEntryNumber = nNumber;
 
-            if (!wss.fAnyUnordered) {
-                CAccountingEntry acentry;
-                ssValue >> acentry;
-                if (acentry.nOrderPos == -1)
-                    wss.fAnyUnordered = true;
-            }
+            CAccountingEntry acentry;
+            ssValue >> acentry;
+            acentry.strAccount = strAccount;
+            acentry.nEntryNo = nNumber;
+            if (acentry.nOrderPos == -1)
+                wss.fAnyUnordered = true;
+            pwallet->LoadAccountingEntry(acentry);
         } else if (strType == "watchs") {
             CScript script;
             ssKey >> script;